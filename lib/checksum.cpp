@@ -0,0 +1,220 @@
+/// \file checksum.cpp
+/// CRC-32 implementations, shared by the TS, Ogg and HTTP code.
+/// Both crc32 and crc32c use the polynomial 0x04C11DB7, most significant bit first.
+/// They are computed eight bytes at a time through slicing tables, or on x86 CPUs that support it,
+/// by folding 64 bytes at a time with carry-less multiplication (PCLMULQDQ), selected at runtime.
+
+#include "checksum.h"
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <immintrin.h>
+#define CRC_CLMUL 1
+#endif
+
+namespace checksum {
+  static const uint32_t POLY = 0x04C11DB7U;
+
+  /// Slicing tables and folding constants, generated from the polynomial on first use.
+  struct crcTables {
+    uint32_t slice[8][256];
+    uint64_t fold[4][2]; ///< x^(128*n+64) and x^(128*n) mod P, for folding by 1 to 4 blocks of 128 bits
+    bool clmul; ///< True if the CPU supports PCLMULQDQ and SSSE3
+    crcTables(){
+      for (uint32_t i = 0; i < 256; ++i){
+        uint32_t c = i << 24;
+        for (int j = 0; j < 8; ++j){c = (c << 1) ^ ((c & 0x80000000U) ? POLY : 0);}
+        slice[0][i] = c;
+      }
+      for (int k = 1; k < 8; ++k){
+        for (uint32_t i = 0; i < 256; ++i){
+          slice[k][i] = (slice[k - 1][i] << 8) ^ slice[0][slice[k - 1][i] >> 24];
+        }
+      }
+      for (int n = 0; n < 4; ++n){
+        fold[n][0] = xPow(128 * (n + 1) + 64);
+        fold[n][1] = xPow(128 * (n + 1));
+      }
+      clmul = false;
+#ifdef CRC_CLMUL
+      unsigned int a, b, c, d;
+      if (__get_cpuid(1, &a, &b, &c, &d)){clmul = (c & bit_PCLMUL) && (c & bit_SSSE3);}
+#endif
+    }
+    /// Returns x^n mod P.
+    static uint32_t xPow(unsigned int n){
+      uint32_t r = 1;
+      while (n--){r = (r << 1) ^ ((r & 0x80000000U) ? POLY : 0);}
+      return r;
+    }
+  };
+
+  static const crcTables & tables(){
+    static crcTables t;
+    return t;
+  }
+
+  static inline uint32_t readBE32(const char * p){
+    const unsigned char * u = (const unsigned char *)p;
+    return ((uint32_t)u[0] << 24) | ((uint32_t)u[1] << 16) | ((uint32_t)u[2] << 8) | u[3];
+  }
+
+  static inline uint32_t swap32(uint32_t v){
+    return (v >> 24) | ((v >> 8) & 0xFF00U) | ((v << 8) & 0xFF0000U) | (v << 24);
+  }
+
+  /// Slicing-by-8 implementation, for short buffers and CPUs without carry-less multiplication.
+  static uint32_t crcSlice(const crcTables & t, uint32_t crc, const char * data, size_t len){
+    while (len >= 8){
+      uint32_t a = crc ^ readBE32(data);
+      uint32_t b = readBE32(data + 4);
+      crc = t.slice[7][a >> 24] ^ t.slice[6][(a >> 16) & 0xFF] ^ t.slice[5][(a >> 8) & 0xFF] ^ t.slice[4][a & 0xFF] ^
+            t.slice[3][b >> 24] ^ t.slice[2][(b >> 16) & 0xFF] ^ t.slice[1][(b >> 8) & 0xFF] ^ t.slice[0][b & 0xFF];
+      data += 8;
+      len -= 8;
+    }
+    while (len--){crc = t.slice[0][((unsigned char)*(data++)) ^ (crc >> 24)] ^ (crc << 8);}
+    return crc;
+  }
+
+#ifdef CRC_CLMUL
+  /// Multiplies both halves of x by the matching constant, which moves x forward by the distance k was made for.
+  __attribute__((target("pclmul,ssse3"))) static inline __m128i crcFold(__m128i x, __m128i k){
+    return _mm_xor_si128(_mm_clmulepi64_si128(x, k, 0x11), _mm_clmulepi64_si128(x, k, 0x00));
+  }
+
+  /// Folds four lanes of 128 bits in parallel over the data, then hands the remainder to crcSlice.
+  /// Requires len >= 64.
+  __attribute__((target("pclmul,ssse3"))) static uint32_t crcClmul(const crcTables & t, uint32_t crc, const char * data, size_t len){
+    //Loads 16 bytes such that the first byte ends up in the most significant bits
+    const __m128i order = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    __m128i x0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)data), order);
+    __m128i x1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 16)), order);
+    __m128i x2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 32)), order);
+    __m128i x3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 48)), order);
+    x0 = _mm_xor_si128(x0, _mm_set_epi32(crc, 0, 0, 0));
+    data += 64;
+    len -= 64;
+    __m128i k = _mm_set_epi64x(t.fold[3][0], t.fold[3][1]);
+    while (len >= 64){
+      x0 = _mm_xor_si128(crcFold(x0, k), _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)data), order));
+      x1 = _mm_xor_si128(crcFold(x1, k), _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 16)), order));
+      x2 = _mm_xor_si128(crcFold(x2, k), _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 32)), order));
+      x3 = _mm_xor_si128(crcFold(x3, k), _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 48)), order));
+      data += 64;
+      len -= 64;
+    }
+    __m128i x = _mm_xor_si128(crcFold(x0, _mm_set_epi64x(t.fold[2][0], t.fold[2][1])), x3);
+    x = _mm_xor_si128(x, crcFold(x1, _mm_set_epi64x(t.fold[1][0], t.fold[1][1])));
+    k = _mm_set_epi64x(t.fold[0][0], t.fold[0][1]);
+    x = _mm_xor_si128(x, crcFold(x2, k));
+    while (len >= 16){
+      x = _mm_xor_si128(crcFold(x, k), _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)data), order));
+      data += 16;
+      len -= 16;
+    }
+    //x is congruent to everything folded so far; its CRC followed by the tail is the CRC of the whole
+    char rem[16];
+    _mm_storeu_si128((__m128i *)rem, _mm_shuffle_epi8(x, order));
+    return crcSlice(t, crcSlice(t, 0, rem, 16), data, len);
+  }
+#endif
+
+  static uint32_t crcMSB(uint32_t crc, const char * data, size_t len){
+    const crcTables & t = tables();
+#ifdef CRC_CLMUL
+    if (len >= 64 && t.clmul){return crcClmul(t, crc, data, len);}
+#endif
+    return crcSlice(t, crc, data, len);
+  }
+
+  /// Plain CRC-32 over data, as used by Ogg pages: not reflected, no final XOR.
+  unsigned int crc32c(unsigned int crc, const char * data, size_t len){
+    return crcMSB(crc, data, len);
+  }
+
+  /// CRC-32 over data, as used by MPEG-TS PSI tables, with the CRC kept in byte-swapped order.
+  /// Writing the result least significant byte first gives the big endian CRC.
+  unsigned int crc32(unsigned int crc, const char * data, size_t len){
+    return swap32(crcMSB(swap32(crc), data, len));
+  }
+
+  /// CRC-32 over data using the reflected (zlib) table, but shifting most significant bit first.
+  unsigned int crc32LE(unsigned int crc, const char * data, size_t len) {
+    static const unsigned int table[256] = {
+      0x00000000U, 0x77073096U, 0xee0e612cU, 0x990951baU,
+      0x076dc419U, 0x706af48fU, 0xe963a535U, 0x9e6495a3U,
+      0x0edb8832U, 0x79dcb8a4U, 0xe0d5e91eU, 0x97d2d988U,
+      0x09b64c2bU, 0x7eb17cbdU, 0xe7b82d07U, 0x90bf1d91U,
+      0x1db71064U, 0x6ab020f2U,	0xf3b97148U, 0x84be41deU,
+      0x1adad47dU, 0x6ddde4ebU, 0xf4d4b551U, 0x83d385c7U,
+      0x136c9856U, 0x646ba8c0U, 0xfd62f97aU, 0x8a65c9ecU,
+      0x14015c4fU, 0x63066cd9U,	0xfa0f3d63U, 0x8d080df5U,
+      0x3b6e20c8U, 0x4c69105eU, 0xd56041e4U, 0xa2677172U,
+      0x3c03e4d1U, 0x4b04d447U, 0xd20d85fdU, 0xa50ab56bU,
+      0x35b5a8faU, 0x42b2986cU,	0xdbbbc9d6U, 0xacbcf940U,
+      0x32d86ce3U, 0x45df5c75U, 0xdcd60dcfU, 0xabd13d59U,
+      0x26d930acU, 0x51de003aU, 0xc8d75180U, 0xbfd06116U,
+      0x21b4f4b5U, 0x56b3c423U,	0xcfba9599U, 0xb8bda50fU,
+      0x2802b89eU, 0x5f058808U, 0xc60cd9b2U, 0xb10be924U,
+      0x2f6f7c87U, 0x58684c11U, 0xc1611dabU, 0xb6662d3dU,
+      0x76dc4190U, 0x01db7106U,	0x98d220bcU, 0xefd5102aU,
+      0x71b18589U, 0x06b6b51fU, 0x9fbfe4a5U, 0xe8b8d433U,
+      0x7807c9a2U, 0x0f00f934U, 0x9609a88eU, 0xe10e9818U,
+      0x7f6a0dbbU, 0x086d3d2dU,	0x91646c97U, 0xe6635c01U,
+      0x6b6b51f4U, 0x1c6c6162U, 0x856530d8U, 0xf262004eU,
+      0x6c0695edU, 0x1b01a57bU, 0x8208f4c1U, 0xf50fc457U,
+      0x65b0d9c6U, 0x12b7e950U,	0x8bbeb8eaU, 0xfcb9887cU,
+      0x62dd1ddfU, 0x15da2d49U, 0x8cd37cf3U, 0xfbd44c65U,
+      0x4db26158U, 0x3ab551ceU, 0xa3bc0074U, 0xd4bb30e2U,
+      0x4adfa541U, 0x3dd895d7U,	0xa4d1c46dU, 0xd3d6f4fbU,
+      0x4369e96aU, 0x346ed9fcU, 0xad678846U, 0xda60b8d0U,
+      0x44042d73U, 0x33031de5U, 0xaa0a4c5fU, 0xdd0d7cc9U,
+      0x5005713cU, 0x270241aaU,	0xbe0b1010U, 0xc90c2086U,
+      0x5768b525U, 0x206f85b3U, 0xb966d409U, 0xce61e49fU,
+      0x5edef90eU, 0x29d9c998U, 0xb0d09822U, 0xc7d7a8b4U,
+      0x59b33d17U, 0x2eb40d81U,	0xb7bd5c3bU, 0xc0ba6cadU,
+      0xedb88320U, 0x9abfb3b6U, 0x03b6e20cU, 0x74b1d29aU,
+      0xead54739U, 0x9dd277afU, 0x04db2615U, 0x73dc1683U,
+      0xe3630b12U, 0x94643b84U,	0x0d6d6a3eU, 0x7a6a5aa8U,
+      0xe40ecf0bU, 0x9309ff9dU, 0x0a00ae27U, 0x7d079eb1U,
+      0xf00f9344U, 0x8708a3d2U, 0x1e01f268U, 0x6906c2feU,
+      0xf762575dU, 0x806567cbU,	0x196c3671U, 0x6e6b06e7U,
+      0xfed41b76U, 0x89d32be0U, 0x10da7a5aU, 0x67dd4accU,
+      0xf9b9df6fU, 0x8ebeeff9U, 0x17b7be43U, 0x60b08ed5U,
+      0xd6d6a3e8U, 0xa1d1937eU,	0x38d8c2c4U, 0x4fdff252U,
+      0xd1bb67f1U, 0xa6bc5767U, 0x3fb506ddU, 0x48b2364bU,
+      0xd80d2bdaU, 0xaf0a1b4cU, 0x36034af6U, 0x41047a60U,
+      0xdf60efc3U, 0xa867df55U,	0x316e8eefU, 0x4669be79U,
+      0xcb61b38cU, 0xbc66831aU, 0x256fd2a0U, 0x5268e236U,
+      0xcc0c7795U, 0xbb0b4703U, 0x220216b9U, 0x5505262fU,
+      0xc5ba3bbeU, 0xb2bd0b28U,	0x2bb45a92U, 0x5cb36a04U,
+      0xc2d7ffa7U, 0xb5d0cf31U, 0x2cd99e8bU, 0x5bdeae1dU,
+      0x9b64c2b0U, 0xec63f226U, 0x756aa39cU, 0x026d930aU,
+      0x9c0906a9U, 0xeb0e363fU,	0x72076785U, 0x05005713U,
+      0x95bf4a82U, 0xe2b87a14U, 0x7bb12baeU, 0x0cb61b38U,
+      0x92d28e9bU, 0xe5d5be0dU, 0x7cdcefb7U, 0x0bdbdf21U,
+      0x86d3d2d4U, 0xf1d4e242U,	0x68ddb3f8U, 0x1fda836eU,
+      0x81be16cdU, 0xf6b9265bU, 0x6fb077e1U, 0x18b74777U,
+      0x88085ae6U, 0xff0f6a70U, 0x66063bcaU, 0x11010b5cU,
+      0x8f659effU, 0xf862ae69U,	0x616bffd3U, 0x166ccf45U,
+      0xa00ae278U, 0xd70dd2eeU, 0x4e048354U, 0x3903b3c2U,
+      0xa7672661U, 0xd06016f7U, 0x4969474dU, 0x3e6e77dbU,
+      0xaed16a4aU, 0xd9d65adcU,	0x40df0b66U, 0x37d83bf0U,
+      0xa9bcae53U, 0xdebb9ec5U, 0x47b2cf7fU, 0x30b5ffe9U,
+      0xbdbdf21cU, 0xcabac28aU, 0x53b39330U, 0x24b4a3a6U,
+      0xbad03605U, 0xcdd70693U,	0x54de5729U, 0x23d967bfU,
+      0xb3667a2eU, 0xc4614ab8U, 0x5d681b02U, 0x2a6f2b94U,
+      0xb40bbe37U, 0xc30c8ea1U, 0x5a05df1bU, 0x2d02ef8dU
+    };
+
+    while (len > 0) {
+      crc = table[*data ^ ((crc >> 24) & 0xff)] ^ (crc << 8);
+      data++;
+      len--;
+    }
+    return crc;
+  }
+}
@@ -32,18 +32,13 @@ static const char * DBG_LVL_LIST[] = {"NONE", "FAIL", "ERROR", "WARN", "INFO", "
 
 #if !defined(__APPLE__) && !defined(__MACH__) && defined(__GNUC__)
 #include <errno.h>
-
-#if DEBUG >= DLVL_DEVEL
-#define DEBUG_MSG(lvl, msg, ...) if (Util::Config::printDebugLevel >= lvl){fprintf(stderr, "%s|%s|%d|%s:%d|" msg "\n", DBG_LVL_LIST[lvl], program_invocation_short_name, getpid(), __FILE__, __LINE__, ##__VA_ARGS__);}
-#else
-#define DEBUG_MSG(lvl, msg, ...) if (Util::Config::printDebugLevel >= lvl){fprintf(stderr, "%s|%s|%d||" msg "\n", DBG_LVL_LIST[lvl], program_invocation_short_name, getpid(), ##__VA_ARGS__);}
 #endif
-#else
+#include "log_ring.h"
+
 #if DEBUG >= DLVL_DEVEL
-#define DEBUG_MSG(lvl, msg, ...) if (Util::Config::printDebugLevel >= lvl){fprintf(stderr, "%s||%d|%s:%d|" msg "\n", DBG_LVL_LIST[lvl], getpid(), __FILE__, __LINE__, ##__VA_ARGS__);}
+#define DEBUG_MSG(lvl, msg, ...) if (Util::Config::printDebugLevel >= lvl){LogRing::log(lvl, __FILE__, __LINE__, msg, ##__VA_ARGS__);}
 #else
-#define DEBUG_MSG(lvl, msg, ...) if (Util::Config::printDebugLevel >= lvl){fprintf(stderr, "%s||%d||" msg "\n", DBG_LVL_LIST[lvl], getpid(), ##__VA_ARGS__);}
-#endif
+#define DEBUG_MSG(lvl, msg, ...) if (Util::Config::printDebugLevel >= lvl){LogRing::log(lvl, 0, 0, msg, ##__VA_ARGS__);}
 #endif
 
 #if defined(_WIN32) || defined(__CYGWIN__)
@@ -93,6 +88,9 @@ static inline void show_stackframe(){}
 #define SHM_DATASIZE 20
 #endif
 
+/// Pages at least this large are marked for transparent huge page backing when compiled with SHM_HUGEPAGES.
+#define SHM_HUGEPAGE_MIN 2 * 1024 * 1024
+
 #define AUDIO_KEY_INTERVAL 5000 ///< This define controls the keyframe interval for non-video tracks, such as audio and metadata tracks.
 
 #ifndef STATS_DELAY
@@ -110,6 +108,9 @@ static inline void show_stackframe(){}
 /// The size used for stream data pages under Windows, where they cannot be size-detected.
 #define DEFAULT_DATA_PAGE_SIZE SHM_DATASIZE * 1024 * 1024
 
+/// The smallest size used for live stream data pages that are sized from the measured track bitrate.
+#define MIN_DATA_PAGE_SIZE 2 * 1024 * 1024
+
 /// The size used for server configuration pages.
 #define DEFAULT_CONF_PAGE_SIZE 4 * 1024 * 1024
 
@@ -121,9 +122,28 @@ static inline void show_stackframe(){}
 /// Does not affect live streams.
 #define FLIP_MIN_DURATION 20000
 
+/// The amount of previously played data pages per track that outputs keep mapped for re-use.
+#define OUTPUT_PAGE_CACHE_SIZE 4
+
 /// Interval where the input refreshes the user data for stats etc.
 #define INPUT_USER_INTERVAL 1000
 
+/// The minimum amount of pages per track that VoD inputs load ahead of each viewer.
+#ifndef INPUT_READAHEAD_PAGES
+#define INPUT_READAHEAD_PAGES 2
+#endif
+
+/// The maximum amount of worker processes VoD inputs use to load pages concurrently.
+#ifndef INPUT_PAGE_WORKERS
+#define INPUT_PAGE_WORKERS 4
+#endif
+
+/// VoD pages used less than this many milliseconds ago are never evicted to stay within the server's page memory budget.
+#define INPUT_EVICT_MIN_AGE 2 * INPUT_USER_INTERVAL
+
+/// Interval in milliseconds at which VoD inputs re-read the server-wide page memory budget from the configuration.
+#define INPUT_BUDGET_INTERVAL 10000
+
 #define SHM_STREAM_INDEX "MstSTRM%s" //%s stream name
 #define SHM_STREAM_STATE "MstSTATE%s" //%s stream name
 #define STRMSTAT_OFF 0
@@ -142,11 +162,27 @@ static inline void show_stackframe(){}
 #define SHM_TRIGGER "MstTRIG%s" //%s trigger name
 #define SEM_LIVE "/MstLIVE%s" //%s stream name
 #define SEM_INPUT "/MstInpt%s" //%s stream name
+#define SEM_PAGES "/MstPage%s" //%s stream name
 #define SEM_CONF "/MstConfLock"
 #define SHM_CONF "MstConf"
+#define SHM_ROUTES "MstRoutes"
+#define SHM_ROUTES_SIZE 64*1024
+#define ROUTE_PREFIX 1 //route flag: url_prefix instead of url_match pattern
+#define ROUTE_CAPTURE 2 //route flag: pattern contains a stream name placeholder
 #define SHM_STATE_LOGS "MstStateLogs"
+#define SHM_LOG_RING "MstLogRing"
 #define SHM_STATE_ACCS "MstStateAccs"
 #define SHM_STATE_STREAMS "MstStateStreams"
+#define SHM_STATE_PAGES "MstStatePages"
+#define SEM_STATE_PAGES "/MstStatePages"
+#define SHM_STATE_PAGES_SIZE 1024*1024
+#define SHM_STATE_METRICS "MstStateMetrics"
+#define SEM_STATE_METRICS "/MstStateMetrics"
+#define SHM_STATE_METRICS_SIZE 4*1024*1024
+#define SHM_STATE_INFO "MstStateInfo"
+#define SEM_STATE_INFO "/MstStateInfo"
+#define SHM_STATE_INFO_SIZE 4*1024*1024
+#define INFO_CACHE_MAX 16*1024 //largest stream info response that is cached, in bytes
 #define NAME_BUFFER_SIZE 200    //char buffer size for snprintf'ing shm filenames
 
 #define SIMUL_TRACKS 20
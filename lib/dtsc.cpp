@@ -3,9 +3,13 @@
 
 #include "dtsc.h"
 #include "defines.h"
+#include "bitfields.h"
 #include <stdlib.h>
 #include <string.h> //for memcmp
 #include <arpa/inet.h> //for htonl/ntohl
+#include <algorithm>
+#include <sys/mman.h>
+#include <unistd.h>
 char DTSC::Magic_Header[] = "DTSC";
 char DTSC::Magic_Packet[] = "DTPD";
 char DTSC::Magic_Packet2[] = "DTP2";
@@ -15,20 +19,40 @@ DTSC::File::File() {
   F = 0;
   buffer = malloc(4);
   endPos = 0;
+  mapped = 0;
+  mapLen = 0;
+  readPos = 0;
+  atEOF = false;
 }
 
 DTSC::File::File(const File & rhs) {
   buffer = malloc(4);
+  mapped = 0;
   *this = rhs;
 }
 
 DTSC::File & DTSC::File::operator =(const File & rhs) {
   created = rhs.created;
+  if (mapped) {
+    munmap(mapped, mapLen);
+    mapped = 0;
+  }
   if (rhs.F) {
     F = fdopen(dup(fileno(rhs.F)), (created ? "w+b" : "r+b"));
   } else {
     F = 0;
   }
+  mapLen = 0;
+  if (F && rhs.mapped) {
+    mapped = (char *)mmap(0, rhs.mapLen, PROT_READ, MAP_SHARED, fileno(F), 0);
+    if (mapped == MAP_FAILED) {
+      mapped = 0;
+    } else {
+      mapLen = rhs.mapLen;
+    }
+  }
+  readPos = rhs.readPos;
+  atEOF = rhs.atEOF;
   endPos = rhs.endPos;
   if (rhs.myPack) {
     myPack = rhs.myPack;
@@ -61,17 +85,33 @@ DTSC::File::File(std::string filename, bool create) {
     fwrite(DTSC::Magic_Header, 4, 1, F);
     memset(buffer, 0, 4);
     fwrite(buffer, 4, 1, F); //write 4 zero-bytes
+    fflush(F);
     headerSize = 0;
   } else {
     F = fopen(filename.c_str(), "r+b");
   }
   created = create;
+  mapped = 0;
+  mapLen = 0;
+  readPos = 0;
+  atEOF = false;
   if (!F) {
     HIGH_MSG("Could not open file %s", filename.c_str());
     return;
   }
   fseek(F, 0, SEEK_END);
   endPos = ftell(F);
+  //Map existing files for reading, so packets can be read without a syscall per read
+  if (!create && endPos) {
+    mapped = (char *)mmap(0, endPos, PROT_READ, MAP_SHARED, fileno(F), 0);
+    if (mapped == MAP_FAILED) {
+      WARN_MSG("Could not map %s, falling back to regular reads: %s", filename.c_str(), strerror(errno));
+      mapped = 0;
+    } else {
+      mapLen = endPos;
+      madvise(mapped, mapLen, MADV_SEQUENTIAL);
+    }
+  }
 
   bool sepHeader = false;
   if (!create) {
@@ -99,18 +139,19 @@ DTSC::File::File(std::string filename, bool create) {
     fseek(F, 4, SEEK_SET);
     memset(buffer, 0, 4);
     fwrite(buffer, 4, 1, F); //write 4 zero-bytes
+    fflush(F);
   } else {
     headerSize = ntohl(((uint32_t *)buffer)[0]);
   }
   if (metadata.moreheader != -1) {
     if (!sepHeader) {
       readHeader(0);
-      fseek(F, 8 + headerSize, SEEK_SET);
+      seek_bpos(8 + headerSize);
     } else {
-      fseek(F, 0, SEEK_SET);
+      seek_bpos(0);
     }
   } else {
-    fseek(F, 0, SEEK_SET);
+    seek_bpos(0);
     File Fhead(filename + ".dtsh");
     if (Fhead) {
       metadata = Fhead.metadata;
@@ -143,6 +184,7 @@ bool DTSC::File::writeHeader(std::string & header, bool force) {
   fseek(F, 8, SEEK_SET);
   int ret = fwrite(header.c_str(), headerSize, 1, F);
   fseek(F, 8 + headerSize, SEEK_SET);
+  fflush(F);
   return (ret == 1);
 }
 
@@ -161,6 +203,7 @@ long long int DTSC::File::addHeader(std::string & header) {
     return 0;
   }
   ret = fwrite(header.c_str(), header.size(), 1, F); //write contents
+  fflush(F);
   if (ret != 1) {
     return 0;
   }
@@ -173,9 +216,9 @@ long long int DTSC::File::addHeader(std::string & header) {
 /// If the packet could not be read for any reason, the reason is printed.
 /// Reading the header means the file position is moved to after the header.
 void DTSC::File::readHeader(int pos) {
-  fseek(F, pos, SEEK_SET);
-  if (fread(buffer, 4, 1, F) != 1) {
-    if (feof(F)) {
+  const char * header = readAt(pos, 8);
+  if (!header) {
+    if (atEOF) {
       DEBUG_MSG(DLVL_DEVEL, "End of file reached while reading header @ %d", pos);
     } else {
       DEBUG_MSG(DLVL_ERROR, "Could not read header @ %d", pos);
@@ -183,28 +226,20 @@ void DTSC::File::readHeader(int pos) {
     metadata = Meta();
     return;
   }
-  if (memcmp(buffer, DTSC::Magic_Header, 4) != 0) {
-    DEBUG_MSG(DLVL_ERROR, "Invalid header - %.4s != %.4s  @ %i", (char *)buffer, DTSC::Magic_Header, pos);
+  if (memcmp(header, DTSC::Magic_Header, 4) != 0) {
+    DEBUG_MSG(DLVL_ERROR, "Invalid header - %.4s != %.4s  @ %i", header, DTSC::Magic_Header, pos);
     metadata = Meta();
     return;
   }
-  if (fread(buffer, 4, 1, F) != 1) {
-    DEBUG_MSG(DLVL_ERROR, "Could not read header size @ %i", pos);
+  long packSize = Bit::btohl(header + 4) + 8;
+  header = readAt(pos, packSize);
+  if (!header) {
+    DEBUG_MSG(DLVL_ERROR, "Could not read header packet @ %i", pos);
     metadata = Meta();
     return;
   }
-  long packSize = ntohl(((unsigned long *)buffer)[0]) + 8;
-  std::string strBuffer;
-  strBuffer.resize(packSize);
-  if (packSize) {
-    fseek(F, pos, SEEK_SET);
-    if (fread((void *)strBuffer.c_str(), packSize, 1, F) != 1) {
-      DEBUG_MSG(DLVL_ERROR, "Could not read header packet @ %i", pos);
-      metadata = Meta();
-      return;
-    }
-    metadata = Meta(DTSC::Packet(strBuffer.data(), strBuffer.size(),true));
-  }
+  readPos = pos + packSize;
+  metadata = Meta(DTSC::Packet(header, packSize, true));
   //if there is another header, read it and replace metadata with that one.
   if (metadata.moreheader) {
     if (metadata.moreheader < getBytePosEOF()) {
@@ -222,11 +257,33 @@ long int DTSC::File::getBytePosEOF() {
 }
 
 long int DTSC::File::getBytePos() {
-  return ftell(F);
+  return readPos;
 }
 
 bool DTSC::File::reachedEOF() {
-  return feof(F);
+  return atEOF;
+}
+
+/// Returns a pointer to len bytes of file data at position pos, or null if those could not be read.
+/// Data within the mapped range is returned in place; anything else is read into readBuffer.
+/// The returned pointer is only valid until the next call.
+/// All writing functions flush what they wrote, so pread here always sees it.
+const char * DTSC::File::readAt(long long int pos, unsigned int len) {
+  if (mapped && pos >= 0 && pos + len <= mapLen) {
+    return mapped + pos;
+  }
+  if (!F) {
+    return 0;
+  }
+  readBuffer.resize(len);
+  ssize_t ret = pread(fileno(F), (void *)readBuffer.data(), len, pos);
+  if (ret != (ssize_t)len) {
+    if (ret >= 0) {
+      atEOF = true;
+    }
+    return 0;
+  }
+  return readBuffer.data();
 }
 
 /// Reads the packet available at the current file position.
@@ -238,17 +295,14 @@ void DTSC::File::seekNext() {
     myPack.null();
     return;
   }
-  seekPos thisPos = *currentPositions.begin();
-  fseek(F, thisPos.bytePos, SEEK_SET);
-  if (reachedEOF()) {
-    myPack.null();
-    return;
-  }
-  clearerr(F);
-  currentPositions.erase(currentPositions.begin());
-  lastreadpos = ftell(F);
-  if (fread(buffer, 4, 1, F) != 1) {
-    if (feof(F)) {
+  std::vector<seekPos>::iterator nextPos = std::min_element(currentPositions.begin(), currentPositions.end());
+  seekPos thisPos = *nextPos;
+  seek_bpos(thisPos.bytePos);
+  currentPositions.erase(nextPos);
+  lastreadpos = readPos;
+  const char * header = readAt(lastreadpos, 8);
+  if (!header) {
+    if (atEOF) {
       DEBUG_MSG(DLVL_DEVEL, "End of file reached while seeking @ %i", (int)lastreadpos);
     } else {
       DEBUG_MSG(DLVL_ERROR, "Could not seek to next @ %i", (int)lastreadpos);
@@ -256,56 +310,37 @@ void DTSC::File::seekNext() {
     myPack.null();
     return;
   }
-  if (memcmp(buffer, DTSC::Magic_Header, 4) == 0) {
+  if (memcmp(header, DTSC::Magic_Header, 4) == 0) {
     seek_time(myPack.getTime(), myPack.getTrackId(), true);
     return seekNext();
   }
-  long long unsigned int version = 0;
-  if (memcmp(buffer, DTSC::Magic_Packet, 4) == 0) {
-    version = 1;
-  }
-  if (memcmp(buffer, DTSC::Magic_Packet2, 4) == 0) {
-    version = 2;
-  }
-  if (version == 0) {
-    DEBUG_MSG(DLVL_ERROR, "Invalid packet header @ %#x - %.4s != %.4s @ %d", (unsigned int)lastreadpos, (char *)buffer, DTSC::Magic_Packet2, (int)lastreadpos);
+  if (memcmp(header, DTSC::Magic_Packet, 4) != 0 && memcmp(header, DTSC::Magic_Packet2, 4) != 0) {
+    DEBUG_MSG(DLVL_ERROR, "Invalid packet header @ %#x - %.4s != %.4s @ %d", (unsigned int)lastreadpos, header, DTSC::Magic_Packet2, (int)lastreadpos);
     myPack.null();
     return;
   }
-  if (fread(buffer, 4, 1, F) != 1) {
-    DEBUG_MSG(DLVL_ERROR, "Could not read packet size @ %d", (int)lastreadpos);
-    myPack.null();
-    return;
-  }
-  long packSize = ntohl(((unsigned long *)buffer)[0]);
-  char * packBuffer = (char *)malloc(packSize + 8);
-  if (version == 1) {
-    memcpy(packBuffer, "DTPD", 4);
-  } else {
-    memcpy(packBuffer, "DTP2", 4);
-  }
-  memcpy(packBuffer + 4, buffer, 4);
-  if (fread((void *)(packBuffer + 8), packSize, 1, F) != 1) {
+  long packSize = Bit::btohl(header + 4);
+  const char * packData = readAt(lastreadpos, packSize + 8);
+  if (!packData) {
     DEBUG_MSG(DLVL_ERROR, "Could not read packet @ %d", (int)lastreadpos);
     myPack.null();
-    free(packBuffer);
     return;
   }
-  myPack.reInit(packBuffer, packSize + 8);
-  free(packBuffer);
+  myPack.reInit(packData, packSize + 8);
+  readPos = lastreadpos + packSize + 8;
   if (metadata.merged) {
-    int tempLoc = getBytePos();
-    char newHeader[20];
+    long long int tempLoc = getBytePos();
     bool insert = false;
     seekPos tmpPos;
-    if (fread((void *)newHeader, 20, 1, F) == 1) {
+    const char * newHeader = readAt(tempLoc, 20);
+    if (newHeader) {
       if (memcmp(newHeader, DTSC::Magic_Packet2, 4) == 0) {
         tmpPos.bytePos = tempLoc;
-        tmpPos.trackID = ntohl(((int *)newHeader)[2]);
+        tmpPos.trackID = Bit::btohl(newHeader + 8);
         tmpPos.seekTime = 0;
         if (selectedTracks.find(tmpPos.trackID) != selectedTracks.end()) {
-          tmpPos.seekTime = ((long long unsigned int)ntohl(((int *)newHeader)[3])) << 32;
-          tmpPos.seekTime += ntohl(((int *)newHeader)[4]);
+          tmpPos.seekTime = ((long long unsigned int)Bit::btohl(newHeader + 12)) << 32;
+          tmpPos.seekTime += Bit::btohl(newHeader + 16);
           insert = true;
         } else {
           long tid = myPack.getTrackId();
@@ -320,7 +355,7 @@ void DTSC::File::seekNext() {
           }
         }
         if (currentPositions.size()) {
-          for (std::set<seekPos>::iterator curPosIter = currentPositions.begin(); curPosIter != currentPositions.end(); curPosIter++) {
+          for (std::vector<seekPos>::iterator curPosIter = currentPositions.begin(); curPosIter != currentPositions.end(); curPosIter++) {
             if ((*curPosIter).trackID == tmpPos.trackID && (*curPosIter).seekTime >= tmpPos.seekTime) {
               insert = false;
               break;
@@ -333,22 +368,22 @@ void DTSC::File::seekNext() {
       if (tmpPos.seekTime > 0xffffffffffffff00ll){
         tmpPos.seekTime = 0;
       }
-      currentPositions.insert(tmpPos);
+      currentPositions.push_back(tmpPos);
     } else {
       seek_time(myPack.getTime(), myPack.getTrackId(), true);
     }
     seek_bpos(tempLoc);
   }else{
     seek_time(thisPos.seekTime, thisPos.trackID);
-    fseek(F, thisPos.bytePos, SEEK_SET);
+    seek_bpos(thisPos.bytePos);
   }
 }
 
 void DTSC::File::parseNext(){
-  char header_buffer[4] = {0, 0, 0, 0};
-  lastreadpos = ftell(F);
-  if (fread(header_buffer, 4, 1, F) != 1) {
-    if (feof(F)) {
+  lastreadpos = readPos;
+  const char * header = readAt(lastreadpos, 8);
+  if (!header) {
+    if (atEOF) {
       DEBUG_MSG(DLVL_DEVEL, "End of file reached @ %d", (int)lastreadpos);
     } else {
       DEBUG_MSG(DLVL_ERROR, "Could not read header @ %d", (int)lastreadpos);
@@ -356,35 +391,20 @@ void DTSC::File::parseNext(){
     myPack.null();
     return;
   }
-  long long unsigned int version = 0;
-  if (memcmp(header_buffer, DTSC::Magic_Packet, 4) == 0 || memcmp(header_buffer, DTSC::Magic_Command, 4) == 0 || memcmp(header_buffer, DTSC::Magic_Header, 4) == 0) {
-    version = 1;
-  }
-  if (memcmp(header_buffer, DTSC::Magic_Packet2, 4) == 0) {
-    version = 2;
-  }
-  if (version == 0) {
-    DEBUG_MSG(DLVL_ERROR, "Invalid packet header @ %#x: %.4s", (unsigned int)lastreadpos, (char *)buffer);
+  if (memcmp(header, DTSC::Magic_Packet, 4) != 0 && memcmp(header, DTSC::Magic_Command, 4) != 0 && memcmp(header, DTSC::Magic_Header, 4) != 0 && memcmp(header, DTSC::Magic_Packet2, 4) != 0) {
+    DEBUG_MSG(DLVL_ERROR, "Invalid packet header @ %#x: %.4s", (unsigned int)lastreadpos, header);
     myPack.null();
     return;
   }
-  if (fread(buffer, 4, 1, F) != 1) {
-    DEBUG_MSG(DLVL_ERROR, "Could not read packet size @ %#x", (unsigned int)lastreadpos);
-    myPack.null();
-    return;
-  }
-  long packSize = ntohl(((unsigned long *)buffer)[0]);
-  char * packBuffer = (char *)malloc(packSize + 8);
-  memcpy(packBuffer, header_buffer, 4);
-  memcpy(packBuffer + 4, buffer, 4);
-  if (fread((void *)(packBuffer + 8), packSize, 1, F) != 1) {
+  long packSize = Bit::btohl(header + 4);
+  const char * packData = readAt(lastreadpos, packSize + 8);
+  if (!packData) {
     DEBUG_MSG(DLVL_ERROR, "Could not read packet @ %d", (int)lastreadpos);
     myPack.null();
-    free(packBuffer);
     return;
   }
-  myPack.reInit(packBuffer, packSize + 8);
-  free(packBuffer);
+  myPack.reInit(packData, packSize + 8);
+  readPos = lastreadpos + packSize + 8;
 }
 
 /// Returns the byte positon of the start of the last packet that was read.
@@ -413,25 +433,31 @@ bool DTSC::File::seek_time(unsigned int ms, unsigned int trackNo, bool forceSeek
     tmpPos.bytePos = 0;
   }
   if (reachedEOF()) {
-    clearerr(F);
     seek_bpos(0);
     tmpPos.bytePos = 0;
     tmpPos.seekTime = 0;
   }
   DTSC::Track & trackRef = metadata.tracks[trackNo];
-  for (unsigned int i = 0; i < trackRef.keys.size(); i++) {
-    long keyTime = trackRef.keys[i].getTime();
-    if (keyTime > ms) {
-      break;
+  //Binary search for the last key at or before ms
+  unsigned int lo = 0, hi = trackRef.keys.size();
+  while (lo < hi) {
+    unsigned int mid = lo + (hi - lo) / 2;
+    if (trackRef.keys[mid].getTime() > ms) {
+      hi = mid;
+    } else {
+      lo = mid + 1;
     }
+  }
+  if (lo) {
+    long keyTime = trackRef.keys[lo - 1].getTime();
     if ((long long unsigned int)keyTime > tmpPos.seekTime) {
       tmpPos.seekTime = keyTime;
-      tmpPos.bytePos = trackRef.keys[i].getBpos();
+      tmpPos.bytePos = trackRef.keys[lo - 1].getBpos();
     }
   }
   bool foundPacket = false;
   while (!foundPacket) {
-    lastreadpos = ftell(F);
+    lastreadpos = readPos;
     if (reachedEOF()) {
       DEBUG_MSG(DLVL_WARN, "Reached EOF during seek to %u in track %d - aborting @ %lld", ms, trackNo, lastreadpos);
       return false;
@@ -439,14 +465,14 @@ bool DTSC::File::seek_time(unsigned int ms, unsigned int trackNo, bool forceSeek
     //Seek to first packet after ms.
     seek_bpos(tmpPos.bytePos);
     //read the header
-    char header[20];
-    if (fread((void *)header, 20, 1, F) != 1){
+    const char * header = readAt(tmpPos.bytePos, 20);
+    if (!header){
       DEBUG_MSG(DLVL_WARN, "Could not read header from file. Much sadface.");
       return false;
     }
     //check if packetID matches, if not, skip size + 8 bytes.
-    int packSize = ntohl(((int *)header)[1]);
-    unsigned int packID = ntohl(((int *)header)[2]);
+    int packSize = Bit::btohl(header + 4);
+    unsigned int packID = Bit::btohl(header + 8);
     if (memcmp(header, Magic_Packet2, 4) != 0 || packID != trackNo) {
       if (memcmp(header, "DT", 2) != 0) {
         DEBUG_MSG(DLVL_WARN, "Invalid header during seek to %u in track %d @ %lld - resetting bytePos from %lld to zero", ms, trackNo, lastreadpos, tmpPos.bytePos);
@@ -457,8 +483,8 @@ bool DTSC::File::seek_time(unsigned int ms, unsigned int trackNo, bool forceSeek
       continue;
     }
     //get timestamp of packet, if too large, break, if not, skip size bytes.
-    long long unsigned int myTime = ((long long unsigned int)ntohl(((int *)header)[3]) << 32);
-    myTime += ntohl(((int *)header)[4]);
+    long long unsigned int myTime = ((long long unsigned int)Bit::btohl(header + 12) << 32);
+    myTime += Bit::btohl(header + 16);
     tmpPos.seekTime = myTime;
     if (myTime >= ms) {
       foundPacket = true;
@@ -471,7 +497,7 @@ bool DTSC::File::seek_time(unsigned int ms, unsigned int trackNo, bool forceSeek
   if (tmpPos.seekTime > 0xffffffffffffff00ll){
     tmpPos.seekTime = 0;
   }
-  currentPositions.insert(tmpPos);
+  currentPositions.push_back(tmpPos);
   return true;
 }
 
@@ -487,16 +513,19 @@ bool DTSC::File::seek_time(unsigned int ms) {
   return true;
 }
 
-bool DTSC::File::seek_bpos(int bpos) {
-  if (fseek(F, bpos, SEEK_SET) == 0) {
-    return true;
+bool DTSC::File::seek_bpos(long long int bpos) {
+  if (bpos < 0) {
+    return false;
   }
-  return false;
+  readPos = bpos;
+  atEOF = false;
+  return true;
 }
 
 void DTSC::File::rewritePacket(std::string & newPacket, int bytePos) {
   fseek(F, bytePos, SEEK_SET);
   fwrite(newPacket.c_str(), newPacket.size(), 1, F);
+  fflush(F);
   fseek(F, 0, SEEK_END);
   if (ftell(F) > endPos) {
     endPos = ftell(F);
@@ -506,6 +535,7 @@ void DTSC::File::rewritePacket(std::string & newPacket, int bytePos) {
 void DTSC::File::writePacket(std::string & newPacket) {
   fseek(F, 0, SEEK_END);
   fwrite(newPacket.c_str(), newPacket.size(), 1, F); //write contents
+  fflush(F);
   fseek(F, 0, SEEK_END);
   endPos = ftell(F);
 }
@@ -536,6 +566,10 @@ void DTSC::File::selectTracks(std::set<unsigned long> & tracks) {
 
 /// Close the file if open
 DTSC::File::~File() {
+  if (mapped) {
+    munmap(mapped, mapLen);
+    mapped = 0;
+  }
   if (F) {
     fclose(F);
     F = 0;
@@ -408,7 +408,7 @@ namespace DTSC {
       DTSC::Packet & getPacket();
       bool seek_time(unsigned int ms);
       bool seek_time(unsigned int ms, unsigned int trackNo, bool forceSeek = false);
-      bool seek_bpos(int bpos);
+      bool seek_bpos(long long int bpos);
       void rewritePacket(std::string & newPacket, int bytePos);
       void writePacket(std::string & newPacket);
       void writePacket(JSON::Value & newPacket);
@@ -417,6 +417,7 @@ namespace DTSC {
     private:
       long int endPos;
       void readHeader(int pos);
+      const char * readAt(long long int pos, unsigned int len);
       DTSC::Packet myPack;
       Meta metadata;
       std::map<unsigned int, std::string> trackMapping;
@@ -427,7 +428,12 @@ namespace DTSC {
       unsigned long headerSize;
       void * buffer;
       bool created;
-      std::set<seekPos> currentPositions;
+      char * mapped;///< Read-only mapping of the file as it was when opened, if available.
+      long long int mapLen;///< Length of the mapping in bytes.
+      long long int readPos;///< Current read position in the file.
+      bool atEOF;///< Set when a read went past the end of the file, cleared by seeking.
+      std::string readBuffer;///< Holds data read from beyond the mapped range.
+      std::vector<seekPos> currentPositions;///< Next read position per selected track; the lowest one is read next.
       std::set<unsigned long> selectedTracks;
   };
   //FileWriter
@@ -0,0 +1,515 @@
+/// \file fanout.cpp
+/// Serving all live viewers of a stream through one output process.
+
+#include "fanout.h"
+#include "checksum.h"
+#include "defines.h"
+#include "stream.h"
+#include "timing.h"
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
+
+#define HANDOFF_INFO_SIZE 20 ///< Binary host (16 bytes) and user agent checksum (4 bytes)
+
+namespace FanOut{
+
+  /// Drops a reference to a chunk, freeing it when it was the last one.
+  static void release(chunk * c){
+    if (!__sync_sub_and_fetch(&c->refs, 1)){delete c;}
+  }
+
+  /// Returns the path of the socket the hub for the given stream and protocol listens on.
+  /// Stream names are hashed, as they may be longer than a socket path can be.
+  std::string hubPath(const std::string & connector, const std::string & streamName){
+    char name[64];
+    snprintf(name, sizeof(name), "MstFan%s_%08X", connector.c_str(), checksum::crc32(0, streamName.data(), streamName.size()));
+    return Util::getTmpFolder() + name;
+  }
+
+  /// Hands the given client socket over to the hub listening on path, along with the client details for the statistics.
+  /// The caller keeps its own copy of the socket, which it should drop (not close!) when this succeeds.
+  /// \returns True if the hub took over the connection.
+  bool handOff(const std::string & path, int fd, const std::string & binHost, uint32_t crc){
+    if (path.size() >= sizeof(((sockaddr_un *)0)->sun_path)){return false;}
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock == -1){return false;}
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, path.data(), path.size());
+    if (connect(sock, (sockaddr *)&addr, sizeof(addr))){
+      ::close(sock);
+      return false;
+    }
+    //Don't wait forever on a hub that hangs
+    struct timeval timeout;
+    timeout.tv_sec = 2;
+    timeout.tv_usec = 0;
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    char info[HANDOFF_INFO_SIZE];
+    memset(info, 0, HANDOFF_INFO_SIZE);
+    memcpy(info, binHost.data(), std::min(binHost.size(), (size_t)16));
+    memcpy(info + 16, &crc, 4);
+    struct iovec vec;
+    vec.iov_base = info;
+    vec.iov_len = HANDOFF_INFO_SIZE;
+    char control[CMSG_SPACE(sizeof(int))];
+    memset(control, 0, sizeof(control));
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &vec;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    struct cmsghdr * cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+    bool accepted = false;
+    if (sendmsg(sock, &msg, MSG_NOSIGNAL) == HANDOFF_INFO_SIZE){
+      char ack = 0;
+      accepted = (recv(sock, &ack, 1, 0) == 1 && ack == 1);
+    }
+    ::close(sock);
+    return accepted;
+  }
+
+  /// Starts listening for viewers on the given path.
+  /// Only one hub can listen on a path at a time; if another one already does, this hub is not connected.
+  Hub::Hub(const std::string & hubPath) : path(hubPath){
+    active = false;
+    header = 0;
+    epollFd = -1;
+    wakePipe[0] = wakePipe[1] = -1;
+    wakePending = false;
+    ioThread = 0;
+    lastTime = 0;
+    idleSince = Util::epoch();
+    dropped = 0;
+    lockFd = open((path + ".lock").c_str(), O_CREAT | O_RDWR | O_CLOEXEC, 0600);
+    if (lockFd == -1 || flock(lockFd, LOCK_EX | LOCK_NB)){
+      INFO_MSG("Another process already serves %s", path.c_str());
+      return;
+    }
+#ifdef __linux__
+    server = Socket::Server(path, true);
+    if (!server.connected()){return;}
+    if (pipe2(wakePipe, O_CLOEXEC | O_NONBLOCK)){
+      wakePipe[0] = wakePipe[1] = -1;
+      return;
+    }
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (epollFd == -1){return;}
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.fd = server.getSocket();
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, server.getSocket(), &ev);
+    ev.data.fd = wakePipe[0];
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, wakePipe[0], &ev);
+    active = true;
+    ioThread = new tthread::thread(ioLoop, this);
+#endif
+  }
+
+  Hub::~Hub(){
+    close();
+    if (lockFd != -1){::close(lockFd);}
+  }
+
+  /// Stops the hub, disconnecting all viewers.
+  void Hub::close(){
+    active = false;
+    if (ioThread){
+      wake();
+      ioThread->join();
+      delete ioThread;
+      ioThread = 0;
+    }
+    //The sending thread is gone, so only the viewer list itself still needs the lock
+    while (viewers.size()){drop(*viewers.begin()->second);}
+    for (std::set<int>::iterator it = handOffs.begin(); it != handOffs.end(); ++it){::close(*it);}
+    handOffs.clear();
+    if (server.connected()){
+      server.close();
+      unlink(path.c_str());
+    }
+    if (epollFd != -1){
+      ::close(epollFd);
+      epollFd = -1;
+    }
+    if (wakePipe[0] != -1){
+      ::close(wakePipe[0]);
+      ::close(wakePipe[1]);
+      wakePipe[0] = wakePipe[1] = -1;
+    }
+    tthread::lock_guard<tthread::mutex> guard(viewerMutex);
+    if (header){release(header);}
+    header = 0;
+  }
+
+  bool Hub::connected() const{return active;}
+
+  /// Writes to the hub never block, so there is nothing to switch.
+  void Hub::setBlocking(bool blocking){}
+
+  /// Sets the stream and protocol name the viewers are reported under in the statistics.
+  /// Without these, viewers are not reported at all.
+  void Hub::setStats(const std::string & strm, const std::string & conn){
+    tthread::lock_guard<tthread::mutex> guard(viewerMutex);
+    streamName = strm;
+    connector = conn;
+  }
+
+  unsigned int Hub::iwrite(const void * buffer, int len){
+    if (!active){return 0;}
+    pending.append((const char *)buffer, len);
+    up += len;
+    return len;
+  }
+
+  unsigned int Hub::iwritev(const struct iovec * vec, int count){
+    unsigned int ret = 0;
+    for (int i = 0; i < count; ++i){ret += iwrite(vec[i].iov_base, vec[i].iov_len);}
+    return ret;
+  }
+
+  /// Takes everything written since the last call as the header that new viewers are sent first.
+  void Hub::setHeader(){
+    chunk * c = new chunk;
+    c->data.swap(pending);
+    c->refs = 1;
+    tthread::lock_guard<tthread::mutex> guard(viewerMutex);
+    if (header){release(header);}
+    header = c;
+  }
+
+  /// Queues everything written since the last call for all viewers, as a single shared chunk.
+  /// Viewers that joined since the last packet that could be started on keep waiting, unless startable is set;
+  /// then they are sent the header first.
+  /// \param time The timestamp of the packet, in milliseconds.
+  void Hub::sendPacket(uint64_t time, bool startable){
+    if (!pending.size()){return;}
+    chunk * c = new chunk;
+    c->data.swap(pending);
+    c->refs = 0;
+    tthread::lock_guard<tthread::mutex> guard(viewerMutex);
+    lastTime = time;
+    for (std::map<int, viewer *>::iterator it = viewers.begin(); it != viewers.end(); ++it){
+      viewer & v = *(it->second);
+      if (v.slow){continue;}
+      if (!v.live){
+        if (!startable || !header){continue;}
+        queue(v, header);
+        v.live = true;
+      }
+      queue(v, c);
+    }
+    if (!c->refs){
+      delete c;
+      return;
+    }
+    wake();
+  }
+
+  /// Returns the amount of viewers currently connected.
+  size_t Hub::viewerCount(){
+    tthread::lock_guard<tthread::mutex> guard(viewerMutex);
+    return viewers.size();
+  }
+
+  /// Returns the amount of viewers that were dropped for not keeping up.
+  uint64_t Hub::droppedCount(){
+    tthread::lock_guard<tthread::mutex> guard(viewerMutex);
+    return dropped;
+  }
+
+  /// Wakes up the sending thread. Only writes to the pipe once until the thread wakes up.
+  void Hub::wake(){
+    if (wakePending || wakePipe[1] == -1){return;}
+    wakePending = true;
+    if (write(wakePipe[1], "", 1) < 0){}
+  }
+
+  /// Adds a chunk to the incoming queue of a viewer, for the sending thread to take over. Caller must hold viewerMutex.
+  void Hub::queue(viewer & v, chunk * c){
+    v.incoming.push_back(c);
+    __sync_add_and_fetch(&c->refs, 1);
+    if (__sync_add_and_fetch(&v.queued, c->data.size()) > FANOUT_QUEUE_MAX){
+      //Sending would only ever fall further behind
+      v.slow = true;
+      ++dropped;
+    }
+  }
+
+  /// Sends as much of the queue of a viewer as its socket accepts. Only called from the sending thread.
+  void Hub::flush(viewer & v){
+#ifdef __linux__
+    while (v.queue.size() && !v.dropped){
+      struct iovec vec[64];
+      int count = 0;
+      for (std::deque<chunk *>::iterator it = v.queue.begin(); it != v.queue.end() && count < 64; ++it){
+        size_t skip = (count ? 0 : v.offset);
+        vec[count].iov_base = (char *)(*it)->data.data() + skip;
+        vec[count].iov_len = (*it)->data.size() - skip;
+        ++count;
+      }
+      struct msghdr msg;
+      memset(&msg, 0, sizeof(msg));
+      msg.msg_iov = vec;
+      msg.msg_iovlen = count;
+      ssize_t sent = sendmsg(v.fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+      if (sent < 0){
+        if (errno == EINTR){continue;}
+        if (errno == EAGAIN || errno == EWOULDBLOCK){
+          if (!v.waitWritable){
+            struct epoll_event ev;
+            ev.events = EPOLLIN | EPOLLRDHUP | EPOLLOUT;
+            ev.data.fd = v.fd;
+            epoll_ctl(epollFd, EPOLL_CTL_MOD, v.fd, &ev);
+            v.waitWritable = true;
+          }
+          return;
+        }
+        v.dropped = true;
+        return;
+      }
+      v.up += sent;
+      __sync_sub_and_fetch(&v.queued, sent);
+      //Release all chunks that were sent completely
+      size_t done = sent + v.offset;
+      while (v.queue.size() && done >= v.queue.front()->data.size()){
+        chunk * c = v.queue.front();
+        done -= c->data.size();
+        v.queue.pop_front();
+        release(c);
+      }
+      v.offset = done;
+    }
+    if (v.waitWritable){
+      struct epoll_event ev;
+      ev.events = EPOLLIN | EPOLLRDHUP;
+      ev.data.fd = v.fd;
+      epoll_ctl(epollFd, EPOLL_CTL_MOD, v.fd, &ev);
+      v.waitWritable = false;
+    }
+#endif
+  }
+
+  /// Disconnects a viewer and frees everything that was queued for it.
+  /// Only called from the sending thread, or once it stopped; takes viewerMutex just to remove the viewer from the list.
+  void Hub::drop(viewer & v){
+    HIGH_MSG("Disconnecting viewer on socket %d after %llu bytes", v.fd, (unsigned long long)v.up);
+    {
+      tthread::lock_guard<tthread::mutex> guard(viewerMutex);
+      viewers.erase(v.fd);
+    }
+    //The output can no longer reach this viewer, so its incoming queue is ours now
+    while (v.incoming.size()){
+      release(v.incoming.front());
+      v.incoming.pop_front();
+    }
+    while (v.queue.size()){
+      release(v.queue.front());
+      v.queue.pop_front();
+    }
+    if (v.stats.getData()){v.stats.finish();}
+    shutdown(v.fd, SHUT_RDWR);
+    ::close(v.fd);//also removes it from the epoll set
+    delete &v;
+    if (!viewers.size()){idleSince = Util::epoch();}
+  }
+
+  /// Accepts all waiting connections from viewer processes. Only called from the sending thread.
+  void Hub::acceptHandOffs(){
+#ifdef __linux__
+    while (true){
+      int fd = accept(server.getSocket(), 0, 0);
+      if (fd == -1){return;}
+      fcntl(fd, F_SETFD, FD_CLOEXEC);
+      struct epoll_event ev;
+      ev.events = EPOLLIN;
+      ev.data.fd = fd;
+      if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev)){
+        ::close(fd);
+        continue;
+      }
+      handOffs.insert(fd);
+    }
+#endif
+  }
+
+  /// Receives a client socket from a viewer process, and starts serving it. Only called from the sending thread.
+  void Hub::receiveHandOff(int sock){
+#ifdef __linux__
+    handOffs.erase(sock);
+    char info[HANDOFF_INFO_SIZE];
+    struct iovec vec;
+    vec.iov_base = info;
+    vec.iov_len = HANDOFF_INFO_SIZE;
+    char control[CMSG_SPACE(sizeof(int))];
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &vec;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    int fd = -1;
+    if (recvmsg(sock, &msg, MSG_DONTWAIT | MSG_CMSG_CLOEXEC) == HANDOFF_INFO_SIZE){
+      struct cmsghdr * cmsg = CMSG_FIRSTHDR(&msg);
+      if (cmsg && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS){memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));}
+    }
+    if (fd != -1){
+      fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+      struct epoll_event ev;
+      ev.events = EPOLLIN | EPOLLRDHUP;
+      ev.data.fd = fd;
+      if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev)){
+        ::close(fd);
+        fd = -1;
+      }
+    }
+    if (fd != -1){
+      viewer * v = new viewer;
+      v->fd = fd;
+      v->host.assign(info, 16);
+      memcpy(&v->crc, info + 16, 4);
+      v->live = false;
+      v->slow = false;
+      v->dropped = false;
+      v->waitWritable = false;
+      v->offset = 0;
+      v->queued = 0;
+      v->up = 0;
+      v->connTime = Util::epoch();
+      {
+        tthread::lock_guard<tthread::mutex> guard(viewerMutex);
+        viewers[fd] = v;
+      }
+      idleSince = 0;
+      HIGH_MSG("Serving viewer on socket %d, %zu viewers", fd, viewers.size());
+      if (send(sock, "\001", 1, MSG_NOSIGNAL) < 0){}
+    }
+    ::close(sock);
+#endif
+  }
+
+  /// Reports all viewers to the statistics, like their own output processes would. Only called from the sending thread.
+  /// \param packetTime The timestamp of the last sent packet, in milliseconds.
+  void Hub::updateStats(uint64_t now, const std::string & strm, const std::string & conn, uint64_t packetTime){
+    if (!strm.size()){return;}
+    for (std::map<int, viewer *>::iterator it = viewers.begin(); it != viewers.end(); ++it){
+      viewer & v = *(it->second);
+      if (!v.stats.getData()){
+        v.stats = IPC::sharedClient(SHM_STATISTICS, STAT_EX_SIZE, true);
+        if (!v.stats.getData()){continue;}
+        IPC::statExchange tmpEx(v.stats.getData());
+        tmpEx.host(v.host);
+        tmpEx.crc(v.crc);
+        tmpEx.streamName(strm);
+        tmpEx.connector(conn);
+      }
+      IPC::statExchange tmpEx(v.stats.getData());
+      tmpEx.now(now);
+      tmpEx.up(v.up);
+      tmpEx.down(0);
+      tmpEx.time(now - v.connTime);
+      tmpEx.lastSecond(packetTime);
+      v.stats.keepAlive();
+    }
+  }
+
+  /// Sending thread: accepts viewers, sends their queues and drops those that disconnect or don't keep up.
+  /// The viewer list is only changed by this thread, so it reads the list without locking; viewerMutex is only
+  /// held while changing the list and while taking over the chunks the output queued, never during socket calls.
+  void Hub::ioLoop(void * hubPtr){
+#ifdef __linux__
+    Hub & hub = *(Hub *)hubPtr;
+    uint64_t lastStats = 0;
+    struct epoll_event events[256];
+    while (hub.active){
+      int count = epoll_wait(hub.epollFd, events, 256, 1000);
+      bool woken = false;
+      for (int i = 0; i < count; ++i){
+        int fd = events[i].data.fd;
+        if (fd == hub.wakePipe[0]){
+          char buf[64];
+          while (read(fd, buf, 64) > 0){}
+          woken = true;
+          continue;
+        }
+        if (fd == hub.server.getSocket()){
+          hub.acceptHandOffs();
+          continue;
+        }
+        if (hub.handOffs.count(fd)){
+          hub.receiveHandOff(fd);
+          continue;
+        }
+        std::map<int, viewer *>::iterator it = hub.viewers.find(fd);
+        if (it == hub.viewers.end()){continue;}
+        viewer & v = *(it->second);
+        if (events[i].events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP)){
+          v.dropped = true;
+          continue;
+        }
+        if (events[i].events & EPOLLIN){
+          //Viewers have nothing to say once playing; discard whatever they send
+          char buf[1024];
+          ssize_t r = recv(fd, buf, sizeof(buf), MSG_DONTWAIT);
+          if (r == 0){v.dropped = true;}
+        }
+        if (events[i].events & EPOLLOUT){hub.flush(v);}
+      }
+      uint64_t now = Util::epoch();
+      std::string strm, conn;
+      uint64_t packetTime = 0;
+      if (woken || now != lastStats){
+        tthread::lock_guard<tthread::mutex> guard(hub.viewerMutex);
+        if (woken){
+          //The output only queues new chunks after waking us, so everything it queued so far is taken over here
+          hub.wakePending = false;
+          for (std::map<int, viewer *>::iterator it = hub.viewers.begin(); it != hub.viewers.end(); ++it){
+            viewer & v = *(it->second);
+            if (v.slow){v.dropped = true;}
+            if (!v.incoming.size()){continue;}
+            v.queue.insert(v.queue.end(), v.incoming.begin(), v.incoming.end());
+            v.incoming.clear();
+          }
+        }
+        if (now != lastStats){
+          strm = hub.streamName;
+          conn = hub.connector;
+          packetTime = hub.lastTime;
+        }
+      }
+      std::map<int, viewer *>::iterator it = hub.viewers.begin();
+      while (it != hub.viewers.end()){
+        viewer & v = *((it++)->second);
+        if (woken && !v.waitWritable){hub.flush(v);}
+        if (v.dropped){hub.drop(v);}
+      }
+      if (now != lastStats){
+        lastStats = now;
+        hub.updateStats(now, strm, conn, packetTime);
+        if (hub.idleSince && now - hub.idleSince > FANOUT_IDLE){
+          INFO_MSG("No viewers left for %d seconds, stopping", FANOUT_IDLE);
+          hub.active = false;
+        }
+      }
+    }
+#endif
+  }
+}
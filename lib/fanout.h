@@ -0,0 +1,97 @@
+/// \file fanout.h
+/// Serving all live viewers of a stream through one output process.
+/// Viewer processes hand their client socket over to the hub of their stream and protocol, which prepares every
+/// packet once into a shared buffer and queues that same buffer for all of its viewers.
+
+#pragma once
+#include "shared_memory.h"
+#include "socket.h"
+#include "tinythread.h"
+#include <deque>
+#include <map>
+#include <set>
+#include <stdint.h>
+#include <string>
+
+#define FANOUT_QUEUE_MAX (4 * 1024 * 1024) ///< Bytes that may be waiting for a single viewer before it is dropped as too slow
+#define FANOUT_IDLE 10 ///< Seconds without viewers after which a hub stops
+
+namespace FanOut{
+  std::string hubPath(const std::string & connector, const std::string & streamName);
+  bool handOff(const std::string & path, int fd, const std::string & binHost, uint32_t crc);
+
+  /// Prepared data, shared by the send queues of all viewers and freed once the last one sent it.
+  struct chunk{
+    std::string data;
+    unsigned int refs; ///< Changed atomically, as both the output and the sending thread release chunks.
+  };
+
+  /// A client connection served by a hub.
+  /// The output only touches live, slow and incoming, while holding the viewerMutex of the hub;
+  /// everything else belongs to the sending thread.
+  struct viewer{
+    int fd;
+    std::string host; ///< Binary host, as used in the statistics.
+    uint32_t crc;
+    bool live; ///< False until the header and a packet that can be started on were queued.
+    bool slow; ///< Set by the output once too much is waiting for this viewer.
+    bool dropped;
+    bool waitWritable; ///< Whether the socket is being watched for becoming writable again.
+    std::deque<chunk *> incoming; ///< Chunks queued by the output that the sending thread did not take over yet.
+    std::deque<chunk *> queue;
+    size_t offset; ///< Bytes of the first chunk in queue that were already sent.
+    size_t queued; ///< Bytes waiting in incoming and queue in total, changed atomically.
+    uint64_t up;
+    uint64_t connTime;
+    IPC::sharedClient stats;
+  };
+
+  /// Connection that collects everything an output writes to it, and sends it to all viewers handed over to it.
+  /// Sending happens from a separate thread, which only holds the lock shared with the output while taking over
+  /// newly queued chunks, so the output writing to the hub never waits for a viewer's socket.
+  class Hub : public Socket::Connection{
+  public:
+    Hub(const std::string & path);
+    ~Hub();
+    void setStats(const std::string & streamName, const std::string & connector);
+    void setHeader();
+    void sendPacket(uint64_t time, bool startable);
+    size_t viewerCount();
+    uint64_t droppedCount();
+    void close();
+    bool connected() const;
+    void setBlocking(bool blocking);
+
+  protected:
+    unsigned int iwrite(const void * buffer, int len);
+    unsigned int iwritev(const struct iovec * vec, int count);
+
+  private:
+    static void ioLoop(void * hubPtr);
+    void acceptHandOffs();
+    void receiveHandOff(int fd);
+    void queue(viewer & v, chunk * c);
+    void flush(viewer & v);
+    void drop(viewer & v);
+    void updateStats(uint64_t now, const std::string & strm, const std::string & conn, uint64_t packetTime);
+    void wake();
+    volatile bool active;
+    std::string path;
+    std::string pending; ///< Data written since the last setHeader or sendPacket call.
+    chunk * header;
+    Socket::Server server;
+    int lockFd;
+    int epollFd;
+    int wakePipe[2];
+    bool wakePending;
+    tthread::mutex viewerMutex;
+    tthread::thread * ioThread;
+    std::map<int, viewer *> viewers; ///< All viewers, by socket.
+    std::set<int> handOffs; ///< Sockets of viewer processes that are handing over a connection.
+    std::string streamName;
+    std::string connector;
+    uint64_t lastTime; ///< Time of the last sent packet, in milliseconds.
+    uint64_t idleSince; ///< When the last viewer left, in seconds since the epoch, or zero.
+    uint64_t dropped; ///< Viewers dropped for being too slow.
+  };
+}
@@ -11,6 +11,8 @@
 #include <fcntl.h> //for Tag::FileLoader
 #include <stdlib.h> //malloc
 #include <string.h> //memcpy
+#include <errno.h>
+#include <algorithm>
 #include <sstream>
 
 
@@ -948,6 +950,154 @@ bool FLV::Tag::FileLoader(FILE * f) {
   return false;
 } //FLV_GetPacket
 
+FLV::BlockReader::BlockReader(){
+  fd = -1;
+  buffer = 0;
+  bufSize = 0;
+  bufFill = 0;
+  bufPos = 0;
+  bufStart = 0;
+  atEnd = false;
+}
+
+FLV::BlockReader::~BlockReader(){
+  close();
+  free(buffer);
+}
+
+/// Opens the given file for reading, positioned at its start.
+bool FLV::BlockReader::open(const std::string & filename){
+  close();
+  fd = ::open(filename.c_str(), O_RDONLY);
+  if (fd == -1){
+    FAIL_MSG("Could not open %s: %s", filename.c_str(), strerror(errno));
+    return false;
+  }
+  seek(0);
+  return true;
+}
+
+/// Closes the file, if open.
+void FLV::BlockReader::close(){
+  if (fd != -1){::close(fd);}
+  fd = -1;
+}
+
+/// Continues reading at the given file position, keeping the buffered data if it contains that position.
+void FLV::BlockReader::seek(uint64_t pos){
+  atEnd = false;
+  if (pos >= bufStart && pos <= bufStart + bufFill){
+    bufPos = pos - bufStart;
+    return;
+  }
+  bufStart = pos;
+  bufFill = 0;
+  bufPos = 0;
+}
+
+/// Returns the file position of the next tag to be read.
+uint64_t FLV::BlockReader::getPos() const{
+  return bufStart + bufPos;
+}
+
+/// Returns true if the end of the file was reached and all buffered data was used up.
+bool FLV::BlockReader::eof() const{
+  return atEnd && bufPos >= bufFill;
+}
+
+/// Makes sure at least count bytes are buffered from the current position onwards, reading a block if needed.
+/// Returns false if the file ends (or cannot be read) before that.
+bool FLV::BlockReader::fill(size_t count){
+  if (bufFill - bufPos >= count){return true;}
+  if (fd == -1){return false;}
+  //Move the unread part to the front of the buffer, and make room for at least one more block
+  if (bufPos){
+    memmove(buffer, buffer + bufPos, bufFill - bufPos);
+    bufStart += bufPos;
+    bufFill -= bufPos;
+    bufPos = 0;
+  }
+  size_t wanted = std::max(count, bufFill + FLV_READ_BLOCK);
+  if (wanted > bufSize){
+    char * newBuffer = (char *)realloc(buffer, wanted);
+    if (!newBuffer){
+      FAIL_MSG("Could not allocate %zu bytes for FLV reading", wanted);
+      return false;
+    }
+    buffer = newBuffer;
+    bufSize = wanted;
+  }
+  while (bufFill < count){
+    ssize_t r = pread(fd, buffer + bufFill, bufSize - bufFill, bufStart + bufFill);
+    if (r < 0 && errno == EINTR){continue;}
+    if (r < 0){
+      FLV::Parse_Error = true;
+      Error_Str = "File reading error.";
+      return false;
+    }
+    if (!r){
+      atEnd = true;
+      return false;
+    }
+    bufFill += r;
+  }
+  return true;
+}
+
+/// Reads the next tag into the given tag, skipping a FLV file header if there is one.
+/// Returns false at the end of the file or on a parse error, in which case FLV::Parse_Error is set.
+bool FLV::BlockReader::readTag(Tag & tag){
+  while (fill(11)){
+    const unsigned char * p = (const unsigned char *)(buffer + bufPos);
+    if (FLV::is_header(buffer + bufPos)){
+      if (!fill(13)){return false;}
+      if (!FLV::check_header(buffer + bufPos)){
+        FLV::Parse_Error = true;
+        Error_Str = "Invalid header received.";
+        return false;
+      }
+      memcpy(FLV::Header, buffer + bufPos, 13);
+      bufPos += 13;
+      continue;
+    }
+    if (p[0] > 0x12){
+      FLV::Parse_Error = true;
+      Error_Str = "Invalid Tag received (";
+      Error_Str += (char)(p[0] + 32);
+      Error_Str += ").";
+      return false;
+    }
+    //The tag header, body and trailing previous tag size
+    size_t len = ((p[1] << 16) | (p[2] << 8) | p[3]) + 15;
+    if (!fill(len)){return false;}
+    tag.len = len;
+    if (!tag.checkBufferSize()){return false;}
+    memcpy(tag.data, buffer + bufPos, len);
+    tag.isKeyframe = ((tag.data[0] == 0x09) && (((tag.data[11] & 0xf0) >> 4) == 1));
+    tag.done = true;
+    tag.sofar = 0;
+    bufPos += len;
+    return true;
+  }
+  return false;
+}
+
+/// Skips tags until the next tag is of the given type, without copying the skipped tags.
+/// Returns false if no such tag was found.
+bool FLV::BlockReader::seekToTagType(uint8_t t){
+  while (fill(11)){
+    const unsigned char * p = (const unsigned char *)(buffer + bufPos);
+    if (p[0] == t){return true;}
+    if (p[0] != 0x08 && p[0] != 0x09 && p[0] != 0x12){
+      WARN_MSG("Invalid FLV tag detected! Aborting search.");
+      return false;
+    }
+    uint64_t next = getPos() + ((p[1] << 16) | (p[2] << 8) | p[3]) + 15;
+    seek(next);
+  }
+  return false;
+}
+
 /// Returns 1 for video, 2 for audio, 3 for meta, 0 otherwise.
 unsigned int FLV::Tag::getTrackID(){
   switch (data[0]){
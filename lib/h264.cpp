@@ -147,15 +147,12 @@ namespace h264 {
 
     //Fill the bitstream
     Utils::bitstream bs;
-    for (unsigned int i = 1; i < dataLen; i++) {
-      if (i + 2 < dataLen && (memcmp(data + i, "\000\000\003", 3) == 0)){//Emulation prevention bytes
-        //Yes, we increase i here
-        bs.append(data + i, 2);
-        i += 2;
-      } else {
-        //No we don't increase i here
-        bs.append(data + i, 1);
-      }
+    //Appends everything in between emulation prevention bytes, skipping the bytes themselves
+    for (unsigned int i = 1; i < dataLen;) {
+      const char * found = nalu::scanEmulationPrevention(data + i, dataLen - i);
+      unsigned int chunkEnd = (found ? found - data + 2 : dataLen);
+      bs.append(data + i, chunkEnd - i);
+      i = (found ? chunkEnd + 1 : dataLen);
     }
 
     char profileIdc = bs.get(8);
@@ -6,8 +6,29 @@
 #include "defines.h"
 #include "encode.h"
 #include "timing.h"
+#include <cstring>
 #include <iomanip>
 
+/// Pre-rendered header lines sent by HTTP::Parser::setCORSHeaders.
+/// Any of these can still be overridden by setting the same header afterwards.
+static const struct{
+  const char *name;
+  const char *line;
+}corsTemplate[] ={
+    {"Access-Control-Allow-Origin", "Access-Control-Allow-Origin: *\r\n"},
+    {"Access-Control-Allow-Credentials", "Access-Control-Allow-Credentials: true\r\n"},
+    {"Access-Control-Expose-Headers", "Access-Control-Expose-Headers: *\r\n"},
+    {"Access-Control-Max-Age", "Access-Control-Max-Age: 600\r\n"},
+    {"Access-Control-Allow-Methods", "Access-Control-Allow-Methods: GET, POST, OPTIONS, HEAD\r\n"},
+    {"Access-Control-Allow-Headers", "Access-Control-Allow-Headers: *\r\n"},
+    {"Access-Control-Request-Method", "Access-Control-Request-Method: GET\r\n"},
+    {"Access-Control-Request-Headers", "Access-Control-Request-Headers: *\r\n"},
+    {"Cache-Control", "Cache-Control: no-cache, no-store, must-revalidate\r\n"},
+    {"Pragma", "Pragma: no-cache\r\n"},
+    {"Expires", "Expires: 0\r\n"},
+};
+#define CORS_TEMPLATE_COUNT (sizeof(corsTemplate) / sizeof(corsTemplate[0]))
+
 /// Helper function to check if the given c-string is numeric or not
 static bool is_numeric(const char *str){
   while (str[0] != 0){
@@ -271,6 +292,7 @@ HTTP::URL HTTP::URL::link(const std::string &l) const{
 /// All this constructor does is call HTTP::Parser::Clean().
 HTTP::Parser::Parser(){
   headerOnly = false;
+  headerCount = 0;
   Clean();
   std::stringstream nStr;
   nStr << std::hex << std::setw(16) << std::setfill('0') << (uint64_t)(Util::bootMS());
@@ -281,7 +303,8 @@ HTTP::Parser::Parser(){
 /// usage.
 void HTTP::Parser::Clean(){
   CleanPreserveHeaders();
-  headers.clear();
+  headerCount = 0;
+  corsHeaders = false;
 }
 
 /// Completely re-initializes the HTTP::Parser, leaving it ready for either reading or writing
@@ -377,18 +400,33 @@ void HTTP::Parser::auth(const std::string &user, const std::string &pass,
 }
 
 /// Sets the neccesary headers to allow Cross Origin Resource Sharing with all domains.
+/// Rather than setting these one by one, a pre-rendered block is appended when the headers are
+/// sent. Earlier values for these headers are overridden; later values override the block.
 void HTTP::Parser::setCORSHeaders(){
-  SetHeader("Access-Control-Allow-Origin", "*");
-  SetHeader("Access-Control-Allow-Credentials", "true");
-  SetHeader("Access-Control-Expose-Headers", "*");
-  SetHeader("Access-Control-Max-Age", "600");
-  SetHeader("Access-Control-Allow-Methods", "GET, POST, OPTIONS, HEAD");
-  SetHeader("Access-Control-Allow-Headers", "*");
-  SetHeader("Access-Control-Request-Method", "GET");
-  SetHeader("Access-Control-Request-Headers", "*");
-  SetHeader("Cache-Control", "no-cache, no-store, must-revalidate");
-  SetHeader("Pragma", "no-cache");
-  SetHeader("Expires", "0");
+  for (size_t i = 0; i < CORS_TEMPLATE_COUNT; ++i){clearHeader(corsTemplate[i].name);}
+  corsHeaders = true;
+}
+
+/// Appends all set headers to target, in "Name: value\r\n" format.
+/// For responses, a Content-Length header with value 0 is left out.
+void HTTP::Parser::renderHeaders(std::string &target, bool isResponse){
+  for (size_t i = 0; i < headerCount; ++i){
+    const headerField &h = headers[i];
+    if (!h.name.size() || !h.value.size()){continue;}
+    if (isResponse && h.value == "0" && h.name == "Content-Length"){continue;}
+    target += h.name;
+    target.append(": ", 2);
+    target += h.value;
+    target.append("\r\n", 2);
+  }
+  if (corsHeaders){
+    for (size_t i = 0; i < CORS_TEMPLATE_COUNT; ++i){
+      if (findHeader(corsTemplate[i].name, strlen(corsTemplate[i].name)) != std::string::npos){
+        continue;
+      }
+      target += corsTemplate[i].line;
+    }
+  }
 }
 
 /// Returns a string containing a valid HTTP 1.0 or 1.1 request, ready for sending.
@@ -397,15 +435,16 @@ void HTTP::Parser::setCORSHeaders(){
 /// \return A string containing a valid HTTP 1.0 or 1.1 request, ready for sending.
 std::string &HTTP::Parser::BuildRequest(){
   /// \todo Include GET/POST variable parsing?
-  std::map<std::string, std::string>::iterator it;
   if (protocol.size() < 5 || protocol[4] != '/'){protocol = "HTTP/1.0";}
-  builder = method + " " + url + " " + protocol + "\r\n";
-  for (it = headers.begin(); it != headers.end(); it++){
-    if ((*it).first != "" && (*it).second != ""){
-      builder += (*it).first + ": " + (*it).second + "\r\n";
-    }
-  }
-  builder += "\r\n" + body;
+  builder.assign(method);
+  builder += ' ';
+  builder += url;
+  builder += ' ';
+  builder += protocol;
+  builder.append("\r\n", 2);
+  renderHeaders(builder, false);
+  builder.append("\r\n", 2);
+  builder += body;
   return builder;
 }
 
@@ -414,18 +453,17 @@ std::string &HTTP::Parser::BuildRequest(){
 /// To be precise, method, url, protocol, headers and body are used.
 void HTTP::Parser::SendRequest(Socket::Connection &conn, const std::string &reqbody){
   /// \todo Include GET/POST variable parsing?
-  std::map<std::string, std::string>::iterator it;
   if (protocol.size() < 5 || protocol[4] != '/'){protocol = "HTTP/1.0";}
-  builder = method + " " + url + " " + protocol + "\r\n";
-  conn.SendNow(builder);
   if (reqbody.size()){SetHeader("Content-Length", reqbody.length());}
-  for (it = headers.begin(); it != headers.end(); it++){
-    if ((*it).first != "" && (*it).second != ""){
-      builder = (*it).first + ": " + (*it).second + "\r\n";
-      conn.SendNow(builder);
-    }
-  }
-  conn.SendNow("\r\n", 2);
+  builder.assign(method);
+  builder += ' ';
+  builder += url;
+  builder += ' ';
+  builder += protocol;
+  builder.append("\r\n", 2);
+  renderHeaders(builder, false);
+  builder.append("\r\n", 2);
+  conn.SendNow(builder);
   if (reqbody.size()){
     conn.SendNow(reqbody);
   }else{
@@ -441,17 +479,15 @@ void HTTP::Parser::SendRequest(Socket::Connection &conn, const std::string &reqb
 /// \return A string containing a valid HTTP 1.0 or 1.1 response, ready for sending.
 std::string &HTTP::Parser::BuildResponse(std::string code, std::string message){
   /// \todo Include GET/POST variable parsing?
-  std::map<std::string, std::string>::iterator it;
   if (protocol.size() < 5 || protocol[4] != '/'){protocol = "HTTP/1.0";}
-  builder = protocol + " " + code + " " + message + "\r\n";
-  for (it = headers.begin(); it != headers.end(); it++){
-    if ((*it).first != "" && (*it).second != ""){
-      if ((*it).first != "Content-Length" || (*it).second != "0"){
-        builder += (*it).first + ": " + (*it).second + "\r\n";
-      }
-    }
-  }
-  builder += "\r\n";
+  builder.assign(protocol);
+  builder += ' ';
+  builder += code;
+  builder += ' ';
+  builder += message;
+  builder.append("\r\n", 2);
+  renderHeaders(builder, true);
+  builder.append("\r\n", 2);
   builder += body;
   return builder;
 }
@@ -468,25 +504,23 @@ std::string &HTTP::Parser::BuildResponse(){
 /// Creates and sends a valid HTTP 1.0 or 1.1 response.
 /// The response is partly build from internal variables set before this call is made.
 /// To be precise, protocol, headers and body are used.
-/// This call will attempt to buffer as little as possible and block until the whole request is
+/// The status line and headers are sent in a single write, followed by the body.
+/// This call will block until the whole request is
 /// sent. \param code The HTTP response code. Usually you want 200. \param message The HTTP response
 /// message. Usually you want "OK". \param conn The Socket::Connection to send the response over.
 void HTTP::Parser::SendResponse(std::string code, std::string message, Socket::Connection &conn){
   /// \todo Include GET/POST variable parsing?
-  std::map<std::string, std::string>::iterator it;
   if (protocol.size() < 5 || protocol[4] != '/'){protocol = "HTTP/1.0";}
-  builder = protocol + " " + code + " " + message + "\r\n";
+  builder.assign(protocol);
+  builder += ' ';
+  builder += code;
+  builder += ' ';
+  builder += message;
+  builder.append("\r\n", 2);
+  renderHeaders(builder, true);
+  builder.append("\r\n", 2);
   conn.SendNow(builder);
-  for (it = headers.begin(); it != headers.end(); it++){
-    if ((*it).first != "" && (*it).second != ""){
-      if ((*it).first != "Content-Length" || (*it).second != "0"){
-        builder = (*it).first + ": " + (*it).second + "\r\n";
-        conn.SendNow(builder);
-      }
-    }
-  }
-  conn.SendNow("\r\n", 2);
-  conn.SendNow(body);
+  if (body.size()){conn.SendNow(body);}
 }
 
 /// Creates and sends a valid HTTP 1.0 or 1.1 response, based on the given request.
@@ -645,17 +679,48 @@ std::string HTTP::Parser::getUrl(){
 
 /// Returns header i, if set.
 const std::string &HTTP::Parser::GetHeader(const std::string &i) const{
-  if (headers.count(i)){
-    return headers.at(i);
+  size_t idx = findHeader(i.data(), i.size());
+  if (idx != std::string::npos){
+    return headers[idx].value;
   }else{
     static const std::string empty;
     return empty;
   }
 }
 
-/// Returns header i, if set.
+/// Returns true if header i is set.
 bool HTTP::Parser::hasHeader(const std::string &i) const{
-  return headers.count(i);
+  return findHeader(i.data(), i.size()) != std::string::npos;
+}
+
+/// Returns the index of the given header name in the header table, or std::string::npos if not set.
+size_t HTTP::Parser::findHeader(const char *name, size_t len) const{
+  for (size_t i = 0; i < headerCount; ++i){
+    if (headers[i].name.size() == len && !memcmp(headers[i].name.data(), name, len)){return i;}
+  }
+  return std::string::npos;
+}
+
+/// Sets a header from raw name and value data, trimming spaces and tabs on both.
+/// Re-uses the storage of earlier requests in the header table where possible.
+void HTTP::Parser::setHeader(const char *name, size_t nameLen, const char *val, size_t valLen){
+  while (nameLen && (*name == ' ' || *name == '\t')){
+    ++name;
+    --nameLen;
+  }
+  while (nameLen && (name[nameLen - 1] == ' ' || name[nameLen - 1] == '\t')){--nameLen;}
+  while (valLen && (*val == ' ' || *val == '\t')){
+    ++val;
+    --valLen;
+  }
+  while (valLen && (val[valLen - 1] == ' ' || val[valLen - 1] == '\t')){--valLen;}
+  size_t idx = findHeader(name, nameLen);
+  if (idx == std::string::npos){
+    idx = headerCount++;
+    if (headers.size() < headerCount){headers.resize(headerCount);}
+    headers[idx].name.assign(name, nameLen);
+  }
+  headers[idx].value.assign(val, valLen);
 }
 
 /// Returns POST variable i, if set.
@@ -684,22 +749,27 @@ std::string HTTP::Parser::allVars(){
 }
 
 /// Sets header i to string value v.
-void HTTP::Parser::SetHeader(std::string i, std::string v){
-  Trim(i);
-  Trim(v);
-  headers[i] = v;
+void HTTP::Parser::SetHeader(const std::string &i, const std::string &v){
+  setHeader(i.data(), i.size(), v.data(), v.size());
 }
 
+/// Removes header i, if set.
 void HTTP::Parser::clearHeader(const std::string &i){
-  headers.erase(i);
+  size_t idx = findHeader(i.data(), i.size());
+  if (idx == std::string::npos){return;}
+  // Keep the table dense; the removed entry's storage is kept for re-use.
+  --headerCount;
+  if (idx != headerCount){
+    headers[idx].name.swap(headers[headerCount].name);
+    headers[idx].value.swap(headers[headerCount].value);
+  }
 }
 
 /// Sets header i to integer value v.
-void HTTP::Parser::SetHeader(std::string i, long long v){
-  Trim(i);
+void HTTP::Parser::SetHeader(const std::string &i, long long v){
   char val[23]; // ints are never bigger than 22 chars as decimal
-  sprintf(val, "%lld", v);
-  headers[i] = val;
+  int len = sprintf(val, "%lld", v);
+  setHeader(i.data(), i.size(), val, len);
 }
 
 /// Sets POST variable i to string value v.
@@ -745,87 +815,82 @@ bool HTTP::Parser::Read(std::string &strbuf){
   return parse(strbuf);
 }// HTTPReader::Read
 
+/// Parses a request or status line, from line up to (not including) lineEnd.
+/// Sets method, url and protocol (or for responses: protocol, code and message) and GET variables.
+void HTTP::Parser::parseRequestLine(const char *line, const char *lineEnd){
+  seenReq = true;
+  const char *sp1 = (const char *)memchr(line, ' ', lineEnd - line);
+  const char *sp2 = sp1 ? (const char *)memchr(sp1 + 1, ' ', lineEnd - sp1 - 1) : 0;
+  if (!sp2){
+    seenReq = false;
+    return;
+  }
+  if (sp1 - line >= 4 && !memcmp(line, "HTTP", 4)){
+    protocol.assign(line, sp1 - line);
+    url.assign(sp1 + 1, sp2 - sp1 - 1);
+    method.assign(sp2 + 1, lineEnd - sp2 - 1);
+  }else{
+    method.assign(line, sp1 - line);
+    url.assign(sp1 + 1, sp2 - sp1 - 1);
+    protocol.assign(sp2 + 1, lineEnd - sp2 - 1);
+  }
+  size_t qmark = url.find('?');
+  if (qmark != std::string::npos){
+    parseVars(url.substr(qmark + 1), vars); // parse GET variables
+    url.erase(qmark);
+  }
+  if (url.find_first_of("%+") != std::string::npos){url = Encodings::URL::decode(url);}
+}
+
 /// Attempt to read a whole HTTP response or request from a data buffer.
 /// If succesful, fills its own fields with the proper data and removes the response/request
 /// from the data buffer.
+/// Header lines are tokenized in place; the buffer is only shortened once per call.
 /// \param HTTPbuffer The data buffer to read from.
 /// \return True on success, false otherwise.
 bool HTTP::Parser::parse(std::string &HTTPbuffer){
   size_t f;
-  std::string tmpA, tmpB, tmpC;
-  /// \todo Make this not resize HTTPbuffer in parts, but read all at once and then remove the
-  /// entire request, like doxygen claims it does?
+  std::string tmpA;
   while (!HTTPbuffer.empty()){
     if (!seenHeaders){
-      f = HTTPbuffer.find('\n');
-      if (f == std::string::npos) return false;
-      tmpA = HTTPbuffer.substr(0, f);
-      if (f + 1 == HTTPbuffer.size()){
-        HTTPbuffer.clear();
-      }else{
-        HTTPbuffer.erase(0, f + 1);
-      }
-      while (tmpA.find('\r') != std::string::npos){tmpA.erase(tmpA.find('\r'));}
-      if (!seenReq){
-        seenReq = true;
-        f = tmpA.find(' ');
-        if (f != std::string::npos){
-          if (tmpA.substr(0, 4) == "HTTP"){
-            protocol = tmpA.substr(0, f);
-            tmpA.erase(0, f + 1);
-            f = tmpA.find(' ');
-            if (f != std::string::npos){
-              url = tmpA.substr(0, f);
-              tmpA.erase(0, f + 1);
-              method = tmpA;
-              if (url.find('?') != std::string::npos){
-                parseVars(url.substr(url.find('?') + 1), vars); // parse GET variables
-                url.erase(url.find('?'));
-              }
-              url = Encodings::URL::decode(url);
-            }else{
-              seenReq = false;
-            }
-          }else{
-            method = tmpA.substr(0, f);
-            tmpA.erase(0, f + 1);
-            f = tmpA.find(' ');
-            if (f != std::string::npos){
-              url = tmpA.substr(0, f);
-              tmpA.erase(0, f + 1);
-              protocol = tmpA;
-              if (url.find('?') != std::string::npos){
-                parseVars(url.substr(url.find('?') + 1), vars); // parse GET variables
-                url.erase(url.find('?'));
-              }
-              url = Encodings::URL::decode(url);
-            }else{
-              seenReq = false;
-            }
-          }
-        }else{
-          seenReq = false;
+      const char *buf = HTTPbuffer.data();
+      size_t pos = 0;
+      while (!seenHeaders){
+        const char *line = buf + pos;
+        const char *nl = (const char *)memchr(line, '\n', HTTPbuffer.size() - pos);
+        if (!nl){break;}
+        pos = nl - buf + 1;
+        // Anything from the first carriage return onwards is ignored
+        const char *lineEnd = (const char *)memchr(line, '\r', nl - line);
+        if (!lineEnd){lineEnd = nl;}
+        if (!seenReq){
+          parseRequestLine(line, lineEnd);
+          continue;
         }
-      }else{
-        if (tmpA.size() == 0){
+        if (line == lineEnd){
           seenHeaders = true;
           body.clear();
-          if (GetHeader("Content-Length") != ""){
-            length = atoi(GetHeader("Content-Length").c_str());
+          const std::string &contentLength = GetHeader("Content-Length");
+          if (contentLength.size()){
+            length = atoi(contentLength.c_str());
             if (body.capacity() < length){body.reserve(length);}
           }
           if (GetHeader("Transfer-Encoding") == "chunked"){
             getChunks = true;
             doingChunk = 0;
           }
-        }else{
-          f = tmpA.find(':');
-          if (f == std::string::npos) continue;
-          tmpB = tmpA.substr(0, f);
-          tmpC = tmpA.substr(f + 1);
-          SetHeader(tmpB, tmpC);
+          break;
         }
+        const char *colon = (const char *)memchr(line, ':', lineEnd - line);
+        if (!colon){continue;}
+        setHeader(line, colon - line, colon + 1, lineEnd - colon - 1);
+      }
+      if (pos == HTTPbuffer.size()){
+        HTTPbuffer.clear();
+      }else if (pos){
+        HTTPbuffer.erase(0, pos);
       }
+      if (!seenHeaders){return false;}
     }
     if (seenHeaders){
       if (length > 0){
@@ -7,6 +7,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string>
+#include <vector>
 
 /// Holds all HTTP processing related code.
 namespace HTTP{
@@ -15,7 +16,15 @@ namespace HTTP{
   /// Reads variables from data, decodes and stores them to storage.
   void parseVars(const std::string &data, std::map<std::string, std::string> &storage);
 
+  /// A single header field, as stored in the header table of HTTP::Parser.
+  struct headerField{
+    std::string name;
+    std::string value;
+  };
+
   /// Simple class for reading and writing HTTP 1.0 and 1.1.
+  /// Headers are kept in a flat table that is re-used between requests, and incoming requests are
+  /// tokenized in place in the receive buffer, so that steady-state parsing does not allocate.
   class Parser{
   public:
     Parser();
@@ -27,8 +36,8 @@ namespace HTTP{
     const std::string &GetVar(const std::string &i) const;
     std::string getUrl();
     std::string allVars();
-    void SetHeader(std::string i, std::string v);
-    void SetHeader(std::string i, long long v);
+    void SetHeader(const std::string &i, const std::string &v);
+    void SetHeader(const std::string &i, long long v);
     void setCORSHeaders();
     void SetVar(std::string i, std::string v);
     void SetBody(std::string s);
@@ -65,9 +74,15 @@ namespace HTTP{
     bool getChunks;
     unsigned int doingChunk;
     bool parse(std::string &HTTPbuffer);
+    void parseRequestLine(const char *line, const char *lineEnd);
+    size_t findHeader(const char *name, size_t len) const;
+    void setHeader(const char *name, size_t nameLen, const char *val, size_t valLen);
+    void renderHeaders(std::string &target, bool isResponse);
     std::string builder;
     std::string read_buffer;
-    std::map<std::string, std::string> headers;
+    std::vector<headerField> headers; ///< Header table, of which the first headerCount entries are in use.
+    size_t headerCount;
+    bool corsHeaders; ///< If true, the pre-rendered CORS header block is sent along.
     std::map<std::string, std::string> vars;
     void Trim(std::string &s);
   };
@@ -299,7 +299,15 @@ static std::string UTF16(uint32_t c){
 }
 
 std::string JSON::string_escape(const std::string & val) {
-  std::string out = "\"";
+  std::string out;
+  string_escape(val, out);
+  return out;
+}
+
+/// JSON-string-escapes a value, appending the result to target.
+void JSON::string_escape(const std::string & val, std::string & out) {
+  out.reserve(out.size() + val.size() + 2);
+  out += '"';
   for (unsigned int i = 0; i < val.size(); ++i) {
     const char & c = val.data()[i];
     switch (c) {
@@ -363,8 +371,7 @@ std::string JSON::string_escape(const std::string & val) {
         break;
     }
   }
-  out += "\"";
-  return out;
+  out += '"';
 }
 
 /// Skips an std::istream forward until any of the following characters is seen: ,]}
@@ -418,9 +425,11 @@ JSON::Value::Value(std::istream & fromstream) {
           reading_array = true;
           c = fromstream.get();
           myType = ARRAY;
-          Value tmp = JSON::Value(fromstream);
-          if (tmp.myType != EMPTY) {
-            append(tmp);
+          Value * tmp = new JSON::Value(fromstream);
+          if (tmp->myType != EMPTY) {
+            arrVal.push_back(tmp);
+          }else{
+            delete tmp;
           }
           break;
         }
@@ -433,7 +442,9 @@ JSON::Value::Value(std::istream & fromstream) {
           stop = true;
         } else {
           std::string tmpstr = read_string(c, fromstream);
-          (*this)[tmpstr] = JSON::Value(fromstream);
+          Value *& member = objVal[tmpstr];
+          if (member){delete member;}
+          member = new JSON::Value(fromstream);
         }
         break;
       case '-':
@@ -480,7 +491,7 @@ JSON::Value::Value(std::istream & fromstream) {
         }
         c = fromstream.get();
         if (reading_array) {
-          append(JSON::Value(fromstream));
+          arrVal.push_back(new JSON::Value(fromstream));
         }
         break;
       case '}':
@@ -667,17 +678,15 @@ JSON::Value & JSON::Value::assignFrom(const Value & rhs, const std::set<std::str
   if (myType == OBJECT){
     jsonForEachConst(rhs, i){
       if (!skip.count(i.key())){
-        JSON::Value tmp;
-        tmp.assignFrom(*i, skip);
-        (*this)[i.key()] = tmp;
+        (*this)[i.key()].assignFrom(*i, skip);
       }
     }
   }
   if (myType == ARRAY){
     jsonForEachConst(rhs, i){
-      JSON::Value tmp;
-      tmp.assignFrom(*i, skip);
-      append(tmp);
+      JSON::Value * tmp = new JSON::Value();
+      tmp->assignFrom(*i, skip);
+      arrVal.push_back(tmp);
     }
   }
   return *this;
@@ -867,15 +876,14 @@ const char * JSON::Value::c_str() const {
 
 /// Retrieves or sets the JSON::Value at this position in the object.
 /// Converts destructively to object if not already an object.
-JSON::Value & JSON::Value::operator[](const std::string i) {
+JSON::Value & JSON::Value::operator[](const std::string & i) {
   if (myType != OBJECT) {
     null();
     myType = OBJECT;
   }
-  Value * pntr = objVal[i];
+  Value *& pntr = objVal[i];
   if (!pntr){
-    objVal[i] = new JSON::Value();
-    pntr = objVal[i];
+    pntr = new JSON::Value();
   }
   return *pntr;
 }
@@ -887,10 +895,9 @@ JSON::Value & JSON::Value::operator[](const char * i) {
     null();
     myType = OBJECT;
   }
-  Value * pntr = objVal[i];
+  Value *& pntr = objVal[i];
   if (!pntr){
-    objVal[i] = new JSON::Value();
-    pntr = objVal[i];
+    pntr = new JSON::Value();
   }
   return *pntr;
 }
@@ -911,7 +918,7 @@ JSON::Value & JSON::Value::operator[](unsigned int i) {
 
 /// Retrieves the JSON::Value at this position in the object.
 /// Fails horribly if that values does not exist.
-const JSON::Value & JSON::Value::operator[](const std::string i) const {
+const JSON::Value & JSON::Value::operator[](const std::string & i) const {
   return *objVal.find(i)->second;
 }
 
@@ -932,17 +939,23 @@ const JSON::Value & JSON::Value::operator[](unsigned int i) const {
 /// As a side effect, this function clear the internal buffer of any object-types.
 std::string JSON::Value::toPacked() const {
   std::string r;
+  r.reserve(packedSize());
+  toPacked(r);
+  return r;
+}
+
+/// Packs for transfer over the network, appending the result to target.
+/// Container types are packed recursively straight into target, without intermediate copies.
+void JSON::Value::toPacked(std::string & r) const {
   if (isInt() || isNull() || isBool()) {
-    r += 0x01;
-    uint64_t numval = intVal;
-    r += *(((char *) &numval) + 7);
-    r += *(((char *) &numval) + 6);
-    r += *(((char *) &numval) + 5);
-    r += *(((char *) &numval) + 4);
-    r += *(((char *) &numval) + 3);
-    r += *(((char *) &numval) + 2);
-    r += *(((char *) &numval) + 1);
-    r += *(((char *) &numval));
+    char numval[9];
+    numval[0] = 0x01;
+    uint64_t tmp = intVal;
+    for (unsigned int i = 8; i > 0; --i){
+      numval[i] = tmp & 0xFF;
+      tmp >>= 8;
+    }
+    r.append(numval, 9);
   }
   if (isString()) {
     r += 0x02;
@@ -960,24 +973,19 @@ std::string JSON::Value::toPacked() const {
           r += i.key().size() / 256;
           r += i.key().size() % 256;
           r += i.key();
-          r += i->toPacked();
+          i->toPacked(r);
         }
       }
     }
-    r += (char)0x0;
-    r += (char)0x0;
-    r += (char)0xEE;
+    r.append("\000\000\356", 3);
   }
   if (isArray()) {
     r += 0x0A;
     jsonForEachConst(*this, i){
-      r += i->toPacked();
+      i->toPacked(r);
     }
-    r += (char)0x0;
-    r += (char)0x0;
-    r += (char)0xEE;
+    r.append("\000\000\356", 3);
   }
-  return r;
 }
 //toPacked
 
@@ -1187,66 +1195,71 @@ std::string & JSON::Value::toNetPacked() {
 /// Converts this JSON::Value to valid JSON notation and returns it.
 /// Makes absolutely no attempts to pretty-print anything. :-)
 std::string JSON::Value::toString() const {
+  std::string r;
+  toString(r);
+  return r;
+}
+
+/// Converts this JSON::Value to valid JSON notation, appending the result to target.
+/// Container types are converted recursively straight into target, without intermediate copies.
+void JSON::Value::toString(std::string & target) const {
   switch (myType) {
     case INTEGER: {
-        std::stringstream st;
-        st << intVal;
-        return st.str();
+        char buf[24];
+        target.append(buf, snprintf(buf, 24, "%lld", intVal));
         break;
       }
     case DOUBLE: {
         std::stringstream st;
         st.precision(10);
         st << std::fixed << dblVal;
-        return st.str();
+        target += st.str();
         break;
       }
     case BOOL: {
         if (intVal != 0){
-          return "true";
+          target += "true";
         }else{
-          return "false";
+          target += "false";
         }
         break;
       }
     case STRING: {
-        return JSON::string_escape(strVal);
+        JSON::string_escape(strVal, target);
         break;
       }
     case ARRAY: {
-        std::string tmp = "[";
+        target += '[';
         if (arrVal.size() > 0) {
           jsonForEachConst(*this, i){
-            tmp += i->toString();
+            i->toString(target);
             if (i.num()+1 != arrVal.size()) {
-              tmp += ",";
+              target += ',';
             }
           }
         }
-        tmp += "]";
-        return tmp;
+        target += ']';
         break;
       }
     case OBJECT: {
-        std::string tmp2 = "{";
+        target += '{';
         if (objVal.size() > 0) {
           jsonForEachConst(*this, i){
-            tmp2 += JSON::string_escape(i.key()) + ":";
-            tmp2 += i->toString();
+            JSON::string_escape(i.key(), target);
+            target += ':';
+            i->toString(target);
             if (i.num()+1 != objVal.size()) {
-              tmp2 += ",";
+              target += ',';
             }
           }
         }
-        tmp2 += "}";
-        return tmp2;
+        target += '}';
         break;
       }
     case EMPTY:
     default:
-      return "null";
+      target += "null";
   }
-  return "null"; //should never get here...
 }
 
 /// Converts this JSON::Value to valid JSON notation and returns it.
@@ -1512,12 +1525,12 @@ void JSON::fromDTMI(const unsigned char * data, unsigned int len, unsigned int &
           return;
         }
         unsigned int tmpi = data[i + 1] * 256 * 256 * 256 + data[i + 2] * 256 * 256 + data[i + 3] * 256 + data[i + 4]; //set tmpi to UTF-8-long length
-        std::string tmpstr = std::string((const char *)data + i + 5, (size_t)tmpi); //set the string data
         if (i + 4 + tmpi >= len) {
           return;
         }
+        ret.myType = STRING;
+        ret.strVal.assign((const char *)data + i + 5, (size_t)tmpi); //set the string data
         i += tmpi + 5; //skip length+size+1 forwards
-        ret = tmpstr;
         return;
         break;
       }
@@ -1531,8 +1544,7 @@ void JSON::fromDTMI(const unsigned char * data, unsigned int len, unsigned int &
           unsigned int tmpi = data[i] * 256 + data[i + 1]; //set tmpi to the UTF-8 length
           std::string tmpstr = std::string((const char *)data + i + 2, (size_t)tmpi); //set the string data
           i += tmpi + 2; //skip length+size forwards
-          ret[tmpstr].null();
-          fromDTMI(data, len, i, ret[tmpstr]); //add content, recursively parsed, updating i, setting indice to tmpstr
+          fromDTMI(data, len, i, ret[tmpstr]); //add content, recursively parsed in place, updating i, setting indice to tmpstr
         }
         i += 3; //skip 0x0000EE
         return;
@@ -1541,9 +1553,10 @@ void JSON::fromDTMI(const unsigned char * data, unsigned int len, unsigned int &
     case 0x0A: { //array
         ++i;
         while (data[i] + data[i + 1] != 0 && i < len) { //while not encountering 0x0000 (we assume 0x0000EE)
-          JSON::Value tval;
-          fromDTMI(data, len, i, tval); //add content, recursively parsed, updating i
-          ret.append(tval);
+          ret.myType = ARRAY;
+          JSON::Value * tval = new JSON::Value();
+          ret.arrVal.push_back(tval);
+          fromDTMI(data, len, i, *tval); //add content, recursively parsed in place, updating i
         }
         i += 3; //skip 0x0000EE
         return;
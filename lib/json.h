@@ -19,11 +19,13 @@ namespace JSON {
 
   /// JSON-string-escapes a value
   std::string string_escape(const std::string & val);
+  void string_escape(const std::string & val, std::string & target);
 
   /// A JSON::Value is either a string or an integer, but may also be an object, array or null.
   class Value {
     friend class Iter;
     friend class ConstIter;
+    friend void fromDTMI(const unsigned char * data, unsigned int len, unsigned int & i, Value & ret);
     private:
       ValueType myType;
       long long int intVal;
@@ -70,19 +72,21 @@ namespace JSON {
       const std::string & asStringRef() const;
       const char * c_str() const;
       //array operator for maps and arrays
-      Value & operator[](const std::string i);
+      Value & operator[](const std::string & i);
       Value & operator[](const char * i);
       Value & operator[](unsigned int i);
-      const Value & operator[](const std::string i) const;
+      const Value & operator[](const std::string & i) const;
       const Value & operator[](const char * i) const;
       const Value & operator[](unsigned int i) const;
       //handy functions and others
       std::string toPacked() const;
+      void toPacked(std::string & target) const;
       void sendTo(Socket::Connection & socket) const;
       unsigned int packedSize() const;
       void netPrepare();
       std::string & toNetPacked();
       std::string toString() const;
+      void toString(std::string & target) const;
       std::string toPrettyString(int indentation = 0) const;
       void append(const Value & rhs);
       void prepend(const Value & rhs);
@@ -0,0 +1,275 @@
+/// \file log_ring.cpp
+/// Lock-free multi-producer ring of log messages in shared memory, drained by the controller.
+/// Slots are claimed and published through per-slot sequence numbers, so writers never wait on each other
+/// or on the controller. A writer that dies between claiming and publishing a slot is skipped after a second.
+
+#include "log_ring.h"
+#include "defines.h"
+#include "shared_memory.h"
+#include <algorithm>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#define LOG_RING_MAGIC 0x4D4C4F47 //"MLOG"
+#define LOG_RING_SIZE (sizeof(header) + LOG_RING_SLOTS * LOG_RING_SLOT_SIZE)
+
+namespace LogRing{
+  static IPC::sharedPage * page = 0;///< Never deleted, so other threads can keep using the mapping during exit
+  static IPC::sharedPage * retired = 0;///< Mapping of the previous ring, deleted when attaching to the next one
+  static header * volatile ring = 0;
+  static int enabled = -1;///< Whether this process was started by a controller, -1 if not checked yet
+  static volatile int attaching = 0;
+  static uint64_t nextAttach = 0;
+  static bool consumer = false;
+  static uint64_t stuckSince = 0;
+  static pid_t myPid = 0;
+  static char streamName[sizeof(((record *)0)->stream)] = "";
+  static __thread bool inLog = false;
+
+  static uint64_t nowMs(){
+    struct timespec t;
+    clock_gettime(CLOCK_REALTIME, &t);
+    return (uint64_t)t.tv_sec * 1000 + t.tv_nsec / 1000000;
+  }
+
+  static void resetPid(){
+    myPid = getpid();
+  }
+
+  /// Returns the PID of this process without a system call, after the first time.
+  static pid_t cachedPid(){
+    if (!myPid){
+      pthread_atfork(0, 0, resetPid);
+      myPid = getpid();
+    }
+    return myPid;
+  }
+
+  static const char * programName(){
+#if !defined(__APPLE__) && !defined(__MACH__) && defined(__GNUC__)
+    return program_invocation_short_name;
+#else
+    return "";
+#endif
+  }
+
+  static inline record * slotAt(header * h, uint64_t pos){
+    return (record *)((char *)h + sizeof(header) + (pos & (h->slots - 1)) * LOG_RING_SLOT_SIZE);
+  }
+
+  static inline bool usable(header * h, uint64_t now){
+    return h && h->magic == LOG_RING_MAGIC && h->drained + LOG_RING_STALE > now;
+  }
+
+  /// Sets the stream name that is sent along with all further messages of this process.
+  void setStream(const std::string & name){
+    size_t len = std::min(name.size(), sizeof(streamName) - 1);
+    memcpy(streamName, name.data(), len);
+    streamName[len] = 0;
+  }
+
+  /// Maps the ring with the given name for writing messages to it.
+  /// Called automatically for the default ring when the first message is logged.
+  /// The mapping of the ring before the previous one is released: attaching happens at most once per second,
+  /// so no other thread can still be writing to it.
+  bool attach(const std::string & name){
+    IPC::sharedPage * p = new IPC::sharedPage(name, 0, false, false);
+    if (!p->mapped || p->len < (long long)LOG_RING_SIZE || ((header *)p->mapped)->magic != LOG_RING_MAGIC){
+      delete p;
+      return false;
+    }
+    delete retired;
+    retired = page;
+    page = p;
+    __sync_synchronize();
+    ring = (header *)p->mapped;
+    return true;
+  }
+
+  /// Returns the ring if a controller is draining it, (re)attaching to it at most once per second.
+  static header * producerRing(){
+    header * h = ring;
+    uint64_t now = nowMs();
+    if (usable(h, now)){return h;}
+    if (enabled == -1){enabled = getenv(LOG_RING_ENV) ? 1 : 0;}
+    if (!enabled || consumer || now < nextAttach || !__sync_bool_compare_and_swap(&attaching, 0, 1)){return 0;}
+    nextAttach = now + 1000;
+    //A controller that exits clears the magic; a new one creates a fresh ring
+    if (!h || h->magic != LOG_RING_MAGIC){attach(SHM_LOG_RING);}
+    attaching = 0;
+    h = ring;
+    return usable(h, now) ? h : 0;
+  }
+
+  /// Writes a message into the ring. Never blocks and makes no system calls.
+  /// \returns False if there is no ring being drained or it is full, in which case nothing was written.
+  bool append(int level, const char * origin, const char * message, size_t len){
+    header * h = producerRing();
+    if (!h){return false;}
+    if (len > sizeof(((record *)0)->message)){len = sizeof(((record *)0)->message);}
+    uint64_t pos = h->writePos;
+    record * r;
+    while (true){
+      r = slotAt(h, pos);
+      int64_t dif = (int64_t)(r->seq - pos);
+      if (!dif){
+        if (__sync_bool_compare_and_swap(&h->writePos, pos, pos + 1)){break;}
+      }else if (dif < 0){
+        //The slot still holds a message from the previous lap: the ring is full
+        __sync_fetch_and_add(&h->overflows, 1);
+        return false;
+      }
+      pos = h->writePos;
+    }
+    r->time = nowMs();
+    r->pid = cachedPid();
+    r->level = level;
+    r->msgLen = len;
+    strncpy(r->program, programName(), sizeof(r->program) - 1);
+    r->program[sizeof(r->program) - 1] = 0;
+    memcpy(r->stream, streamName, sizeof(r->stream));
+    strncpy(r->origin, origin, sizeof(r->origin) - 1);
+    r->origin[sizeof(r->origin) - 1] = 0;
+    memcpy(r->message, message, len);
+    __sync_synchronize();
+    //Publish, unless the controller gave up on this slot in the mean time
+    __sync_bool_compare_and_swap(&r->seq, pos, pos + 1);
+    return true;
+  }
+
+  /// Logs a message at the given level. Used by the DEBUG_MSG macro and friends.
+  /// Goes into the ring if this process was started by a controller that is draining it, to standard error otherwise.
+  void log(int level, const char * file, int line, const char * fmt, ...){
+    if (level < 0 || level > DLVL_DONTEVEN){level = DLVL_DONTEVEN;}
+    char origin[sizeof(((record *)0)->origin)] = "";
+    if (file){snprintf(origin, sizeof(origin), "%s:%d", file, line);}
+    char msg[sizeof(((record *)0)->message)];
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(msg, sizeof(msg), fmt, args);
+    va_end(args);
+    if (len < 0){len = 0;}
+    //Messages logged while writing to the ring (e.g. by the shared memory code) go to standard error
+    if (!inLog && (size_t)len < sizeof(msg)){
+      inLog = true;
+      bool written = append(level, origin, msg, len);
+      inLog = false;
+      if (written){return;}
+    }
+    if ((size_t)len < sizeof(msg)){
+      fprintf(stderr, "%s|%s|%d|%s|%s\n", DBG_LVL_LIST[level], programName(), cachedPid(), origin, msg);
+      return;
+    }
+    //Too long for the ring: print it in full
+    char * longMsg = 0;
+    va_start(args, fmt);
+    if (vasprintf(&longMsg, fmt, args) >= 0){
+      fprintf(stderr, "%s|%s|%d|%s|%s\n", DBG_LVL_LIST[level], programName(), cachedPid(), origin, longMsg);
+      free(longMsg);
+    }
+    va_end(args);
+  }
+
+  /// Creates the ring with the given name, making this process its only reader.
+  /// A ring left behind by a previous controller is taken over as it is, since its writers may still be active.
+  bool create(const std::string & name){
+    IPC::sharedPage * p = new IPC::sharedPage(name, 0, false, false);
+    if (p->mapped && p->len >= (long long)LOG_RING_SIZE && ((header *)p->mapped)->magic == LOG_RING_MAGIC &&
+        ((header *)p->mapped)->slots == LOG_RING_SLOTS){
+      page = p;
+      consumer = true;
+      __sync_synchronize();
+      ring = (header *)p->mapped;
+      return true;
+    }
+    delete p;
+    p = new IPC::sharedPage(name, LOG_RING_SIZE, true);
+    if (!p->mapped){
+      delete p;
+      return false;
+    }
+    header * h = (header *)p->mapped;
+    h->magic = 0;
+    __sync_synchronize();
+    h->slots = LOG_RING_SLOTS;
+    h->writePos = 0;
+    h->readPos = 0;
+    h->overflows = 0;
+    h->drained = nowMs();
+    for (uint64_t i = 0; i < LOG_RING_SLOTS; ++i){slotAt(h, i)->seq = i;}
+    __sync_synchronize();
+    h->magic = LOG_RING_MAGIC;
+    page = p;
+    consumer = true;
+    __sync_synchronize();
+    ring = h;
+    return true;
+  }
+
+  /// Passes up to max messages from the ring to callback, in order, and marks the ring as being drained.
+  /// Must only be called from one thread at a time, in the process that created the ring.
+  /// \returns The amount of messages passed to callback.
+  size_t drain(void callback(const record &), size_t max){
+    header * h = ring;
+    if (!consumer || !h){return 0;}
+    uint64_t now = nowMs();
+    h->drained = now;
+    size_t count = 0;
+    while (count < max){
+      uint64_t pos = h->readPos;
+      record * r = slotAt(h, pos);
+      if (r->seq == pos + 1){
+        __sync_synchronize();
+        callback(*r);
+        __sync_synchronize();
+        r->seq = pos + h->slots;
+        h->readPos = pos + 1;
+        stuckSince = 0;
+        ++count;
+        continue;
+      }
+      if (h->writePos <= pos){break;}
+      if (r->seq == pos + h->slots){
+        //Drained by a previous controller that exited before moving readPos past it
+        h->readPos = pos + 1;
+        continue;
+      }
+      //Claimed but not published yet; give up on the slot if its writer does not finish within a second
+      if (!stuckSince){stuckSince = now;}
+      if (now - stuckSince < 1000){break;}
+      if (__sync_bool_compare_and_swap(&r->seq, pos, pos + h->slots)){
+        h->readPos = pos + 1;
+        stuckSince = 0;
+      }
+    }
+    return count;
+  }
+
+  /// Returns the amount of messages that went to standard error because the ring was full.
+  uint64_t overflows(){
+    header * h = ring;
+    return h ? h->overflows : 0;
+  }
+
+  /// Stops being the reader of the ring. Unless leaveBehind is set, writers go back to standard error and the ring is removed.
+  /// The mapping itself is kept, as other threads may still be writing to it.
+  void destroy(bool leaveBehind){
+    header * h = ring;
+    if (!consumer || !h){return;}
+    consumer = false;
+    if (!leaveBehind){
+      h->magic = 0;
+      ring = 0;
+#ifdef SHM_ENABLED
+      shm_unlink(page->name.c_str());
+#endif
+    }
+    page->master = false;
+  }
+}
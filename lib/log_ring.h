@@ -0,0 +1,51 @@
+/// \file log_ring.h
+/// Lock-free multi-producer ring of log messages in shared memory, drained by the controller.
+/// Processes started by the controller append pre-formatted messages without any system calls; standard error
+/// is used by all other processes, and when no controller is draining the ring or it is full.
+
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+#define LOG_RING_SLOTS 4096 ///< Amount of messages the ring holds, must be a power of two
+#define LOG_RING_SLOT_SIZE 1024 ///< Size of a single message record, in bytes
+#define LOG_RING_STALE 5000 ///< Milliseconds without a drain after which the ring is considered abandoned
+#define LOG_RING_ENV "MIST_LOG_RING" ///< Environment variable the controller sets for its children, enabling the ring
+
+namespace LogRing{
+  /// A single message in the ring.
+  struct record{
+    volatile uint64_t seq;///< Slot state: equals the write position for free slots, one more once written
+    uint64_t time;///< Milliseconds since the epoch
+    uint32_t pid;
+    uint8_t level;
+    uint8_t reserved;
+    uint16_t msgLen;
+    char program[32];
+    char stream[96];
+    char origin[48];///< Source file and line, may be empty
+    char message[LOG_RING_SLOT_SIZE - 200];
+  };
+
+  /// Header at the start of the ring page.
+  struct header{
+    volatile uint32_t magic;///< Set once the ring is initialized, cleared when the controller exits
+    uint32_t slots;
+    volatile uint64_t writePos;
+    volatile uint64_t readPos;
+    volatile uint64_t drained;///< Time of the last drain in milliseconds since the epoch
+    volatile uint64_t overflows;///< Messages that went to standard error because the ring was full
+    char reserved[24];
+  };
+
+  void log(int level, const char * file, int line, const char * fmt, ...) __attribute__((format(printf, 4, 5)));
+  void setStream(const std::string & streamName);
+  bool attach(const std::string & name);
+  bool append(int level, const char * origin, const char * message, size_t len);
+
+  bool create(const std::string & name);
+  size_t drain(void callback(const record &), size_t max = LOG_RING_SLOTS);
+  uint64_t overflows();
+  void destroy(bool leaveBehind);
+}
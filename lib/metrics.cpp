@@ -0,0 +1,176 @@
+/// \file metrics.cpp
+/// Timing histograms of hot paths, kept per process and published on a shared memory page for the controller.
+
+#include "metrics.h"
+#include "defines.h"
+#include "shared_memory.h"
+#include "timing.h"
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <unistd.h>
+
+namespace Metrics{
+  const char * names[METRIC_COUNT] = {"page_wait", "empty_wait", "meta_update", "live_wait", "buffer_frame", "packet_send"};
+
+  const char * descriptions[METRIC_COUNT] = {
+      "Time outputs spent waiting for the input to make a requested page available.",
+      "Time outputs spent waiting for new data at the end of a live page.",
+      "Time spent reading or writing stream metadata on its page, including the lock wait.",
+      "Time spent waiting for the live metadata lock.",
+      "Time inputs spent loading a single VoD page.",
+      "Time outputs spent handling a single packet."};
+
+  /// Upper bounds of the histogram buckets, in microseconds. The last bucket has no upper bound.
+  const uint64_t bucketBounds[METRICS_BUCKETS - 1] = {100, 500, 1000, 5000, 10000, 50000, 100000, 500000, 1000000};
+
+  static totals local;///< The histograms of this process
+  static IPC::sharedPage page;///< The controller's metrics page, if we have a record on it
+  static Util::RelAccX rlx;
+  static uint64_t recordNo = 0;
+
+  /// Adds the given amount of microseconds to the histogram of the given metric.
+  void record(metric m, uint64_t micros){
+    histogram & h = local.values[m];
+    ++h.count;
+    h.sum += micros;
+    size_t b = 0;
+    while (b < METRICS_BUCKETS - 1 && micros > bucketBounds[b]){++b;}
+    ++h.buckets[b];
+  }
+
+  /// Writes the histograms of this process to our record on the metrics page.
+  static void writeRecord(){
+    for (size_t m = 0; m < METRIC_COUNT; ++m){
+      const histogram & h = local.values[m];
+      std::string field = names[m];
+      memcpy(rlx.getPointer(field + "_buckets", recordNo), h.buckets, sizeof(h.buckets));
+      rlx.setInt(field + "_sum", h.sum, recordNo);
+      rlx.setInt(field + "_count", h.count, recordNo);
+    }
+  }
+
+  /// Writes the histograms of this process to the controller's metrics page, claiming a record first if needed.
+  /// The process name is only used when claiming a record.
+  void publish(const std::string & process){
+    if (page.mapped && (rlx.isExit() || rlx.getInt("pid", recordNo) != (uint64_t)getpid())){
+      //The controller restarted or released our record: start over
+      page.close();
+    }
+    if (!page.mapped){
+      page.init(SHM_STATE_METRICS, SHM_STATE_METRICS_SIZE, false, false);
+      if (!page.mapped){return;}
+      rlx = Util::RelAccX(page.mapped, false);
+      if (!rlx.isReady()){
+        page.close();
+        return;
+      }
+      IPC::semaphore metricsLock(SEM_STATE_METRICS, O_CREAT | O_RDWR, ACCESSPERMS, 1);
+      metricsLock.wait();
+      recordNo = rlx.getEndPos();
+      //Records of exited processes are released by the controller, once it has added them to its totals
+      for (uint64_t i = 0; i < rlx.getEndPos(); ++i){
+        if (!rlx.getInt("pid", i)){
+          recordNo = i;
+          //Overwrite the previous owner's values before the controller can see the record as ours
+          rlx.setString("process", process, i);
+          writeRecord();
+          rlx.setInt("pid", getpid(), i);
+          break;
+        }
+      }
+      metricsLock.post();
+      if (recordNo == rlx.getEndPos()){
+        static bool warned = false;
+        if (!warned){WARN_MSG("No room left on the metrics page for %s", process.c_str());}
+        warned = true;
+        page.close();
+      }
+      return;
+    }
+    writeRecord();
+  }
+
+  /// Forgets the histograms and metrics record inherited from the parent process, for use right after forking.
+  void reset(){
+    local = totals();
+    if (page.mapped){page.close();}
+  }
+
+  /// Adds the fields of a metrics record to the given, not yet ready, accessor.
+  void addFields(Util::RelAccX & rlx){
+    rlx.addField("pid", RAX_32UINT);
+    rlx.addField("process", RAX_32STRING);
+    for (size_t m = 0; m < METRIC_COUNT; ++m){
+      std::string field = names[m];
+      rlx.addField(field + "_count", RAX_64UINT);
+      rlx.addField(field + "_sum", RAX_64UINT);
+      rlx.addField(field + "_buckets", RAX_RAW, sizeof(uint64_t) * METRICS_BUCKETS);
+    }
+  }
+
+  timer::timer(metric m){
+    which = m;
+    start = Util::getMicros();
+  }
+
+  timer::~timer(){record(which, Util::getMicros(start));}
+
+  totals::totals(){memset(values, 0, sizeof(values));}
+
+  /// Adds the histograms of other to our own.
+  void totals::add(const totals & other){
+    for (size_t m = 0; m < METRIC_COUNT; ++m){
+      values[m].count += other.values[m].count;
+      values[m].sum += other.values[m].sum;
+      for (size_t b = 0; b < METRICS_BUCKETS; ++b){values[m].buckets[b] += other.values[m].buckets[b];}
+    }
+  }
+
+  /// Adds the histograms of the given record of a metrics page to our own.
+  void totals::add(const Util::RelAccX & rlx, uint64_t recordNo){
+    for (size_t m = 0; m < METRIC_COUNT; ++m){
+      std::string field = names[m];
+      values[m].count += rlx.getInt(field + "_count", recordNo);
+      values[m].sum += rlx.getInt(field + "_sum", recordNo);
+      uint64_t buckets[METRICS_BUCKETS];
+      memcpy(buckets, rlx.getPointer(field + "_buckets", recordNo), sizeof(buckets));
+      for (size_t b = 0; b < METRICS_BUCKETS; ++b){values[m].buckets[b] += buckets[b];}
+    }
+  }
+
+  /// Prints the given amount of microseconds as seconds.
+  static void printSeconds(std::stringstream & out, uint64_t micros){
+    out << (micros / 1000000) << "." << std::setw(6) << std::setfill('0') << (micros % 1000000);
+  }
+
+  /// Returns the given histograms, per process name, in the Prometheus text exposition format.
+  /// Metrics that were never recorded by a process are left out for that process.
+  std::string toPrometheus(const std::map<std::string, totals> & processes){
+    std::stringstream out;
+    for (size_t m = 0; m < METRIC_COUNT; ++m){
+      std::string name = std::string("mist_") + names[m] + "_seconds";
+      out << "# HELP " << name << " " << descriptions[m] << "\n";
+      out << "# TYPE " << name << " histogram\n";
+      for (std::map<std::string, totals>::const_iterator it = processes.begin(); it != processes.end(); ++it){
+        const histogram & h = it->second.values[m];
+        if (!h.count){continue;}
+        uint64_t cumulative = 0;
+        for (size_t b = 0; b < METRICS_BUCKETS; ++b){
+          cumulative += h.buckets[b];
+          out << name << "_bucket{process=\"" << it->first << "\",le=\"";
+          if (b < METRICS_BUCKETS - 1){
+            printSeconds(out, bucketBounds[b]);
+          }else{
+            out << "+Inf";
+          }
+          out << "\"} " << cumulative << "\n";
+        }
+        out << name << "_sum{process=\"" << it->first << "\"} ";
+        printSeconds(out, h.sum);
+        out << "\n" << name << "_count{process=\"" << it->first << "\"} " << h.count << "\n";
+      }
+    }
+    return out.str();
+  }
+}
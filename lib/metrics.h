@@ -0,0 +1,60 @@
+/// \file metrics.h
+/// Timing histograms of hot paths, kept per process and published on a shared memory page for the controller.
+
+#pragma once
+#include <map>
+#include <string>
+#include <stdint.h>
+#include "util.h"
+
+#define METRICS_BUCKETS 10 ///< Amount of histogram buckets per metric, the last one being unbounded
+
+namespace Metrics{
+  /// The timed hot paths.
+  enum metric{
+    PAGE_WAIT,    ///< Output waiting for the input to make a requested page available
+    EMPTY_WAIT,   ///< Output waiting for new data at the end of a live page
+    META_UPDATE,  ///< Reading or writing the stream metadata on its page, including the lock wait
+    LIVE_WAIT,    ///< Waiting for the SEM_LIVE metadata lock
+    BUFFER_FRAME, ///< Input loading a single VoD page
+    PACKET_SEND,  ///< Output handling a single packet in sendNext
+    METRIC_COUNT
+  };
+
+  extern const char * names[METRIC_COUNT];
+  extern const char * descriptions[METRIC_COUNT];
+  extern const uint64_t bucketBounds[METRICS_BUCKETS - 1];
+
+  void record(metric m, uint64_t micros);
+  void publish(const std::string & process);
+  void reset();
+  void addFields(Util::RelAccX & rlx);
+
+  /// Records the time between its construction and destruction in the given metric.
+  class timer{
+    public:
+      timer(metric m);
+      ~timer();
+    private:
+      metric which;
+      uint64_t start;
+  };
+
+  /// Histogram of a single metric.
+  struct histogram{
+    uint64_t count;
+    uint64_t sum;///< In microseconds
+    uint64_t buckets[METRICS_BUCKETS];
+  };
+
+  /// Accumulated histograms of all metrics.
+  class totals{
+    public:
+      totals();
+      void add(const totals & other);
+      void add(const Util::RelAccX & rlx, uint64_t recordNo);
+      histogram values[METRIC_COUNT];
+  };
+
+  std::string toPrometheus(const std::map<std::string, totals> & processes);
+}
@@ -259,6 +259,9 @@ namespace MP4 {
       case 0x74666864:
         return ((TFHD *)this)->toPrettyString(indent);
         break;
+      case 0x74666474:
+        return ((TFDT *)this)->toPrettyString(indent);
+        break;
       case 0x61766343:
         return ((AVCC *)this)->toPrettyString(indent);
         break;
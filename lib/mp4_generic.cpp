@@ -497,6 +497,9 @@ namespace MP4 {
     if (flags & tfhdNoDuration) {
       r << " NoDuration";
     }
+    if (flags & tfhdBaseIsMoof) {
+      r << " BaseIsMoof";
+    }
     r << std::endl;
 
     r << std::string(indent + 1, ' ') << "TrackID " << getTrackID() << std::endl;
@@ -520,6 +523,37 @@ namespace MP4 {
     return r.str();
   }
 
+  TFDT::TFDT(uint64_t baseMediaDecodeTime) {
+    memcpy(data + 4, "tfdt", 4);
+    setVersion(1);
+    setFlags(0);
+    setBaseMediaDecodeTime(baseMediaDecodeTime);
+  }
+
+  void TFDT::setBaseMediaDecodeTime(uint64_t newBaseMediaDecodeTime) {
+    if (getVersion() == 0) {
+      setInt32(newBaseMediaDecodeTime, 4);
+    } else {
+      setInt64(newBaseMediaDecodeTime, 4);
+    }
+  }
+
+  uint64_t TFDT::getBaseMediaDecodeTime() {
+    if (getVersion() == 0) {
+      return getInt32(4);
+    } else {
+      return getInt64(4);
+    }
+  }
+
+  std::string TFDT::toPrettyString(uint32_t indent) {
+    std::stringstream r;
+    r << std::string(indent, ' ') << "[tfdt] Track Fragment Base Media Decode Time Box (" << boxedSize() << ")" << std::endl;
+    r << fullBox::toPrettyString(indent);
+    r << std::string(indent + 1, ' ') << "BaseMediaDecodeTime: " << getBaseMediaDecodeTime() << std::endl;
+    return r.str();
+  }
+
 
   AVCC::AVCC() {
     memcpy(data + 4, "avcC", 4);
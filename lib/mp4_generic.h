@@ -74,6 +74,7 @@ namespace MP4 {
     tfhdSampleSize = 0x000010,
     tfhdSampleFlag = 0x000020,
     tfhdNoDuration = 0x010000,
+    tfhdBaseIsMoof = 0x020000,
   };
   class TFHD: public Box {
     public:
@@ -95,6 +96,14 @@ namespace MP4 {
       std::string toPrettyString(uint32_t indent = 0);
   };
 
+  class TFDT: public fullBox {
+    public:
+      TFDT(uint64_t baseMediaDecodeTime = 0);
+      void setBaseMediaDecodeTime(uint64_t newBaseMediaDecodeTime);
+      uint64_t getBaseMediaDecodeTime();
+      std::string toPrettyString(uint32_t indent = 0);
+  };
+
 
   class AVCC: public Box {
     public:
@@ -10,7 +10,62 @@
 #include "bitfields.h"
 #include "defines.h"
 
+#if defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
 namespace nalu {
+  /// Returns a pointer to the first occurrence of the bytes 00 00 [third] in data, or null if none.
+  /// Checks 16 (or with AVX2, 32) positions at once where the instruction set allows it.
+  static const char * scanZeroZero(const char * data, uint32_t dataSize, char third){
+    if (dataSize < 3){return 0;}
+    const char * p = data;
+    //One past the last position a match can start at
+    const char * end = data + dataSize - 2;
+#if defined(__AVX2__)
+    const __m256i zero32 = _mm256_setzero_si256();
+    const __m256i third32 = _mm256_set1_epi8(third);
+    while (p + 32 <= end){
+      __m256i a = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)p), zero32);
+      __m256i b = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(p + 1)), zero32);
+      __m256i c = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(p + 2)), third32);
+      uint32_t mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_and_si256(a, b), c));
+      if (mask){return p + __builtin_ctz(mask);}
+      p += 32;
+    }
+#endif
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i thirdVec = _mm_set1_epi8(third);
+    while (p + 16 <= end){
+      __m128i a = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)p), zero);
+      __m128i b = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + 1)), zero);
+      __m128i c = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + 2)), thirdVec);
+      uint32_t mask = _mm_movemask_epi8(_mm_and_si128(_mm_and_si128(a, b), c));
+      if (mask){return p + __builtin_ctz(mask);}
+      p += 16;
+    }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    const uint8x16_t zero = vdupq_n_u8(0);
+    const uint8x16_t thirdVec = vdupq_n_u8(third);
+    while (p + 16 <= end){
+      uint8x16_t a = vceqq_u8(vld1q_u8((const uint8_t *)p), zero);
+      uint8x16_t b = vceqq_u8(vld1q_u8((const uint8_t *)(p + 1)), zero);
+      uint8x16_t c = vceqq_u8(vld1q_u8((const uint8_t *)(p + 2)), thirdVec);
+      uint64x2_t mask = vreinterpretq_u64_u8(vandq_u8(vandq_u8(a, b), c));
+      //Found something in this block; the scalar loop below pinpoints it
+      if (vgetq_lane_u64(mask, 0) | vgetq_lane_u64(mask, 1)){break;}
+      p += 16;
+    }
+#endif
+    for (; p < end; ++p){
+      if (!p[0] && !p[1] && p[2] == third){return p;}
+    }
+    return 0;
+  }
+
   std::deque<int> parseNalSizes(DTSC::Packet & pack){
     std::deque<int> result;
     char * data;
@@ -26,27 +81,30 @@ namespace nalu {
   }
 
   std::string removeEmulationPrevention(const std::string & data) {
-    std::string result;
-    result.resize(data.size());
-    result[0] = data[0];
-    result[1] = data[1];
-    unsigned int dataPtr = 2;
-    unsigned int dataLen = data.size();
-    unsigned int resPtr = 2;
-    while (dataPtr + 2 < dataLen) {
-      if (!data[dataPtr] && !data[dataPtr + 1] && data[dataPtr + 2] == 3){ //We have found an emulation prevention
-        result[resPtr++] = data[dataPtr++];
-        result[resPtr++] = data[dataPtr++];
-        dataPtr++; //Skip the emulation prevention byte
-      } else {
-        result[resPtr++] = data[dataPtr++];
-      }
+    std::string result = data;
+    if (result.size() > 2){
+      result.resize(removeEmulationPrevention((char *)result.data(), result.size()));
     }
+    return result;
+  }
 
-    while (dataPtr < dataLen){
-      result[resPtr++] = data[dataPtr++];
+  /// Removes emulation prevention bytes (the 03 in 00 00 03) from data, in place.
+  /// The first two bytes are never considered part of such a sequence.
+  /// \returns The new size of the data.
+  unsigned long removeEmulationPrevention(char * data, unsigned long dataSize){
+    if (dataSize < 3){return dataSize;}
+    char * writePtr = data + 2;
+    const char * readPtr = data + 2;
+    const char * end = data + dataSize;
+    while (readPtr < end){
+      const char * found = scanEmulationPrevention(readPtr, end - readPtr);
+      //Copy everything up to and including the two zero bytes, then skip the 03
+      const char * copyEnd = (found ? found + 2 : end);
+      if (writePtr != readPtr){memmove(writePtr, readPtr, copyEnd - readPtr);}
+      writePtr += copyEnd - readPtr;
+      readPtr = (found ? found + 3 : end);
     }
-    return result.substr(0, resPtr);
+    return writePtr - data;
   }
 
   unsigned long toAnnexB(const char * data, unsigned long dataSize, char *& result){
@@ -79,30 +137,15 @@ namespace nalu {
 
   ///Scan data for Annex B start code. Returns pointer to it when found, null otherwise.
   const char * scanAnnexB(const char * data, uint32_t dataSize){
-    char * offset = (char*)data;
-    const char * maxData = data + dataSize - 2;
-    while(offset < maxData){
-      if (offset[2] > 1){
-        //We have no zero in the third byte, so we need to skip at least 3 bytes forward
-        offset += 3;
-        continue;
-      }
-      if (!offset[2]){
-        //We skip forward 1 or 2 bytes depending on contents of the second byte
-        offset += (offset[1]?2:1);
-        continue;
-      }
-      if (!offset[0] && !offset[1]){
-        return offset;
-      }
-      //We have no zero in the third byte, so we need to skip at least 3 bytes forward
-      offset += 3;
-    }
-    return 0;
+    return scanZeroZero(data, dataSize, 1);
+  }
+
+  ///Scan data for an emulation prevention sequence (00 00 03). Returns pointer to it when found, null otherwise.
+  const char * scanEmulationPrevention(const char * data, uint32_t dataSize){
+    return scanZeroZero(data, dataSize, 3);
   }
 
   unsigned long fromAnnexB(const char * data, unsigned long dataSize, char *& result){
-    const char * lastCheck = data + dataSize - 3;
     if (!result){
       FAIL_MSG("No output buffer given to FromAnnexB");
       return 0;
@@ -110,19 +153,13 @@ namespace nalu {
     int offset = 0;
     int newOffset = 0;
     while (offset < dataSize){
-      const char * begin = data + offset;
-      while ( begin < lastCheck && !(!begin[0] && !begin[1] && begin[2] == 0x01)){
-        begin++;
-        if (begin < lastCheck && begin[0]){
-          begin++;
-        }
-      }
-      begin += 3;//Initialize begin after the first 0x000001 pattern.
-      if (begin > data + dataSize){
+      const char * begin = scanAnnexB(data + offset, dataSize - offset);
+      if (!begin){
         offset = dataSize;
         continue;
       }
-      const char * end = (const char*)memmem(begin, dataSize - (begin - data), "\000\000\001", 3);
+      begin += 3;//Initialize begin after the first 0x000001 pattern.
+      const char * end = scanAnnexB(begin, dataSize - (begin - data));
       if (!end) {
         end = data + dataSize;
       }
@@ -13,9 +13,11 @@ namespace nalu {
 
   std::deque<int> parseNalSizes(DTSC::Packet & pack);
   std::string removeEmulationPrevention(const std::string & data);
+  unsigned long removeEmulationPrevention(char * data, unsigned long dataSize);
 
   unsigned long toAnnexB(const char * data, unsigned long dataSize, char *& result);
   unsigned long fromAnnexB(const char * data, unsigned long dataSize, char *& result);
   const char* scanAnnexB(const char * data, uint32_t dataSize);
+  const char* scanEmulationPrevention(const char * data, uint32_t dataSize);
   const char* nalEndPosition(const char * data, uint32_t dataSize);
 }
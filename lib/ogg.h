@@ -14,12 +14,20 @@ namespace OGG {
   class oggSegment {
     public:
       oggSegment();
-      std::string dataString;
+      void setData(const char * ptr, size_t len);
+      void own();
+      void consume(size_t count);
+      const char * getData() const;
+      size_t getSize() const;
+      std::string dataString;///< Owned segment data, used when the segment does not reference external data
       int isKeyframe;
       long long unsigned int lastKeyFrameSeen;
       long long unsigned int framesSinceKeyFrame;
       unsigned int frameNumber;
       long long unsigned int timeStamp;
+    private:
+      const char * dataPtr;///< Referenced segment data, not owned by this segment; null if dataString holds the data
+      size_t dataLen;
   };
 
   enum oggCodec {THEORA, VORBIS, OPUS};
@@ -78,6 +86,7 @@ namespace OGG {
       unsigned int addSegment(const std::string & content); //add a segment to the page, returns added bytes
       unsigned int addSegment(const char * content, unsigned int length); //add a segment to the page, returns added bytes
       void sendTo(Socket::Connection & destination, int calcGranule = -2); //combines all data and sends it to socket
+      void ownSegments();//copies referenced data of all buffered segments
       unsigned int setNextSegmentTableEntry(unsigned int entrySize);//returns the size that could not be added to the table
       unsigned int overFlow();//returns the amount of bytes that don't fit in this page from the segments;
 
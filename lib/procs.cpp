@@ -19,7 +19,15 @@
 #include <pwd.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <poll.h>
 #include "timing.h"
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
+#endif
 
 std::set<pid_t> Util::Procs::plist;
 std::set<int> Util::Procs::socketList;
@@ -27,6 +35,21 @@ bool Util::Procs::handler_set = false;
 bool Util::Procs::thread_handler = false;
 tthread::mutex Util::Procs::plistMutex;
 tthread::thread * Util::Procs::reaper_thread = 0;
+std::map<pid_t, int> Util::Procs::pidFds;
+int Util::Procs::reapEpoll = -1;
+int Util::Procs::wakePipe[2] = {-1, -1};
+pid_t Util::Procs::reaperPid = 0;
+void (*Util::Procs::exitHandler)(pid_t, int) = 0;
+
+/// Returns a descriptor that becomes readable once the given process exits, or -1 if not supported.
+static int openPidfd(pid_t pid){
+#ifdef __linux__
+  return syscall(SYS_pidfd_open, pid, 0);
+#else
+  errno = ENOSYS;
+  return -1;
+#endif
+}
 
 
 /// Local-only function. Attempts to reap child and returns current running status.
@@ -34,18 +57,24 @@ bool Util::Procs::childRunning(pid_t p) {
   int status;
   pid_t ret = waitpid(p, &status, WNOHANG);
   if (ret == p) {
-    tthread::lock_guard<tthread::mutex> guard(plistMutex);
     int exitcode = -1;
     if (WIFEXITED(status)) {
       exitcode = WEXITSTATUS(status);
     } else if (WIFSIGNALED(status)) {
       exitcode = -WTERMSIG(status);
     }
-    if (plist.count(ret)) {
-      HIGH_MSG("Process %d fully terminated with code %d", ret, exitcode);
-      plist.erase(ret);
-    } else {
-      HIGH_MSG("Child process %d exited with code %d", ret, exitcode);
+    {
+      tthread::lock_guard<tthread::mutex> guard(plistMutex);
+      unwatch(ret);
+      if (plist.count(ret)) {
+        HIGH_MSG("Process %d fully terminated with code %d", ret, exitcode);
+        plist.erase(ret);
+      } else {
+        HIGH_MSG("Child process %d exited with code %d", ret, exitcode);
+      }
+    }
+    if (exitHandler) {
+      exitHandler(ret, exitcode);
     }
     return false;
   }
@@ -60,6 +89,63 @@ bool Util::Procs::isRunning(pid_t pid){
   return !kill(pid, 0);
 }
 
+/// Waits up to ms milliseconds for the given process to exit, returning as soon as it does.
+/// Does not reap the process. Without pidfd support, sleeps the full time and checks afterwards.
+/// \returns True if the process exited (or never existed), false if it is still running.
+bool Util::Procs::waitExit(pid_t pid, unsigned int ms){
+  int fd = openPidfd(pid);
+  if (fd == -1){
+    if (errno == ESRCH){return true;}
+    Util::wait(ms);
+    return !isRunning(pid);
+  }
+  struct pollfd pfd;
+  pfd.fd = fd;
+  pfd.events = POLLIN;
+  pfd.revents = 0;
+  int ret = poll(&pfd, 1, ms);
+  close(fd);
+  if (ret < 0){return !isRunning(pid);}
+  return ret > 0;
+}
+
+/// Sets a function that is called whenever a child process is reaped, with its PID and exit code.
+/// The exit code is negative when the process was killed by a signal.
+/// Called from the reaper thread, so it should not block.
+void Util::Procs::setExitHandler(void callback(pid_t pid, int exitCode)){
+  exitHandler = callback;
+}
+
+/// Starts watching the given child for exit from the reaper thread. Caller must hold plistMutex.
+void Util::Procs::watch(pid_t pid){
+#ifdef __linux__
+  if (reapEpoll == -1 || pidFds.count(pid)){return;}
+  int fd = openPidfd(pid);
+  if (fd == -1){return;}
+  struct epoll_event ev;
+  ev.events = EPOLLIN;
+  ev.data.u64 = pid;
+  if (epoll_ctl(reapEpoll, EPOLL_CTL_ADD, fd, &ev)){
+    close(fd);
+    return;
+  }
+  pidFds[pid] = fd;
+#endif
+}
+
+/// Stops watching the given child for exit. Caller must hold plistMutex.
+void Util::Procs::unwatch(pid_t pid){
+  std::map<pid_t, int>::iterator it = pidFds.find(pid);
+  if (it == pidFds.end()){return;}
+  close(it->second);
+  pidFds.erase(it);
+}
+
+/// Wakes up the reaper thread, if it is sleeping.
+void Util::Procs::wakeReaper(){
+  if (wakePipe[1] != -1 && write(wakePipe[1], "", 1) < 0){}
+}
+
 /// Called at exit of any program that used a Start* function.
 /// Waits up to 1 second, then sends SIGINT signal to all managed processes.
 /// After that waits up to 5 seconds for children to exit, then sends SIGKILL to
@@ -72,6 +158,7 @@ void Util::Procs::exit_handler() {
     listcopy = plist;
     thread_handler = false;
   }
+  wakeReaper();
   if (reaper_thread){
     reaper_thread->join();
     delete reaper_thread;
@@ -163,6 +250,35 @@ void Util::Procs::exit_handler() {
 void Util::Procs::setHandler() {
   tthread::lock_guard<tthread::mutex> guard(plistMutex);
   if (!handler_set) {
+    //Descriptors inherited from a parent process belong to the reaper thread over there
+    for (std::map<pid_t, int>::iterator it = pidFds.begin(); it != pidFds.end(); ++it){
+      close(it->second);
+    }
+    pidFds.clear();
+    if (reapEpoll != -1){
+      close(reapEpoll);
+      reapEpoll = -1;
+    }
+    if (wakePipe[0] != -1){
+      close(wakePipe[0]);
+      close(wakePipe[1]);
+      wakePipe[0] = wakePipe[1] = -1;
+    }
+#ifdef __linux__
+    if (!pipe2(wakePipe, O_CLOEXEC | O_NONBLOCK)){
+      reapEpoll = epoll_create1(EPOLL_CLOEXEC);
+      struct epoll_event ev;
+      ev.events = EPOLLIN;
+      ev.data.u64 = 0;
+      if (reapEpoll != -1 && epoll_ctl(reapEpoll, EPOLL_CTL_ADD, wakePipe[0], &ev)){
+        close(reapEpoll);
+        reapEpoll = -1;
+      }
+    }else{
+      wakePipe[0] = wakePipe[1] = -1;
+    }
+#endif
+    reaperPid = getpid();
     thread_handler = true;
     reaper_thread = new tthread::thread(grim_reaper, 0);
     struct sigaction new_action;
@@ -176,11 +292,13 @@ void Util::Procs::setHandler() {
 }
 
 ///Thread that loops until thread_handler is false.
-///Reaps available children and then sleeps for a second.
+///Reaps available children, then sleeps until the SIGCHLD handler or the pidfd of a started process wakes it up.
+///Falls back to checking every half second where epoll and pidfds are not available.
 ///Not done in signal handler so we can use a mutex to prevent race conditions.
 void Util::Procs::grim_reaper(void * n){
   VERYHIGH_MSG("Grim reaper start");
   while (thread_handler){
+    std::deque<std::pair<pid_t, int> > exits;
     {
       tthread::lock_guard<tthread::mutex> guard(plistMutex);
   int status;
@@ -201,22 +319,50 @@ void Util::Procs::grim_reaper(void * n){
     } else { // not possible
           break;
     }
+        unwatch(ret);
         if (plist.count(ret)) {
           HIGH_MSG("Process %d fully terminated with code %d", ret, exitcode);
     plist.erase(ret);
     } else {
           HIGH_MSG("Child process %d exited with code %d", ret, exitcode);
     }
+        if (exitHandler) {
+          exits.push_back(std::make_pair(ret, exitcode));
+        }
   }
 }
-    Util::sleep(500);
+    for (std::deque<std::pair<pid_t, int> >::iterator it = exits.begin(); it != exits.end(); ++it){
+      exitHandler(it->first, it->second);
+    }
+    if (reapEpoll == -1){
+      Util::sleep(500);
+      continue;
+    }
+#ifdef __linux__
+    struct epoll_event events[16];
+    int count = epoll_wait(reapEpoll, events, 16, 5000);
+    for (int i = 0; i < count; ++i){
+      if (!events[i].data.u64){
+        char buf[64];
+        while (read(wakePipe[0], buf, 64) > 0){}
+        continue;
+      }
+      //The process is reaped at the start of the next loop; stop watching it now in case it never is
+      tthread::lock_guard<tthread::mutex> guard(plistMutex);
+      unwatch(events[i].data.u64);
+    }
+#endif
   }
   VERYHIGH_MSG("Grim reaper stop");
 }
 
-/// Ignores everything. Separate thread handles waiting for children.
+/// Wakes up the reaper thread. Separate thread handles waiting for children.
 void Util::Procs::childsig_handler(int signum) {
-  return;
+  //Only wake our own reaper thread, not that of a parent we were forked from
+  if (wakePipe[1] == -1 || reaperPid != getpid()){return;}
+  int err = errno;
+  wakeReaper();
+  errno = err;
 }
 
 
@@ -226,7 +372,7 @@ std::string Util::Procs::getOutputOf(char * const * argv) {
   int fin = 0, fout = -1, ferr = 0;
   pid_t myProc = StartPiped(argv, &fin, &fout, &ferr);
   while (childRunning(myProc)) {
-    Util::sleep(100);
+    waitExit(myProc, 100);
   }
   FILE * outFile = fdopen(fout, "r");
   char * fileBuf = 0;
@@ -390,6 +536,7 @@ pid_t Util::Procs::StartPiped(const char * const * argv, int * fdin, int * fdout
     {
       tthread::lock_guard<tthread::mutex> guard(plistMutex);
     plist.insert(pid);
+      watch(pid);
     }
     DEBUG_MSG(DLVL_HIGH, "Piped process %s started, PID %d", argv[0], pid);
     if (devnull != -1) {
@@ -452,11 +599,150 @@ bool Util::Procs::isActive(pid_t name) {
 void Util::Procs::forget(pid_t pid) {
   tthread::lock_guard<tthread::mutex> guard(plistMutex);
   plist.erase(pid);
+  unwatch(pid);
 }
 
 /// Remember the given PID, killing it on shutdown.
 void Util::Procs::remember(pid_t pid) {
   tthread::lock_guard<tthread::mutex> guard(plistMutex);
   plist.insert(pid);
+  watch(pid);
 }
 
+
+/// Creates an empty watch list.
+Util::PidWatch::PidWatch() {
+#ifdef __linux__
+  epollFd = epoll_create1(EPOLL_CLOEXEC);
+#else
+  epollFd = -1;
+#endif
+  round = 0;
+}
+
+/// Copies start out with an empty watch list of their own.
+Util::PidWatch::PidWatch(const PidWatch & rhs) {
+#ifdef __linux__
+  epollFd = epoll_create1(EPOLL_CLOEXEC);
+#else
+  epollFd = -1;
+#endif
+  round = 0;
+}
+
+/// Keeps the watch list of this object, emptied.
+Util::PidWatch & Util::PidWatch::operator=(const PidWatch & rhs) {
+  clear();
+  return *this;
+}
+
+Util::PidWatch::~PidWatch() {
+  clear();
+  if (epollFd != -1) {
+    close(epollFd);
+  }
+}
+
+/// Stops watching all processes.
+void Util::PidWatch::clear() {
+  for (std::map<pid_t, watched>::iterator it = procs.begin(); it != procs.end(); ++it) {
+    if (it->second.fd != -1) {
+      close(it->second.fd);
+    }
+  }
+  procs.clear();
+}
+
+/// Collects the watched processes that exited since the previous call, in a single system call.
+/// Call once before a round of isRunning calls.
+void Util::PidWatch::update() {
+#ifdef __linux__
+  if (epollFd == -1) {
+    return;
+  }
+  struct epoll_event events[64];
+  int count;
+  do {
+    count = epoll_wait(epollFd, events, 64, 0);
+    for (int i = 0; i < count; ++i) {
+      std::map<pid_t, watched>::iterator it = procs.find(events[i].data.u64);
+      if (it != procs.end() && it->second.fd != -1) {
+        close(it->second.fd);
+        it->second.fd = -1;
+      }
+    }
+  } while (count == 64);
+#endif
+}
+
+/// Returns true if the process was running as of the last update() call, and starts watching it if needed.
+/// Only processes that are not watched yet cost a system call.
+bool Util::PidWatch::isRunning(pid_t pid) {
+  std::map<pid_t, watched>::iterator it = procs.find(pid);
+  if (it != procs.end()) {
+    it->second.round = round;
+    return it->second.fd != -1;
+  }
+#ifdef __linux__
+  //Every watched process costs a file descriptor; past the cap, don't eat into the limit the rest of the process needs
+  if (epollFd != -1 && procs.size() < PIDWATCH_MAX) {
+    int fd = openPidfd(pid);
+    watched & w = procs[pid];
+    w.fd = -1;
+    w.round = round;
+    if (fd == -1 && errno == ESRCH) {
+      return false;
+    }
+    if (fd != -1) {
+      struct pollfd pfd;
+      pfd.fd = fd;
+      pfd.events = POLLIN;
+      pfd.revents = 0;
+      //A process that already exited, but was not reaped yet, still has a PID
+      if (poll(&pfd, 1, 0) > 0) {
+        close(fd);
+        return false;
+      }
+      struct epoll_event ev;
+      ev.events = EPOLLIN;
+      ev.data.u64 = pid;
+      if (!epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev)) {
+        w.fd = fd;
+        return true;
+      }
+      close(fd);
+    }
+    procs.erase(pid);
+  }
+#endif
+  return Util::Procs::isRunning(pid);
+}
+
+/// Stops watching the given process, closing its pidfd. Call when the process is no longer of interest.
+void Util::PidWatch::forget(pid_t pid) {
+  std::map<pid_t, watched>::iterator it = procs.find(pid);
+  if (it == procs.end()) {
+    return;
+  }
+  if (it->second.fd != -1) {
+    close(it->second.fd);
+  }
+  procs.erase(it);
+}
+
+/// Stops watching processes that were not checked since the previous call.
+/// Call once after a round of isRunning calls.
+void Util::PidWatch::prune() {
+  std::map<pid_t, watched>::iterator it = procs.begin();
+  while (it != procs.end()) {
+    if (it->second.round == round) {
+      ++it;
+      continue;
+    }
+    if (it->second.fd != -1) {
+      close(it->second.fd);
+    }
+    procs.erase(it++);
+  }
+  ++round;
+}
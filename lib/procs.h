@@ -4,11 +4,14 @@
 #pragma once
 #include <unistd.h>
 #include <string>
+#include <map>
 #include <set>
 #include <vector>
 #include <deque>
 #include "tinythread.h"
 
+#define PIDWATCH_MAX 128 ///< Processes a PidWatch keeps a pidfd open for at most
+
 /// Contains utility code, not directly related to streaming media
 namespace Util {
 
@@ -23,11 +26,21 @@ namespace Util {
       static void runCmd(std::string & cmd);
       static char* const* dequeToArgv(std::deque<std::string> & argDeq);
       static void grim_reaper(void * n);
+      static void watch(pid_t pid);
+      static void unwatch(pid_t pid);
+      static void wakeReaper();
+      static std::map<pid_t, int> pidFds; ///< Exit notification descriptors of processes in plist, by PID.
+      static int reapEpoll; ///< Epoll instance the reaper thread sleeps on, -1 if unavailable.
+      static int wakePipe[2]; ///< Written to by the SIGCHLD handler to wake the reaper thread.
+      static pid_t reaperPid; ///< PID of the process the reaper thread runs in.
+      static void (*exitHandler)(pid_t, int);
     public:
       static bool childRunning(pid_t p);
       static tthread::thread * reaper_thread;
       static bool handler_set; ///< If true, the sigchld handler has been setup.
       static void setHandler();
+      static void setExitHandler(void callback(pid_t pid, int exitCode));
+      static bool waitExit(pid_t pid, unsigned int ms);
       static std::string getOutputOf(char * const * argv);
       static std::string getOutputOf(std::deque<std::string> & argDeq);
       static pid_t StartPiped(const char * const * argv, int * fdin, int * fdout, int * fderr);
@@ -42,5 +55,29 @@ namespace Util {
       static void remember(pid_t pid);
       static std::set<int> socketList; ///< Holds sockets that should be closed before forking
   };
+
+  /// Keeps track of processes that are not necessarily children of this one, such as shared memory clients.
+  /// Uses a pidfd per process and a single epoll instance, so checking many processes costs one system call.
+  /// Falls back to sending signal 0 where pidfds are not supported, and for processes past the first PIDWATCH_MAX.
+  class PidWatch {
+    public:
+      PidWatch();
+      PidWatch(const PidWatch & rhs);
+      PidWatch & operator=(const PidWatch & rhs);
+      ~PidWatch();
+      void update();
+      bool isRunning(pid_t pid);
+      void forget(pid_t pid);
+      void prune();
+    private:
+      struct watched {
+        int fd; ///< Becomes readable when the process exits, -1 once it did.
+        unsigned int round; ///< The last round in which the process was checked.
+      };
+      void clear();
+      int epollFd;
+      unsigned int round; ///< Incremented by every prune.
+      std::map<pid_t, watched> procs; ///< Watched processes, by PID.
+  };
 }
 
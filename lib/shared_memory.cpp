@@ -498,8 +498,37 @@ namespace IPC {
         mapped = 0;
         return;
       }
+#ifdef SHM_HUGEPAGES
+      //Large pages get mapped by many processes: back them with huge pages to save on TLB entries and faults
+      if (len >= SHM_HUGEPAGE_MIN && madvise(mapped, len, MADV_HUGEPAGE)) {
+        VERYHIGH_MSG("madvise(MADV_HUGEPAGE) for page %s failed: %s", name.c_str(), strerror(errno));
+      }
+#endif
+#endif
+    }
+  }
+
+  ///\brief Pre-faults the mapping of a shared page into this process' page tables.
+  ///
+  ///Avoids taking a separate minor fault for every 4KiB of the page while reading it later on.
+  ///Only use this for data that has actually been written: populating unwritten parts of a page allocates memory for them.
+  ///\param bytes The amount of bytes from the start of the page to populate, or 0 for the whole page
+  void sharedPage::populate(unsigned long long bytes) {
+    if (!mapped){return;}
+    if (!bytes || bytes > (unsigned long long)len){
+      bytes = len;
+    }
+#if !defined(__CYGWIN__) && !defined(_WIN32)
+#ifdef MADV_POPULATE_READ
+    if (!madvise(mapped, bytes, MADV_POPULATE_READ)){return;}
 #endif
+    //Older kernels: touch every page once
+    volatile char tmp;
+    for (unsigned long long i = 0; i < bytes; i += 4096){
+      tmp = mapped[i];
     }
+    (void)tmp;
+#endif
   }
 
 #endif
@@ -764,11 +793,84 @@ namespace IPC {
     mySemaphore->post();
   }
 
+  ///\brief Determines the layout of a sharedServer page: the header length and the amount of slots that fit.
+  ///The header consists of a 32-bit closing flag, followed by the slot bitmap in 32-bit words.
+  ///Both the server and the clients derive the layout from the page and slot size only, so they always agree.
+  ///\param pageLen The total size of the page
+  ///\param slotLen The size of a single slot, including the counter if any
+  ///\param headerLen Set to the offset of the first slot within the page
+  ///\return The amount of slots on the page
+  static unsigned int slotLayout(unsigned int pageLen, unsigned int slotLen, unsigned int & headerLen){
+    if (pageLen < 8 || !slotLen){
+      headerLen = pageLen;
+      return 0;
+    }
+    unsigned int slots = (unsigned long long)(pageLen - 4) * 8 / (slotLen * 8 + 1);
+    headerLen = 4 + ((slots + 31) / 32) * 4;
+    while (slots && headerLen + slots * slotLen > pageLen){
+      --slots;
+      headerLen = 4 + ((slots + 31) / 32) * 4;
+    }
+    return slots;
+  }
+
+  ///\brief Atomically claims the first free slot on a page by setting its bit in the page header.
+  ///Fails if the page is being closed by the server, releasing the claimed slot again.
+  ///\return The claimed slot number, or -1 if none could be claimed.
+  static int claimSlot(char * page, unsigned int slots){
+    volatile uint32_t * closing = (uint32_t *)page;
+    volatile uint32_t * bitmap = closing + 1;
+    if (*closing){return -1;}
+    for (unsigned int w = 0; w * 32 < slots; ++w){
+      uint32_t bits = bitmap[w];
+      while (~bits){
+        unsigned int bit = __builtin_ctz(~bits);
+        if (w * 32 + bit >= slots){break;}
+        if (__sync_bool_compare_and_swap(bitmap + w, bits, bits | (1u << bit))){
+          //The server sets the closing flag before checking the bitmap, so one of us is guaranteed to notice the other
+          if (*closing){
+            __sync_fetch_and_and(bitmap + w, ~(1u << bit));
+            return -1;
+          }
+          return w * 32 + bit;
+        }
+        bits = bitmap[w];
+      }
+    }
+    return -1;
+  }
+
+  ///\brief Atomically releases a slot claimed by claimSlot. The slot contents must already be cleared.
+  static void releaseSlot(char * page, unsigned int slot){
+    __sync_fetch_and_and((uint32_t *)page + 1 + slot / 32, ~(1u << (slot % 32)));
+  }
+
+  ///\brief Closes a sharedServer page left behind by a crashed server to new clients, and asks all clients on it to disconnect.
+  ///\param page The mapped page
+  ///\param pageLen The size of the page
+  ///\param len The length of the payload, as given to the server
+  void sharedServer::disconnectAll(char * page, unsigned int pageLen, int len){
+    unsigned int headerLen;
+    unsigned int slots = slotLayout(pageLen, len + 1, headerLen);
+    __sync_fetch_and_or((uint32_t *)page, 1);
+    volatile uint32_t * bitmap = (uint32_t *)page + 1;
+    for (unsigned int w = 0; w * 32 < slots; ++w){
+      uint32_t bits = bitmap[w];
+      if ((w + 1) * 32 > slots){bits &= (1u << (slots % 32)) - 1;}
+      while (bits){
+        unsigned int slot = w * 32 + __builtin_ctz(bits);
+        bits &= bits - 1;
+        page[headerLen + slot * (len + 1)] = 0xFF;//disconnect request, seen by sharedClient::isAlive
+      }
+    }
+  }
+
   ///\brief Default constructor, erases all the values
   sharedServer::sharedServer() {
     payLen = 0;
     hasCounter = false;
     amount = 0;
+    connectedUsers = 0;
   }
 
   ///\brief Desired constructor, initializes after cleaning.
@@ -776,7 +878,8 @@ namespace IPC {
   ///\param len The lenght of the payload
   ///\param withCounter Whether the content should have a counter
   sharedServer::sharedServer(std::string name, int len, bool withCounter) {
-    sharedServer();
+    amount = 0;
+    connectedUsers = 0;
     init(name, len, withCounter);
   }
 
@@ -785,38 +888,16 @@ namespace IPC {
   ///\param len The lenght of the payload
   ///\param withCounter Whether the content should have a counter
   void sharedServer::init(std::string name, int len, bool withCounter) {
-    if (mySemaphore) {
-      mySemaphore.close();
-    }
-    if (baseName != "") {
-      mySemaphore.unlink();
-    }
     myPages.clear();
     baseName = "/" + name;
     payLen = len;
     hasCounter = withCounter;
-    mySemaphore.open(baseName.c_str(), O_CREAT | O_EXCL | O_RDWR, ACCESSPERMS, 1);
-    if (!mySemaphore) {
-      mySemaphore.open(baseName.c_str(), O_CREAT | O_RDWR, ACCESSPERMS, 1);
-    }
-    if (!mySemaphore) {
-      DEBUG_MSG(DLVL_FAIL, "Creating semaphore failed: %s", strerror(errno));
-      return;
-    }
-    if (!mySemaphore.tryWaitOneSecond()){
-      WARN_MSG("Force unlocking sharedServer semaphore to prevent deadlock");
-    }
-    mySemaphore.post();
-    semGuard tmpGuard(&mySemaphore);
     amount = 0;
     newPage();
   }
 
   ///\brief The deconstructor
-  sharedServer::~sharedServer() {
-    mySemaphore.close();
-    mySemaphore.unlink();
-  }
+  sharedServer::~sharedServer() {}
 
   ///\brief Determines whether a sharedServer is valid
   sharedServer::operator bool() const {
@@ -834,6 +915,7 @@ namespace IPC {
   }
 
   ///\brief Creates the next page with the correct size
+  ///If the page already exists (left behind by a previous server), it is taken over as-is.
   void sharedServer::newPage() {
     sharedPage tmp(std::string(baseName.substr(1) + (char)(myPages.size() + (int)'A')), std::min(((8192 * 2) << myPages.size()), (32 * 1024 * 1024)), false, false);
     if (!tmp.mapped){
@@ -842,47 +924,33 @@ namespace IPC {
     }
     myPages.push_back(tmp);
     myPages.back().master = true;
+    if (myPages.back().mapped){
+      //Reopen the page for new clients, in case we closed it earlier without removing it
+      __sync_fetch_and_and((uint32_t *)myPages.back().mapped, 0);
+    }
     VERYHIGH_MSG("Created a new page: %s", tmp.name.c_str());
-    amount += (32 * 1024 * 1024)*myPages.size();//assume maximum load - we don't want to miss any entries
   }
 
-  ///\brief Deletes the highest allocated page
+  ///\brief Deletes the highest allocated page, if no client holds a slot on it.
   void sharedServer::deletePage() {
     if (myPages.size() == 1) {
       DEBUG_MSG(DLVL_WARN, "Can't remove last page for %s", baseName.c_str());
       return;
     }
-    myPages.pop_back();
-  }
-
-  ///\brief Determines whether an id is currently in use or not
-  bool sharedServer::isInUse(unsigned int id) {
-    unsigned int i = 0;
-    for (std::deque<sharedPage>::iterator it = myPages.begin(); it != myPages.end(); it++) {
-      //return if we reached the end
-      if (!it->mapped || !it->len) {
-        return false;
-      }
-      //not on this page? skip to next.
-      if (it->len < (id - i)*payLen) {
-        i += it->len / payLen;
-        continue;
-      }
-      if (hasCounter) {
-        //counter? return true if it is non-zero.
-        return (it->mapped[(id - i) * payLen] != 0);
-      } else {
-        //no counter - check the entire size for being all zeroes.
-        for (unsigned int j = 0; j < payLen; ++j) {
-          if (it->mapped[(id - i)*payLen + j]) {
-            return true;
-          }
+    sharedPage & lastPage = myPages.back();
+    if (lastPage.mapped){
+      unsigned int headerLen;
+      unsigned int slots = slotLayout(lastPage.len, payLen + (hasCounter ? 1 : 0), headerLen);
+      //Close the page to new clients first, then check that none got in before that
+      __sync_fetch_and_or((uint32_t *)lastPage.mapped, 1);
+      for (unsigned int w = 0; w * 32 < slots; ++w){
+        if (((volatile uint32_t *)lastPage.mapped)[1 + w]){
+          __sync_fetch_and_and((uint32_t *)lastPage.mapped, 0);
+          return;
         }
-        return false;
       }
     }
-    //only happens if we run out of pages
-    return false;
+    myPages.pop_back();
   }
 
   ///Disconnect all connected users, waits at most 2.5 seconds until completed
@@ -900,168 +968,147 @@ namespace IPC {
   ///Returns a pointer to the data for the given index.
   ///Returns null on error or if index is empty.
   char * sharedServer::getIndex(unsigned int requestId){
-    char * empty = 0;
-    if (!hasCounter) {
-      empty = (char *)malloc(payLen * sizeof(char));
-      memset(empty, 0, payLen);
-    }
+    unsigned int slotLen = payLen + (hasCounter ? 1 : 0);
     unsigned int id = 0;
     for (std::deque<sharedPage>::iterator it = myPages.begin(); it != myPages.end(); it++) {
       if (!it->mapped || !it->len) {
         DEBUG_MSG(DLVL_FAIL, "Something went terribly wrong?");
         return 0;
       }
-      unsigned int offset = 0;
-      while (offset + payLen + (hasCounter ? 1 : 0) <= it->len) {
-        if (id == requestId){
-          if (hasCounter) {
-            if (it->mapped[offset] != 0) {
-              return it->mapped + offset + 1;
-            }else{
-              return 0;
-            }
-          } else {
-            if (memcmp(empty, it->mapped + offset, payLen)) {
-              return it->mapped + offset;
-            }else{
-              return 0;
-            }
-          }
-        }
-        offset += payLen + (hasCounter ? 1 : 0);
-        id ++;
+      unsigned int headerLen;
+      unsigned int slots = slotLayout(it->len, slotLen, headerLen);
+      if (requestId >= id + slots){
+        id += slots;
+        continue;
+      }
+      unsigned int slot = requestId - id;
+      if (!(((uint32_t *)it->mapped)[1 + slot / 32] & (1u << (slot % 32)))){return 0;}
+      char * data = it->mapped + headerLen + slot * slotLen;
+      if (hasCounter){
+        return (*data != 0) ? data + 1 : 0;
       }
+      return data;
     }
     return 0;
   }
 
-  ///\brief Parse each of the possible payload pieces, and runs a callback on it if in use.
+  ///\brief Parse each of the claimed payload pieces, and runs a callback on it if in use.
+  ///Only slots that have their bit set in the page header are visited, whole words of free slots are skipped at once.
   void sharedServer::parseEach(void (*activeCallback)(char * data, size_t len, unsigned int id), void (*disconCallback)(char * data, size_t len, unsigned int id)) {
-    char * empty = 0;
-    if (!hasCounter) {
-      empty = (char *)malloc(payLen * sizeof(char));
-      memset(empty, 0, payLen);
-    }
+    unsigned int slotLen = payLen + (hasCounter ? 1 : 0);
     unsigned int id = 0;
     unsigned int userCount = 0;
     unsigned int emptyCount = 0;
-    unsigned int lastFilled = 0;
+    unsigned int newAmount = 0;
     connectedUsers = 0;
+    pidWatch.update();
     for (std::deque<sharedPage>::iterator it = myPages.begin(); it != myPages.end(); it++) {
       if (!it->mapped || !it->len) {
         DEBUG_MSG(DLVL_FAIL, "Something went terribly wrong?");
         break;
       }
       userCount = 0;
-      unsigned int offset = 0;
-      while (offset + payLen + (hasCounter ? 1 : 0) <= it->len) {
-        if (hasCounter) {
-          if (it->mapped[offset] != 0) {
-            char * counter = it->mapped + offset;
-            //increase the count if needed
+      unsigned int headerLen;
+      unsigned int slots = slotLayout(it->len, slotLen, headerLen);
+      volatile uint32_t * bitmap = (uint32_t *)it->mapped + 1;
+      for (unsigned int w = 0; w * 32 < slots; ++w){
+        uint32_t bits = bitmap[w];
+        //Bits past the last slot are never claimed, but may be set by a page wiped with junk
+        if ((w + 1) * 32 > slots){bits &= (1u << (slots % 32)) - 1;}
+        while (bits){
+          unsigned int slot = w * 32 + __builtin_ctz(bits);
+          bits &= bits - 1;
+          unsigned int slotId = id + slot;
+          char * slotData = it->mapped + headerLen + slot * slotLen;
+          if (!hasCounter) {
             ++userCount;
-            if (*counter & 0x80){
-              connectedUsers++;
-            }
-            char countNum = (*counter) & 0x7F;
-            lastFilled = id;
-            if (id >= amount) {
-              amount = id + 1;
-              VERYHIGH_MSG("Shared memory %s is now at count %u", baseName.c_str(), amount);
-            }
-            uint32_t tmpPID = *((uint32_t *)(it->mapped + 1 + offset + payLen - 4));
-            if (tmpPID > 1 && it->master && !Util::Procs::isRunning(tmpPID) && !(countNum == 126 || countNum == 127)){
-              WARN_MSG("process disappeared, timing out. (pid %lu)", tmpPID);
-              *counter = 125 | (0x80 & (*counter)); //if process is already dead, instant timeout.
+            newAmount = slotId + 1;
+            activeCallback(slotData, payLen, slotId);
+            continue;
+          }
+          //A claimed slot without counter is still being set up by its client
+          if (*slotData == 0){
+            //Clients write their PID and counter right after claiming, so if that doesn't happen they died in between
+            uint32_t setupPID = *((uint32_t *)(slotData + 1 + payLen - 4));
+            uint64_t now = Util::bootSecs();
+            if (!settingUp.count(slotId)){settingUp[slotId] = now;}
+            if ((setupPID > 1 && it->master && !pidWatch.isRunning(setupPID)) || now - settingUp[slotId] > 10){
+              WARN_MSG("Client %u never finished registering, releasing its slot", slotId);
+              settingUp.erase(slotId);
+              if (setupPID > 1){pidWatch.forget(setupPID);}
+              memset(slotData, 0, slotLen);
+              releaseSlot(it->mapped, slot);
+              continue;
             }
-            activeCallback(it->mapped + offset + 1, payLen, id);
-            switch (countNum) {
-              case 127:
-                HIGH_MSG("Client %u requested disconnect", id);
-                break;
-              case 126:
-                HIGH_MSG("Client %u timed out", id);
-                break;
-              default:
+            ++userCount;
+            newAmount = slotId + 1;
+            continue;
+          }
+          if (settingUp.size()){settingUp.erase(slotId);}
+          char * counter = slotData;
+          //increase the count if needed
+          ++userCount;
+          if (*counter & 0x80){
+            connectedUsers++;
+          }
+          char countNum = (*counter) & 0x7F;
+          newAmount = slotId + 1;
+          uint32_t tmpPID = *((uint32_t *)(counter + 1 + payLen - 4));
+          if (tmpPID > 1 && it->master && !pidWatch.isRunning(tmpPID) && !(countNum == 126 || countNum == 127)){
+            WARN_MSG("process disappeared, timing out. (pid %lu)", tmpPID);
+            *counter = 125 | (0x80 & (*counter)); //if process is already dead, instant timeout.
+          }
+          activeCallback(counter + 1, payLen, slotId);
+          switch (countNum) {
+            case 127:
+              HIGH_MSG("Client %u requested disconnect", slotId);
+              break;
+            case 126:
+              HIGH_MSG("Client %u timed out", slotId);
+              break;
+            default:
 #ifndef NOCRASHCHECK
-                if (tmpPID > 1 && it->master) {
-                  if (countNum > 10 && countNum < 60) {
-                    if (countNum < 30) {
-                      if (countNum > 15) {
-                        WARN_MSG("Process %d is unresponsive", tmpPID);
-                      }
-                      Util::Procs::Stop(tmpPID); //soft kill
-                    } else {
-                      ERROR_MSG("Killing unresponsive process %d", tmpPID);
-                      Util::Procs::Murder(tmpPID); //improved kill
+              if (tmpPID > 1 && it->master) {
+                if (countNum > 10 && countNum < 60) {
+                  if (countNum < 30) {
+                    if (countNum > 15) {
+                      WARN_MSG("Process %d is unresponsive", tmpPID);
                     }
+                    Util::Procs::Stop(tmpPID); //soft kill
+                  } else {
+                    ERROR_MSG("Killing unresponsive process %d", tmpPID);
+                    Util::Procs::Murder(tmpPID); //improved kill
                   }
-                  if (countNum > 70) {
-                    if (countNum < 90) {
-                      if (countNum > 75) {
-                        WARN_MSG("Stopping process %d is unresponsive", tmpPID);
-                      }
-                      Util::Procs::Stop(tmpPID); //soft kill
-                    } else {
-                      ERROR_MSG("Killing unresponsive stopping process %d", tmpPID);
-                      Util::Procs::Murder(tmpPID); //improved kill
+                }
+                if (countNum > 70) {
+                  if (countNum < 90) {
+                    if (countNum > 75) {
+                      WARN_MSG("Stopping process %d is unresponsive", tmpPID);
                     }
+                    Util::Procs::Stop(tmpPID); //soft kill
+                  } else {
+                    ERROR_MSG("Killing unresponsive stopping process %d", tmpPID);
+                    Util::Procs::Murder(tmpPID); //improved kill
                   }
                 }
-#endif
-                break;
-            }
-            if (countNum == 127 || countNum == 126){
-              semGuard tmpGuard(&mySemaphore);
-              if (disconCallback){
-                disconCallback(counter + 1, payLen, id);
               }
-              memset(counter + 1, 0, payLen);
-              *counter = 0;
-            } else {
-              ++(*counter);
-            }
-          } else {
-            //stop if we're past the amount counted and we're empty
-            if (id >= amount) {
-              //bring the counter down if this was the last element
-              if (lastFilled+1 < amount) {
-                amount = lastFilled+1;
-                VERYHIGH_MSG("Shared memory %s is now at count %u", baseName.c_str(), amount);
-              }
-              //stop, we're guaranteed no more pages are full at this point
+#endif
               break;
-            }
           }
-        } else {
-          if (memcmp(empty, it->mapped + offset, payLen)) {
-            ++userCount;
-            //increase the count if needed
-            lastFilled = id;
-            if (id >= amount) {
-              amount = id + 1;
-              VERYHIGH_MSG("Shared memory %s is now at count %u", baseName.c_str(), amount);
+          if (countNum == 127 || countNum == 126){
+            if (disconCallback){
+              disconCallback(counter + 1, payLen, slotId);
             }
-            activeCallback(it->mapped + offset, payLen, id);
+            if (tmpPID > 1){pidWatch.forget(tmpPID);}
+            memset(counter + 1, 0, payLen);
+            *counter = 0;
+            releaseSlot(it->mapped, slot);
           } else {
-            //stop if we're past the amount counted and we're empty
-            if (id >= amount) {
-              //bring the counter down if this was the last element
-              if (lastFilled+1 < amount) {
-                amount = lastFilled+1;
-                VERYHIGH_MSG("Shared memory %s is now at count %u", baseName.c_str(), amount);
-              }
-              //stop, we're guaranteed no more pages are full at this point
-              if (empty) {
-                free(empty);
-              }
-              break;
-            }
+            ++(*counter);
           }
         }
-        offset += payLen + (hasCounter ? 1 : 0);
-        id ++;
       }
+      id += slots;
       if (userCount == 0) {
         ++emptyCount;
       } else {
@@ -1069,7 +1116,6 @@ namespace IPC {
         std::deque<sharedPage>::iterator tIt = it;
         if (++tIt == myPages.end()){
           bool unsetMaster = !(it->master);
-          semGuard tmpGuard(&mySemaphore);
           newPage();
           if (unsetMaster){
             (myPages.end()-1)->master = false;
@@ -1078,15 +1124,15 @@ namespace IPC {
         }
       }
     }
+    pidWatch.prune();
+    if (newAmount != amount){
+      amount = newAmount;
+      VERYHIGH_MSG("Shared memory %s is now at count %u", baseName.c_str(), amount);
+    }
 
     if (emptyCount > 1) {
-      semGuard tmpGuard(&mySemaphore);
       deletePage();
     }
-
-    if (empty) {
-      free(empty);
-    }
   }
 
   ///\brief Creates an empty shared client
@@ -1105,16 +1151,6 @@ namespace IPC {
     baseName = rhs.baseName;
     payLen = rhs.payLen;
     hasCounter = rhs.hasCounter;
-#ifdef __APPLE__
-    //note: O_CREAT is only needed for mac, probably
-    mySemaphore.open(baseName.c_str(), O_RDWR | O_CREAT, 0);
-#else
-    mySemaphore.open(baseName.c_str(), O_RDWR);
-#endif
-    if (!mySemaphore) {
-      DEBUG_MSG(DLVL_FAIL, "Creating semaphore failed: %s", strerror(errno));
-      return;
-    }
     myPage.init(rhs.myPage.name, rhs.myPage.len, rhs.myPage.master);
     offsetOnPage = rhs.offsetOnPage;
   }
@@ -1125,16 +1161,6 @@ namespace IPC {
     baseName = rhs.baseName;
     payLen = rhs.payLen;
     hasCounter = rhs.hasCounter;
-#ifdef __APPLE__
-    //note: O_CREAT is only needed for mac, probably
-    mySemaphore.open(baseName.c_str(), O_RDWR | O_CREAT, 0);
-#else
-    mySemaphore.open(baseName.c_str(), O_RDWR);
-#endif
-    if (!mySemaphore) {
-      DEBUG_MSG(DLVL_FAIL, "Creating copy of semaphore %s failed: %s", baseName.c_str(), strerror(errno));
-      return;
-    }
     myPage.init(rhs.myPage.name, rhs.myPage.len, rhs.myPage.master);
     offsetOnPage = rhs.offsetOnPage;
   }
@@ -1145,72 +1171,40 @@ namespace IPC {
   ///\param withCounter Whether or not this payload has a counter
   sharedClient::sharedClient(std::string name, int len, bool withCounter) : baseName("/" + name), payLen(len), offsetOnPage(-1), hasCounter(withCounter) {
     countAsViewer = true;
-#ifdef __APPLE__
-    //note: O_CREAT is only needed for mac, probably
-    mySemaphore.open(baseName.c_str(), O_RDWR | O_CREAT, 0);
-#else
-    mySemaphore.open(baseName.c_str(), O_RDWR);
-#endif
-    if (!mySemaphore) {
-      DEBUG_MSG(DLVL_FAIL, "Creating semaphore %s failed: %s", baseName.c_str(), strerror(errno));
-      return;
-    }
-    //Empty is used to compare for emptyness. This is not needed when the page uses a counter
-    char * empty = 0;
-    if (!hasCounter) {
-      empty = (char *)malloc(payLen * sizeof(char));
-      if (!empty) {
-        DEBUG_MSG(DLVL_FAIL, "Failed to allocate %u bytes for empty payload!", payLen);
-        return;
-      }
-      memset(empty, 0, payLen);
-    }
+    unsigned int slotLen = payLen + (hasCounter ? 1 : 0);
+    //Slots are freed and pages added by the server, so retry often while it catches up, for up to 10 seconds
     uint32_t attempts = 0;
-    while (offsetOnPage == -1 && (++attempts) < 20) {
+    while (offsetOnPage == -1 && (++attempts) < 200) {
       for (char i = 'A'; i <= 'Z'; i++) {
         myPage.init(baseName.substr(1) + i, (4096 << (i - 'A')), false, false);
         if (!myPage.mapped) {
           break;
         }
-        int offset = 0;
-        while (offset + payLen + (hasCounter ? 1 : 0) <= myPage.len) {
-          if ((hasCounter && myPage.mapped[offset] == 0) || (!hasCounter && !memcmp(myPage.mapped + offset, empty, payLen))) {
-            semGuard tmpGuard(&mySemaphore);
-            if ((hasCounter && myPage.mapped[offset] == 0) || (!hasCounter && !memcmp(myPage.mapped + offset, empty, payLen))) {
-              offsetOnPage = offset;
-              if (hasCounter) {
-                myPage.mapped[offset] = 1;
-                *((uint32_t *)(myPage.mapped + 1 + offset + len - 4)) = getpid();
-                HIGH_MSG("sharedClient received ID %d", offsetOnPage/(payLen+1));
-              }
-              break;
-            }
-          }
-          offset += payLen + (hasCounter ? 1 : 0);
+        unsigned int headerLen;
+        int slot = claimSlot(myPage.mapped, slotLayout(myPage.len, slotLen, headerLen));
+        if (slot == -1){
+          continue;
         }
-        if (offsetOnPage != -1) {
-          break;
+        offsetOnPage = headerLen + slot * slotLen;
+        if (hasCounter) {
+          *((uint32_t *)(myPage.mapped + 1 + offsetOnPage + len - 4)) = getpid();
+          myPage.mapped[offsetOnPage] = 1;
+          HIGH_MSG("sharedClient received ID %d", slot);
         }
+        break;
       }
       if (offsetOnPage == -1) {
-        Util::wait(500);
+        Util::wait(50);
       }
     }
     if (offsetOnPage == -1){
       FAIL_MSG("Could not register on page for %s", baseName.c_str());
       myPage.close();
     }
-    if (empty) {
-      free(empty);
-    }
   }
 
   ///\brief The deconstructor
-  sharedClient::~sharedClient() {
-    mySemaphore.close();
-
-
-  }
+  sharedClient::~sharedClient() {}
 
   ///\brief Writes data to the shared data
   void sharedClient::write(char * data, int len) {
@@ -1221,18 +1215,21 @@ namespace IPC {
   }
 
   ///\brief Indicate that the process is done using this piece of memory, set the counter to finished
+  ///Without counter, nobody else would notice the client is gone, so the slot is released right away.
   void sharedClient::finish() {
     if (!myPage.mapped) {
       return;
     }
     if (!hasCounter) {
-      DEBUG_MSG(DLVL_WARN, "Trying to time-out an element without counters");
+      unsigned int headerLen;
+      slotLayout(myPage.len, payLen, headerLen);
+      memset(myPage.mapped + offsetOnPage, 0, payLen);
+      releaseSlot(myPage.mapped, (offsetOnPage - headerLen) / payLen);
       myPage.close();
       return;
     }
-    semGuard tmpGuard(&mySemaphore);
     myPage.mapped[offsetOnPage] = 126 | (countAsViewer?0x80:0);
-    HIGH_MSG("sharedClient finished ID %d", offsetOnPage/(payLen+1));
+    HIGH_MSG("sharedClient finished offset %d", offsetOnPage);
     myPage.close();
   }
 
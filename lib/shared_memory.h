@@ -1,9 +1,11 @@
 #pragma once
 #include <string>
+#include <map>
 #include <set>
 
 #include "timing.h"
 #include "defines.h"
+#include "procs.h"
 
 #if defined(__CYGWIN__) || defined(_WIN32)
 #include <windows.h>
@@ -145,6 +147,7 @@ namespace IPC {
     void unmap();
     void close();
     bool exists();
+    void populate(unsigned long long bytes = 0);
     #if defined(__CYGWIN__) || defined(_WIN32)
     ///\brief The handle of the opened shared memory page
     HANDLE handle;
@@ -177,10 +180,11 @@ namespace IPC {
   ///The server manages the shared memory pages, and allocates new pages when needed.
   ///
   ///Pages are created with a basename + index, where index is in the range of 'A' - 'Z'
-  ///Each time a page is nearly full, the next page is created with a size double to the previous one.
+  ///Each time a page is in use, the next page is created with a size double to the previous one.
   ///
-  ///Clients should allocate payLen bytes at a time, possibly with the addition of a counter.
-  ///If no such length can be allocated, the next page should be tried, and so on.
+  ///Every page starts with a header holding a closing flag and a bitmap with one bit per slot, followed by the slots.
+  ///Clients claim a slot by atomically setting its bit, so no lock is needed to connect.
+  ///The server only parses slots that have their bit set, and clears the bit once a slot is freed.
   class sharedServer {
     public:
       sharedServer();
@@ -195,8 +199,8 @@ namespace IPC {
       unsigned int connectedUsers;
       void finishEach();
       void abandon();
+      static void disconnectAll(char * page, unsigned int pageLen, int len);
     private:
-      bool isInUse(unsigned int id);
       void newPage();
       void deletePage();
       ///\brief The basename of the shared pages.
@@ -205,10 +209,12 @@ namespace IPC {
       unsigned int payLen;
       ///\brief The set of sharedPage structures to manage the actual memory
       std::deque<sharedPage> myPages;
-      ///\brief A semaphore that is locked upon creation and deletion of the page, to ensure no new data is allocated during this step.
-      semaphore mySemaphore;
       ///\brief Whether the payload has a counter, if so, it is added in front of the payload
       bool hasCounter;
+      ///\brief Notices clients that disappeared without checking every process on every parse
+      Util::PidWatch pidWatch;
+      ///\brief Since when claimed slots have been waiting for their client to write its counter, by slot ID
+      std::map<unsigned int, uint64_t> settingUp;
   };
 
   ///\brief The client part of a server/client model for shared memory.
@@ -216,10 +222,10 @@ namespace IPC {
   ///The server manages the shared memory pages, and allocates new pages when needed.
   ///
   ///Pages are created with a basename + index, where index is in the range of 'A' - 'Z'
-  ///Each time a page is nearly full, the next page is created with a size double to the previous one.
+  ///Each time a page is in use, the next page is created with a size double to the previous one.
   ///
-  ///Clients should allocate payLen bytes at a time, possibly with the addition of a counter.
-  ///If no such length can be allocated, the next page should be tried, and so on.
+  ///Clients claim a free slot in the first page that has one, by atomically setting its bit in the page header.
+  ///If no slot is free on any page, the client retries a few times while the server adds pages.
   class sharedClient {
     public:
       sharedClient();
@@ -239,8 +245,6 @@ namespace IPC {
       std::string baseName;
       ///\brief The shared page this client has reserved a space on.
       sharedPage myPage;
-      ///\brief A semaphore that is locked upon trying to allocate space on a page
-      semaphore mySemaphore;
       ///\brief The size in bytes of the opened page
       int payLen;
       ///\brief The offset of the payload reserved for this client within the opened page
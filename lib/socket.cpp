@@ -5,7 +5,9 @@
 #include "socket.h"
 #include "defines.h"
 #include "timing.h"
+#include <algorithm>
 #include <cstdlib>
+#include <cstring>
 #include <netdb.h>
 #include <netinet/in.h>
 #include <poll.h>
@@ -248,14 +250,6 @@ void Socket::Buffer::append(const std::string &newdata){
   append(newdata.data(), newdata.size());
 }
 
-///Helper function that does a short-circuiting string compare
-inline bool string_compare(const char *a, const char *b, const size_t len){
-  for (size_t i = 0; i < len; ++i){
-    if (a[i] != b[i]){return false;}
-  }
-  return true;
-}
-
 /// Appends this data block to the internal std::deque of std::string objects.
 /// It is automatically split every BUFFER_BLOCKSIZE bytes and when the splitter string is encountered.
 void Socket::Buffer::append(const char *newdata, const unsigned int newdatasize){
@@ -269,12 +263,9 @@ void Socket::Buffer::append(const char *newdata, const unsigned int newdatasize)
         j = newdatasize - i;
       }
     }else{
-      while (j+i < newdatasize && j < BUFFER_BLOCKSIZE){
-        j++;
-        if (j >= splitter.size()){
-          if (string_compare(newdata+i+j-splitter.size(), splitter.data(), splitter.size())){break;}
-        }
-      }
+      uint32_t maxLen = std::min((uint32_t)(newdatasize - i), (uint32_t)BUFFER_BLOCKSIZE);
+      const char * found = (const char *)memmem(newdata + i, maxLen, splitter.data(), splitter.size());
+      j = (found ? (found - (newdata + i)) + splitter.size() : maxLen);
     }
     if (j){
       data.push_front("");
@@ -676,6 +667,45 @@ void Socket::Connection::SendNow(const std::string &data){
   SendNow(data.data(), data.size());
 }
 
+/// Will not buffer anything but always send right away. Blocks.
+/// Sends all count buffers in vec, in order, using as few system calls as possible.
+/// Any data that could not be send will block until it can be send or the connection is severed.
+void Socket::Connection::SendNow(const struct iovec *vec, size_t count){
+  bool bing = isBlocking();
+  if (!bing){setBlocking(true);}
+  size_t idx = 0;
+  size_t done = 0; ///< Bytes of vec[idx] already sent
+  while (idx < count && connected()){
+    //Build the next batch, starting with whatever is left of the current buffer
+    struct iovec batch[64];
+    int batchCount = 0;
+    for (size_t i = idx; i < count && batchCount < 64; ++i){
+      batch[batchCount].iov_base = (char *)vec[i].iov_base + (i == idx ? done : 0);
+      batch[batchCount].iov_len = vec[i].iov_len - (i == idx ? done : 0);
+      if (batch[batchCount].iov_len){++batchCount;}
+    }
+    if (!batchCount){break;}
+    size_t sent = iwritev(batch, batchCount);
+    //Advance past everything that was sent
+    while (sent && idx < count){
+      size_t left = vec[idx].iov_len - done;
+      if (sent < left){
+        done += sent;
+        sent = 0;
+      }else{
+        sent -= left;
+        ++idx;
+        done = 0;
+      }
+    }
+    while (idx < count && vec[idx].iov_len == done){
+      ++idx;
+      done = 0;
+    }
+  }
+  if (!bing){setBlocking(false);}
+}
+
 void Socket::Connection::skipBytes(uint32_t byteCount){
   INFO_MSG("Skipping first %lu bytes going to socket", byteCount);
   skipCount = byteCount;
@@ -725,6 +755,32 @@ unsigned int Socket::Connection::iwrite(const void *buffer, int len){
   return r;
 }// Socket::Connection::iwrite
 
+/// Incremental gather write call. Tries to write all count buffers in vec to the socket, in order,
+/// returning the amount of bytes it actually wrote.
+/// Falls back to writing only the first buffer for pipes and when bytes are being skipped.
+unsigned int Socket::Connection::iwritev(const struct iovec *vec, int count){
+  if (!connected() || count < 1){return 0;}
+  if (skipCount || sock < 0 || count == 1){return iwrite(vec[0].iov_base, vec[0].iov_len);}
+  int r = writev(sock, vec, count);
+  if (r < 0){
+    switch (errno){
+    case EWOULDBLOCK: return 0; break;
+    default:
+      Error = true;
+      INSANE_MSG("Could not iwritev data! Error: %s", strerror(errno));
+      close();
+      return 0;
+      break;
+    }
+  }
+  if (r == 0){
+    DONTEVEN_MSG("Socket closed by remote");
+    close();
+  }
+  up += r;
+  return r;
+}
+
 /// Incremental read call. This function tries to read len bytes to the buffer from the socket,
 /// returning the amount of bytes it actually read.
 /// \param buffer Location of the buffer to read to.
@@ -1033,6 +1089,12 @@ unsigned int Socket::SSLConnection::iwrite(const void *buffer, int len){
   return r;
 }
 
+/// Incremental gather write call. Encrypts and writes only the first buffer, as mbedtls has no gather write.
+unsigned int Socket::SSLConnection::iwritev(const struct iovec *vec, int count){
+  if (count < 1){return 0;}
+  return iwrite(vec[0].iov_base, vec[0].iov_len);
+}
+
 bool Socket::SSLConnection::connected() const{
   return isConnected;
 }
@@ -14,6 +14,7 @@
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <sys/un.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 #ifdef SSL
@@ -78,6 +79,7 @@ namespace Socket{
     Buffer downbuffer;                                ///< Stores temporary data coming in.
     virtual int iread(void *buffer, int len, int flags = 0);  ///< Incremental read call.
     virtual unsigned int iwrite(const void *buffer, int len); ///< Incremental write call.
+    virtual unsigned int iwritev(const struct iovec *vec, int count); ///< Incremental gather write call.
     bool iread(Buffer &buffer, int flags = 0);        ///< Incremental write call that is compatible with Socket::Buffer.
     bool iwrite(std::string &buffer);                 ///< Write call that is compatible with std::string.
   public:
@@ -110,6 +112,7 @@ namespace Socket{
     void SendNow(const std::string &data);      ///< Will not buffer anything but always send right away. Blocks.
     void SendNow(const char *data);             ///< Will not buffer anything but always send right away. Blocks.
     void SendNow(const char *data, size_t len); ///< Will not buffer anything but always send right away. Blocks.
+    void SendNow(const struct iovec *vec, size_t count); ///< Sends all given buffers right away, in order. Blocks.
     void skipBytes(uint32_t byteCount);
     uint32_t skipCount;
     // stats related methods
@@ -142,6 +145,7 @@ namespace Socket{
       bool isConnected;
       int iread(void *buffer, int len, int flags = 0);  ///< Incremental read call.
       unsigned int iwrite(const void *buffer, int len); ///< Incremental write call.
+      unsigned int iwritev(const struct iovec *vec, int count); ///< Incremental gather write call.
       mbedtls_net_context * server_fd;
       mbedtls_entropy_context * entropy;
       mbedtls_ctr_drbg_context * ctr_drbg;
@@ -142,12 +142,15 @@ bool Util::startInput(std::string streamname, std::string filename, bool forkFir
   //It's still possible a duplicate starts anyway, this is caught in the inputs initializer.
   //Note: this uses the _whole_ stream name, including + (if any).
   //This means "test+a" and "test+b" have separate locks and do not interact with each other.
+  //Back off from 10ms up to 250ms between checks, so short transitions are noticed quickly
+  unsigned int delay = 10;
   uint8_t streamStat = getStreamStatus(streamname);
   while (streamStat != STRMSTAT_OFF && streamStat != STRMSTAT_READY && (!isProvider || streamStat != STRMSTAT_WAIT)){
     if (streamStat == STRMSTAT_BOOT && overrides.count("throughboot")){
       break;
     }
-    Util::sleep(250);
+    Util::sleep(delay);
+    delay = (delay < 125 ? delay * 2 : 250);
     streamStat = getStreamStatus(streamname);
   }
   if (streamAlive(streamname) && !overrides.count("alwaysStart")){
@@ -263,13 +266,16 @@ bool Util::startInput(std::string streamname, std::string filename, bool forkFir
     *spawn_pid = pid;
   }
 
-  unsigned int waiting = 0;
-  while (!streamAlive(streamname) && ++waiting < 240){
-    Util::wait(250);
-    if (!Util::Procs::isRunning(pid)){
+  //Wait up to a minute for the stream to come online, noticing an exiting input immediately
+  uint64_t waited = 0;
+  delay = 10;
+  while (!streamAlive(streamname) && waited < 60000){
+    if (Util::Procs::waitExit(pid, delay)){
       FAIL_MSG("Input process shut down before stream coming online, aborting.");
       break;
     }
+    waited += delay;
+    delay = (delay < 125 ? delay * 2 : 250);
   }
 
   return streamAlive(streamname);
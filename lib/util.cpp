@@ -244,36 +244,63 @@ namespace Util{
     }
   }
 
+  /// Appends a log message to out as a human readable line, optionally colored by kind.
+  /// progname, progpid and lineno may be null or empty.
+  /// The line is stamped with the given time, or the current time if when is 0.
+  void logFormat(std::string & out, bool colored, const char * kind, const char * progname, const char * progpid, const char * lineno, const char * message, time_t when){
+    static const char * color_time = 0, * color_end, * CONF_msg, * FAIL_msg, * ERROR_msg, * WARN_msg, * INFO_msg;
+    if (!color_time){
+      color_end = getenv("MIST_COLOR_END") ? getenv("MIST_COLOR_END") : "\033[0m";
+      CONF_msg = getenv("MIST_COLOR_CONF") ? getenv("MIST_COLOR_CONF") : "\033[0;1;37m";
+      FAIL_msg = getenv("MIST_COLOR_FAIL") ? getenv("MIST_COLOR_FAIL") : "\033[0;1;31m";
+      ERROR_msg = getenv("MIST_COLOR_ERROR") ? getenv("MIST_COLOR_ERROR") : "\033[0;31m";
+      WARN_msg = getenv("MIST_COLOR_WARN") ? getenv("MIST_COLOR_WARN") : "\033[0;1;33m";
+      INFO_msg = getenv("MIST_COLOR_INFO") ? getenv("MIST_COLOR_INFO") : "\033[0;36m";
+      color_time = getenv("MIST_COLOR_TIME") ? getenv("MIST_COLOR_TIME") : "\033[2m";
+    }
+    const char * color_msg = "";
+    if (colored){
+      color_msg = color_end;
+      if (!strcmp(kind, "CONF")){color_msg = CONF_msg;}
+      if (!strcmp(kind, "FAIL")){color_msg = FAIL_msg;}
+      if (!strcmp(kind, "ERROR")){color_msg = ERROR_msg;}
+      if (!strcmp(kind, "WARN")){color_msg = WARN_msg;}
+      if (!strcmp(kind, "INFO")){color_msg = INFO_msg;}
+    }
+    time_t rawtime = when;
+    struct tm timetmp;
+    char buffer[100];
+    if (!rawtime){time(&rawtime);}
+    strftime(buffer, 100, "%F %H:%M:%S", localtime_r(&rawtime, &timetmp));
+    if (colored){out += color_time;}
+    out += "[";
+    out += buffer;
+    out += "] ";
+    if (progname && progpid && strlen(progname) && strlen(progpid)){
+      out += progname;
+      out += " (";
+      out += progpid;
+      out += ") ";
+    }
+    out += color_msg;
+    out += kind;
+    out += ": ";
+    out += message;
+    if (colored){out += color_end;}
+    if (lineno && strlen(lineno)){
+      out += " (";
+      out += lineno;
+      out += ") ";
+    }
+    out += "\n";
+  }
+
   /// Parses log messages from the given file descriptor in, printing them to out, optionally calling the given callback for each valid message.
   /// Closes the file descriptor on read error
   void logParser(int in, int out, bool colored, void callback(std::string, std::string, bool)){
     char buf[1024];
     FILE *output = fdopen(in, "r");
-    char *color_time, *color_msg, *color_end, *CONF_msg, *FAIL_msg, *ERROR_msg, *WARN_msg, *INFO_msg;
-    if (colored){
-      color_end = (char*)"\033[0m";
-      if (getenv("MIST_COLOR_END")){color_end = getenv("MIST_COLOR_END");}
-      color_time = (char*)"\033[2m";
-      if (getenv("MIST_COLOR_TIME")){color_time = getenv("MIST_COLOR_TIME");}
-      CONF_msg = (char*)"\033[0;1;37m";
-      if (getenv("MIST_COLOR_CONF")){CONF_msg = getenv("MIST_COLOR_CONF");}
-      FAIL_msg = (char*)"\033[0;1;31m";
-      if (getenv("MIST_COLOR_FAIL")){FAIL_msg = getenv("MIST_COLOR_FAIL");}
-      ERROR_msg = (char*)"\033[0;31m";
-      if (getenv("MIST_COLOR_ERROR")){ERROR_msg = getenv("MIST_COLOR_ERROR");}
-      WARN_msg = (char*)"\033[0;1;33m";
-      if (getenv("MIST_COLOR_WARN")){WARN_msg = getenv("MIST_COLOR_WARN");}
-      INFO_msg = (char*)"\033[0;36m";
-      if (getenv("MIST_COLOR_INFO")){INFO_msg = getenv("MIST_COLOR_INFO");}
-    }else{
-      color_end = (char*)"";
-      color_time = (char*)"";
-      CONF_msg = (char*)"";
-      FAIL_msg = (char*)"";
-      ERROR_msg = (char*)"";
-      WARN_msg = (char*)"";
-      INFO_msg = (char*)"";
-    }
+    std::string line;
     while (fgets(buf, 1024, output)){
       unsigned int i = 0;
       char * kind = buf;//type of message, at begin of string
@@ -312,30 +339,9 @@ namespace Util{
       //print message
       if (message){
         if (callback){callback(kind, message, true);}
-        color_msg = color_end;
-        if (colored){
-          if (!strcmp(kind, "CONF")){color_msg = CONF_msg;}
-          if (!strcmp(kind, "FAIL")){color_msg = FAIL_msg;}
-          if (!strcmp(kind, "ERROR")){color_msg = ERROR_msg;}
-          if (!strcmp(kind, "WARN")){color_msg = WARN_msg;}
-          if (!strcmp(kind, "INFO")){color_msg = INFO_msg;}
-        }
-        time_t rawtime;
-        struct tm *timeinfo;
-        struct tm timetmp;
-        char buffer[100];
-        time(&rawtime);
-        timeinfo = localtime_r(&rawtime, &timetmp);
-        strftime(buffer, 100, "%F %H:%M:%S", timeinfo);
-        dprintf(out, "%s[%s] ", color_time, buffer);
-        if (progname && progpid && strlen(progname) && strlen(progpid)){
-          dprintf(out, "%s (%s) ", progname, progpid);
-        }
-        dprintf(out, "%s%s: %s%s", color_msg, kind, message, color_end);
-        if (lineno && strlen(lineno)){
-          dprintf(out, " (%s) ", lineno);
-        }
-        dprintf(out, "\n");
+        line.clear();
+        logFormat(line, colored, kind, progname, progpid, lineno, message);
+        dprintf(out, "%s", line.c_str());
       }else{
         //could not be parsed as log string - print the whole thing
         dprintf(out, "%s\n", buf);
@@ -6,6 +6,7 @@
 #include <map>
 #include <stdint.h>
 #include <stdlib.h>
+#include <time.h>
 
 namespace Util{
   bool isDirectory(const std::string &path);
@@ -39,6 +40,7 @@ namespace Util{
 
   };
 
+  void logFormat(std::string & out, bool colored, const char * kind, const char * progname, const char * progpid, const char * lineno, const char * message, time_t when = 0);
   void logParser(int in, int out, bool colored, void callback(std::string, std::string, bool) = 0);
   void redirectLogsIfNeeded();
 
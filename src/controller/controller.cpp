@@ -9,6 +9,7 @@
 #include "controller_storage.h"
 #include "controller_streams.h"
 #include <ctime>
+#include <fcntl.h>
 #include <iostream>
 #include <mist/auth.h>
 #include <mist/config.h>
@@ -20,6 +21,7 @@
 #include <mist/stream.h>
 #include <mist/timing.h>
 #include <mist/tinythread.h>
+#include <poll.h>
 #include <stdio.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
@@ -60,12 +62,30 @@ void createAccount(std::string account){
   }
 }
 
+static int monitorWake[2] = {-1, -1}; ///< Written to when a child process exits, to wake up the status monitor.
+
+/// Wakes up the status monitor, so that crashed connectors are restarted right away.
+static void childExited(pid_t pid, int exitCode){
+  if (monitorWake[1] != -1 && write(monitorWake[1], "", 1) < 0){}
+}
+
 /// Status monitoring thread.
-/// Will check outputs, inputs and converters every five seconds
+/// Will check outputs, inputs and converters every five seconds, and whenever a child process exits.
+/// Checks at most once per second, so connectors that keep crashing are not restarted in a tight loop.
 void statusMonitor(void *np){
   IPC::semaphore configLock(SEM_CONF, O_CREAT | O_RDWR, ACCESSPERMS, 1);
   Controller::loadActiveConnectors();
+  if (!pipe(monitorWake)){
+    for (int i = 0; i < 2; ++i){
+      fcntl(monitorWake[i], F_SETFL, O_NONBLOCK);
+      fcntl(monitorWake[i], F_SETFD, FD_CLOEXEC);
+    }
+    Util::Procs::setExitHandler(childExited);
+  }else{
+    monitorWake[0] = monitorWake[1] = -1;
+  }
   while (Controller::conf.is_active){
+    uint64_t lastCheck = Util::bootMS();
     // this scope prevents the configMutex from being locked constantly
     {
       tthread::lock_guard<tthread::mutex> guard(Controller::configMutex);
@@ -89,7 +109,28 @@ void statusMonitor(void *np){
         Controller::configChanged = false;
       }
     }
-    Util::sleep(5000); // wait at least 5 seconds
+    if (monitorWake[0] == -1){
+      Util::sleep(5000);
+      continue;
+    }
+    struct pollfd pfd;
+    pfd.fd = monitorWake[0];
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    if (poll(&pfd, 1, 5000) > 0){
+      char buf[64];
+      while (read(monitorWake[0], buf, 64) > 0){}
+    }
+    uint64_t sinceCheck = Util::bootMS() - lastCheck;
+    if (sinceCheck < 1000){Util::sleep(1000 - sinceCheck);}
+  }
+  Util::Procs::setExitHandler(0);
+  if (monitorWake[0] != -1){
+    int wakeFd = monitorWake[1];
+    monitorWake[1] = -1;
+    close(monitorWake[0]);
+    close(wakeFd);
+    monitorWake[0] = -1;
   }
   if (Controller::restarting){
     Controller::prepareActiveConnectorsForReload();
@@ -377,6 +418,8 @@ int main_loop(int argc, char **argv){
   tthread::thread statsThread(Controller::SharedMemStats, &Controller::conf);
   // start monitoring thread
   tthread::thread monitorThread(statusMonitor, 0);
+  // start log ring draining thread
+  tthread::thread logRingThread(Controller::handleLogRing, &Controller::conf);
 
   // start main loop
   while (Controller::conf.is_active){
@@ -397,6 +440,8 @@ int main_loop(int argc, char **argv){
   statsThread.join();
   HIGH_MSG("Joining monitor thread...");
   monitorThread.join();
+  HIGH_MSG("Joining log ring thread...");
+  logRingThread.join();
   // write config
   tthread::lock_guard<tthread::mutex> guard(Controller::logMutex);
   Controller::writeConfigToDisk();
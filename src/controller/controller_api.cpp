@@ -1,5 +1,6 @@
 #include <dirent.h> //for browse API call
 #include <sys/stat.h> //for browse API call
+#include <deque>
 #include <mist/http_parser.h>
 #include <mist/auth.h>
 #include <mist/config.h>
@@ -124,10 +125,112 @@ class streamStat{
     uint64_t outputs;
 };
 
+#define WS_RECORD_CACHE 1000 ///< Amount of most recent log and access log records kept serialized for websockets
+
+/// Serialized state page records, shared by all websocket connections.
+/// Each record is serialized only once, no matter how many dashboards are connected.
+class recordCache{
+  public:
+    recordCache(){first = 0;}
+    /// Returns the serialized record at the given position, serializing it first if it is not cached yet.
+    std::string get(const Util::RelAccX & rlx, uint64_t pos, std::string (*serialize)(const Util::RelAccX &, uint64_t)){
+      tthread::lock_guard<tthread::mutex> guard(lock);
+      if (pos >= first && pos < first + records.size()){return records[pos - first];}
+      //Older records than we have are rare (new connections asking for history): don't cache those
+      if (pos < first && records.size()){return serialize(rlx, pos);}
+      if (pos != first + records.size()){
+        records.clear();
+        first = pos;
+      }
+      records.push_back(serialize(rlx, pos));
+      if (records.size() > WS_RECORD_CACHE){
+        records.pop_front();
+        ++first;
+      }
+      return records.back();
+    }
+  private:
+    tthread::mutex lock;
+    uint64_t first;///< Position of the first cached record
+    std::deque<std::string> records;
+};
+
+static recordCache logCache;
+static recordCache accsCache;
+
+static std::string serializeLog(const Util::RelAccX & rlx, uint64_t pos){
+  JSON::Value tmp;
+  tmp.append((long long)rlx.getInt("time", pos));
+  tmp.append(rlx.getPointer("kind", pos));
+  tmp.append(rlx.getPointer("msg", pos));
+  return tmp.toString();
+}
+
+static std::string serializeAccess(const Util::RelAccX & rlx, uint64_t pos){
+  JSON::Value tmp;
+  tmp.append((long long)rlx.getInt("time", pos));
+  tmp.append(rlx.getPointer("session", pos));
+  tmp.append(rlx.getPointer("stream", pos));
+  tmp.append(rlx.getPointer("connector", pos));
+  tmp.append(rlx.getPointer("host", pos));
+  tmp.append((long long)rlx.getInt("duration", pos));
+  tmp.append((long long)rlx.getInt("up", pos));
+  tmp.append((long long)rlx.getInt("down", pos));
+  tmp.append(rlx.getPointer("tags", pos));
+  return tmp.toString();
+}
+
+static tthread::mutex streamCacheLock;
+static std::map<std::string, std::pair<streamStat, std::string> > streamCache;///< Last serialized state per stream
+
+/// Returns the serialized state of the given stream, shared by all websocket connections like recordCache.
+/// Streams that went away are sent with an all-zero state, which is not cached.
+static std::string serializeStream(const std::string & strm, const streamStat & stat){
+  tthread::lock_guard<tthread::mutex> guard(streamCacheLock);
+  if (stat == streamStat()){
+    streamCache.erase(strm);
+  }else if (streamCache.count(strm) && streamCache[strm].first == stat){
+    return streamCache[strm].second;
+  }
+  JSON::Value tmp;
+  tmp.append(strm);
+  tmp.append((long long)stat.status);
+  tmp.append((long long)stat.viewers);
+  tmp.append((long long)stat.inputs);
+  tmp.append((long long)stat.outputs);
+  if (stat != streamStat()){streamCache[strm] = std::make_pair(stat, tmp.toString());}
+  return tmp.toString();
+}
+
+/// Sends the given serialized records of the given type: either one frame per record, or all in a single frame.
+static void sendRecords(HTTP::Websocket & W, const char * type, const std::deque<std::string> & records, bool batch){
+  if (!records.size()){return;}
+  std::string prefix = std::string("[\"") + type + "\",";
+  if (!batch){
+    for (std::deque<std::string>::const_iterator it = records.begin(); it != records.end(); ++it){
+      W.sendFrame(prefix + *it + "]");
+    }
+    return;
+  }
+  std::string frame = prefix;
+  for (std::deque<std::string>::const_iterator it = records.begin(); it != records.end(); ++it){
+    if (it != records.begin()){frame += ",";}
+    frame += *it;
+  }
+  frame += "]";
+  W.sendFrame(frame);
+}
+
+/// Streams logs, access logs and stream states to a websocket as they change.
+/// Wakes up whenever the controller changes any of them, instead of polling.
+/// Every message is a JSON array of the type ("log", "access" or "stream") followed by a record.
+/// If the "batch" URL parameter is set, all records of a type that are ready at once are sent in a single
+/// message, as a JSON array of the type followed by all those records.
 void Controller::handleWebSocket(HTTP::Parser & H, Socket::Connection & C){
   std::string logs = H.GetVar("logs");
   std::string accs = H.GetVar("accs");
   bool doStreams = H.GetVar("streams").size();
+  bool batch = H.GetVar("batch").size();
   HTTP::Websocket W(C, H);
   if (!W){return;}
 
@@ -176,34 +279,21 @@ void Controller::handleWebSocket(HTTP::Parser & H, Socket::Connection & C){
   }
   std::map<std::string, streamStat> lastStrmStat;
   std::set<std::string> strmRemove;
+  std::deque<std::string> records;
+  uint64_t stateSeq = stateSequence();
   while (W){
-    bool sent = false;
     while (doLog && rlxLog.getEndPos() > logPos){
-      sent = true;
-      JSON::Value tmp;
-      tmp[0u] = "log";
-      tmp[1u].append((long long)rlxLog.getInt("time", logPos));
-      tmp[1u].append(rlxLog.getPointer("kind", logPos));
-      tmp[1u].append(rlxLog.getPointer("msg", logPos));
-      W.sendFrame(tmp.toString());
+      records.push_back(logCache.get(rlxLog, logPos, serializeLog));
       logPos++;
     }
+    sendRecords(W, "log", records, batch);
+    records.clear();
     while (doAccs && rlxAccs.getEndPos() > accsPos){
-      sent = true;
-      JSON::Value tmp;
-      tmp[0u] = "access";
-      tmp[1u].append((long long)rlxAccs.getInt("time", accsPos));
-      tmp[1u].append(rlxAccs.getPointer("session", accsPos));
-      tmp[1u].append(rlxAccs.getPointer("stream", accsPos));
-      tmp[1u].append(rlxAccs.getPointer("connector", accsPos));
-      tmp[1u].append(rlxAccs.getPointer("host", accsPos));
-      tmp[1u].append((long long)rlxAccs.getInt("duration", accsPos));
-      tmp[1u].append((long long)rlxAccs.getInt("up", accsPos));
-      tmp[1u].append((long long)rlxAccs.getInt("down", accsPos));
-      tmp[1u].append(rlxAccs.getPointer("tags", accsPos));
-      W.sendFrame(tmp.toString());
+      records.push_back(accsCache.get(rlxAccs, accsPos, serializeAccess));
       accsPos++;
     }
+    sendRecords(W, "access", records, batch);
+    records.clear();
     if (doStreams){
       for (std::map<std::string, streamStat>::iterator it = lastStrmStat.begin(); it != lastStrmStat.end(); ++it){
         strmRemove.insert(it->first);
@@ -216,35 +306,19 @@ void Controller::handleWebSocket(HTTP::Parser & H, Socket::Connection & C){
         streamStat tmpStat(rlxStreams, cPos);
         if (lastStrmStat[strm] != tmpStat){
           lastStrmStat[strm] = tmpStat;
-          sent = true;
-          JSON::Value tmp;
-          tmp[0u] = "stream";
-          tmp[1u].append(strm);
-          tmp[1u].append((long long)tmpStat.status);
-          tmp[1u].append((long long)tmpStat.viewers);
-          tmp[1u].append((long long)tmpStat.inputs);
-          tmp[1u].append((long long)tmpStat.outputs);
-          W.sendFrame(tmp.toString());
+          records.push_back(serializeStream(strm, tmpStat));
         }
       }
       while (strmRemove.size()){
         std::string strm = *strmRemove.begin();
-        sent = true;
-        JSON::Value tmp;
-        tmp[0u] = "stream";
-        tmp[1u].append(strm);
-        tmp[1u].append((long long)0);
-        tmp[1u].append((long long)0);
-        tmp[1u].append((long long)0);
-        tmp[1u].append((long long)0);
-        W.sendFrame(tmp.toString());
+        records.push_back(serializeStream(strm, streamStat()));
         strmRemove.erase(strm);
         lastStrmStat.erase(strm);
       }
+      sendRecords(W, "stream", records, batch);
+      records.clear();
     }
-    if (!sent){
-      Util::sleep(500);
-    }
+    stateSeq = waitState(stateSeq);
   }
 }
 
@@ -288,6 +362,29 @@ int Controller::handleAPIConnection(Socket::Connection & conn){
           }
         }
       }
+      //Catch Prometheus requests, which need no authorization on the configured path
+      std::string promPath;
+      {
+        tthread::lock_guard<tthread::mutex> guard(configMutex);
+        promPath = Storage["config"]["prometheus"].asString();
+      }
+      if (H.url == "/metrics" || (promPath.size() && H.url == "/" + promPath)){
+        if (!authorized && (!promPath.size() || H.url != "/" + promPath)){
+          H.Clean();
+          H.body = "Please login first or provide a valid token authentication.";
+          H.SetHeader("Server", "MistServer/" PACKAGE_VERSION);
+          H.SendResponse("403", "Not authorized", conn);
+          H.Clean();
+          continue;
+        }
+        H.Clean();
+        H.SetHeader("Content-Type", "text/plain; version=0.0.4");
+        H.SetHeader("Server", "MistServer/" PACKAGE_VERSION);
+        H.SetBody(getMetrics());
+        H.SendResponse("200", "OK", conn);
+        H.Clean();
+        continue;
+      }
       //Catch websocket requests
       if (H.url == "/ws"){
         if (!authorized){
@@ -347,11 +444,16 @@ int Controller::handleAPIConnection(Socket::Connection & conn){
       H.Clean();
       H.SetHeader("Content-Type", "text/javascript");
       H.setCORSHeaders();
+      std::string body;
       if (jsonp == ""){
-        H.SetBody(Response.toString() + "\n\n");
+        Response.toString(body);
+        body += "\n\n";
       }else{
-        H.SetBody(jsonp + "(" + Response.toString() + ");\n\n");
+        body = jsonp + "(";
+        Response.toString(body);
+        body += ");\n\n";
       }
+      H.SetBody(body);
       H.SendResponse("200", "OK", conn);
       H.Clean();
     }//if HTTP request received
@@ -406,6 +508,12 @@ void Controller::handleAPICommands(JSON::Value & Request, JSON::Value & Response
     if (in.isMember("serverid")){
       out["serverid"] = in["serverid"];
     }
+    if (in.isMember("vod_memory")){
+      out["vod_memory"] = in["vod_memory"];
+    }
+    if (in.isMember("prometheus")){
+      out["prometheus"] = in["prometheus"];
+    }
   }
   if (Request.isMember("streams")){
     Controller::CheckStreams(Request["streams"], Controller::Storage["streams"]);
@@ -607,6 +715,9 @@ void Controller::handleAPICommands(JSON::Value & Request, JSON::Value & Response
   if (Request.isMember("stats_streams")){
     Controller::fillActive(Request["stats_streams"], Response["stats_streams"]);
   }
+  if (Request.isMember("vod_pages")){
+    Controller::fillPages(Response["vod_pages"]);
+  }
           
   Controller::configChanged = true;
 }
@@ -4,6 +4,9 @@
 #include <mist/shared_memory.h>
 #include <mist/dtsc.h>
 #include <mist/stream.h>
+#include <mist/bitfields.h>
+#include <mist/procs.h>
+#include <mist/metrics.h>
 #include "controller_statistics.h"
 #include "controller_storage.h"
 
@@ -33,6 +36,7 @@
 std::map<Controller::sessIndex, Controller::statSession> Controller::sessions; ///< list of sessions that have statistics data available
 std::map<unsigned long, Controller::sessIndex> Controller::connToSession; ///< Map of socket IDs to session info.
 tthread::mutex Controller::statsMutex;
+std::map<std::string, Metrics::totals> retiredMetrics; ///< Metrics of processes that have exited, per process name.
 
 //For server-wide totals. Local to this file only.
 struct streamTotals {
@@ -119,6 +123,8 @@ void Controller::SharedMemStats(void * config){
       tthread::lock_guard<tthread::mutex> guard2(statsMutex);
       //parse current users
       statServer.parseEach(parseStatistics);
+      cleanPages();
+      cleanMetrics();
       //wipe old statistics
       if (sessions.size()){
         std::list<sessIndex> mustWipe;
@@ -183,6 +189,8 @@ void Controller::SharedMemStats(void * config){
         shiftWrites = true;
       }
     }
+    //Wake up websocket connections, which also lets them notice disconnects at least once per second
+    notifyState();
     Util::wait(1000);
   }
   statPointer = 0;
@@ -838,6 +846,46 @@ void Controller::fillClients(JSON::Value & req, JSON::Value & rep){
   //all done! return is by reference, so no need to return anything here.
 }
 
+/// Returns the total size in bytes of all shared memory pages currently allocated for the given stream.
+/// Counts the stream index page, plus the index and data pages of every track in it.
+/// Returns -1 if the stream has no metadata page, or if its metadata is being written right now:
+/// this is called from API requests, which must not wait for a busy stream.
+static long long streamShmUsage(const std::string & streamName){
+  char pageId[NAME_BUFFER_SIZE];
+  snprintf(pageId, NAME_BUFFER_SIZE, SHM_STREAM_INDEX, streamName.c_str());
+  IPC::sharedPage streamIndex(pageId, DEFAULT_STRM_PAGE_SIZE, false, false);
+  if (!streamIndex.mapped){return -1;}
+  long long total = streamIndex.len;
+  std::set<unsigned long> trackIds;
+  {
+    char liveSemName[NAME_BUFFER_SIZE];
+    snprintf(liveSemName, NAME_BUFFER_SIZE, SEM_LIVE, streamName.c_str());
+    IPC::semaphore metaLocker(liveSemName, O_CREAT | O_RDWR, (S_IRWXU|S_IRWXG|S_IRWXO), 1);
+    if (!metaLocker.tryWait()){return -1;}
+    DTSC::Scan trcks = DTSC::Packet(streamIndex.mapped, streamIndex.len, true).getScan().getMember("tracks");
+    unsigned int trcks_ctr = trcks.getSize();
+    for (unsigned int i = 0; i < trcks_ctr; ++i){
+      trackIds.insert(trcks.getIndice(i).getMember("trackid").asInt());
+    }
+    metaLocker.post();
+  }
+  for (std::set<unsigned long>::iterator it = trackIds.begin(); it != trackIds.end(); ++it){
+    snprintf(pageId, NAME_BUFFER_SIZE, SHM_TRACK_INDEX, streamName.c_str(), *it);
+    IPC::sharedPage trackIndex(pageId, SHM_TRACK_INDEX_SIZE, false, false);
+    if (!trackIndex.mapped){continue;}
+    total += trackIndex.len;
+    for (int j = 0; j < trackIndex.len / 8; ++j){
+      char * tmpOffset = trackIndex.mapped + (j * 8);
+      unsigned long pageNum = Bit::btohl(tmpOffset);
+      if (!pageNum || !Bit::btohl(tmpOffset+4)){continue;}
+      snprintf(pageId, NAME_BUFFER_SIZE, SHM_TRACK_DATA, streamName.c_str(), *it, pageNum);
+      IPC::sharedPage dataPage(pageId, DEFAULT_DATA_PAGE_SIZE, false, false);
+      total += dataPage.len;
+    }
+  }
+  return total;
+}
+
 /// This takes a "active_streams" request, and fills in the response data.
 /// 
 /// \api
@@ -856,7 +904,8 @@ void Controller::fillClients(JSON::Value & req, JSON::Value & rep){
 /// [
 ///   //Array of requested data types
 ///   "clients", //Current viewer count
-///   "lastms" //Current position in the live buffer, if live
+///   "lastms", //Current position in the live buffer, if live
+///   "shm" //Total bytes of shared memory allocated for the stream's metadata and data pages, or -1 if unknown right now
 /// ]
 /// ~~~~~~~~~~~~~~~
 /// In which case the response is changed into this format:
@@ -934,6 +983,9 @@ void Controller::fillActive(JSON::Value & req, JSON::Value & rep, bool onlyNow){
             rep[*it].append(-1ll);
           }
         }
+        if (j->asStringRef() == "shm"){
+          rep[*it].append(streamShmUsage(*it));
+        }
       }
     }else{
       rep.append(*it);
@@ -967,6 +1019,77 @@ class totalsData {
     long long upbps;
 };
 
+/// Releases the VoD page accounting records of inputs that are no longer running.
+void Controller::cleanPages(){
+  Util::RelAccX * pageStats = pagesAccessor();
+  if (!pageStats || !pageStats->isReady()){return;}
+  IPC::semaphore pagesLock(SEM_STATE_PAGES, O_CREAT | O_RDWR, ACCESSPERMS, 1);
+  pagesLock.wait();
+  for (uint64_t i = 0; i < pageStats->getEndPos(); ++i){
+    uint64_t pid = pageStats->getInt("pid", i);
+    if (pid && !Util::Procs::isRunning(pid)){
+      INFO_MSG("Releasing VoD page accounting of stopped input %llu for stream %s", (unsigned long long)pid, pageStats->getPointer("stream", i));
+      pageStats->setInt("pid", 0, i);
+      pageStats->setInt("resident", 0, i);
+      pageStats->setInt("pages", 0, i);
+    }
+  }
+  pagesLock.post();
+}
+
+/// Fills rep with the server-wide VoD page memory budget and usage, as well as the per-stream page counters.
+void Controller::fillPages(JSON::Value & rep){
+  rep.null();
+  rep["budget"] = Storage["config"]["vod_memory"].asInt() * 1024 * 1024;
+  rep["resident"] = 0ll;
+  rep["pages"] = 0ll;
+  rep["loads"] = 0ll;
+  rep["evictions"] = 0ll;
+  Util::RelAccX * pageStats = pagesAccessor();
+  if (!pageStats || !pageStats->isReady()){return;}
+  for (uint64_t i = 0; i < pageStats->getEndPos(); ++i){
+    if (!pageStats->getInt("pid", i)){continue;}
+    JSON::Value & strm = rep["streams"][std::string(pageStats->getPointer("stream", i))];
+    strm["resident"] = strm["resident"].asInt() + (long long)pageStats->getInt("resident", i);
+    strm["pages"] = strm["pages"].asInt() + (long long)pageStats->getInt("pages", i);
+    strm["loads"] = strm["loads"].asInt() + (long long)pageStats->getInt("loads", i);
+    strm["evictions"] = strm["evictions"].asInt() + (long long)pageStats->getInt("evictions", i);
+    rep["resident"] = rep["resident"].asInt() + (long long)pageStats->getInt("resident", i);
+    rep["pages"] = rep["pages"].asInt() + (long long)pageStats->getInt("pages", i);
+    rep["loads"] = rep["loads"].asInt() + (long long)pageStats->getInt("loads", i);
+    rep["evictions"] = rep["evictions"].asInt() + (long long)pageStats->getInt("evictions", i);
+  }
+}
+
+/// Adds the metrics of processes that are no longer running to the retired totals, and releases their records.
+void Controller::cleanMetrics(){
+  Util::RelAccX * metrics = metricsAccessor();
+  if (!metrics || !metrics->isReady()){return;}
+  IPC::semaphore metricsLock(SEM_STATE_METRICS, O_CREAT | O_RDWR, ACCESSPERMS, 1);
+  metricsLock.wait();
+  for (uint64_t i = 0; i < metrics->getEndPos(); ++i){
+    uint64_t pid = metrics->getInt("pid", i);
+    if (pid && !Util::Procs::isRunning(pid)){
+      retiredMetrics[metrics->getPointer("process", i)].add(*metrics, i);
+      metrics->setInt("pid", 0, i);
+    }
+  }
+  metricsLock.post();
+}
+
+/// Returns the hot path metrics of all running and exited processes, in Prometheus text format.
+std::string Controller::getMetrics(){
+  tthread::lock_guard<tthread::mutex> guard(statsMutex);
+  std::map<std::string, Metrics::totals> processes = retiredMetrics;
+  Util::RelAccX * metrics = metricsAccessor();
+  if (metrics && metrics->isReady()){
+    for (uint64_t i = 0; i < metrics->getEndPos(); ++i){
+      if (metrics->getInt("pid", i)){processes[metrics->getPointer("process", i)].add(*metrics, i);}
+    }
+  }
+  return Metrics::toPrometheus(processes);
+}
+
 /// This takes a "totals" request, and fills in the response data.
 void Controller::fillTotals(JSON::Value & req, JSON::Value & rep){
   tthread::lock_guard<tthread::mutex> guard(statsMutex);
@@ -105,6 +105,10 @@ namespace Controller {
   void fillClients(JSON::Value & req, JSON::Value & rep);
   void fillActive(JSON::Value & req, JSON::Value & rep, bool onlyNow = false);
   void fillTotals(JSON::Value & req, JSON::Value & rep);
+  void fillPages(JSON::Value & rep);
+  void cleanPages();
+  void cleanMetrics();
+  std::string getMetrics();
   void SharedMemStats(void * config);
   bool hasViewers(std::string streamName);
 }
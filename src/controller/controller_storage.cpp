@@ -6,6 +6,8 @@
 #include <mist/shared_memory.h>
 #include <mist/defines.h>
 #include <mist/util.h>
+#include <mist/metrics.h>
+#include <mist/log_ring.h>
 #include <sys/stat.h>
 #include "controller_storage.h"
 #include "controller_capabilities.h"
@@ -32,6 +34,19 @@ namespace Controller {
   Util::RelAccX * rlxAccs = 0;
   IPC::sharedPage * shmStrm = 0;
   Util::RelAccX * rlxStrm = 0;
+  IPC::sharedPage * shmPages = 0;
+  Util::RelAccX * rlxPages = 0;
+  IPC::sharedPage * shmMetrics = 0;
+  Util::RelAccX * rlxMetrics = 0;
+  IPC::sharedPage * shmInfo = 0;
+  Util::RelAccX * rlxInfo = 0;
+  IPC::sharedPage * shmRoutes = 0;
+  Util::RelAccX * rlxRoutes = 0;
+  tthread::mutex stateMutex;
+  tthread::condition_variable stateChanged;
+  uint64_t stateSeq = 0;
+  tthread::mutex logRingMutex;///< Held while draining the log ring, which allows only one reader at a time
+  std::string logRingLines;///< Printable lines of the messages drained from the log ring in the current batch
 
   Util::RelAccX * logAccessor(){
     return rlxLogs;
@@ -45,14 +60,52 @@ namespace Controller {
     return rlxStrm;
   }
 
+  Util::RelAccX * pagesAccessor(){
+    return rlxPages;
+  }
+
+  Util::RelAccX * metricsAccessor(){
+    return rlxMetrics;
+  }
+
+  /// Wakes up everyone waiting in waitState: the logs, access logs or streams state pages changed.
+  void notifyState(){
+    tthread::lock_guard<tthread::mutex> guard(stateMutex);
+    ++stateSeq;
+    stateChanged.notify_all();
+  }
+
+  /// Returns the current state change sequence number.
+  uint64_t stateSequence(){
+    tthread::lock_guard<tthread::mutex> guard(stateMutex);
+    return stateSeq;
+  }
+
+  /// Blocks until the state pages changed after the given sequence number was current.
+  /// The streams page is updated every second, so this returns at least about once per second.
+  /// \returns The new sequence number.
+  uint64_t waitState(uint64_t seq){
+    tthread::lock_guard<tthread::mutex> guard(stateMutex);
+    while (stateSeq == seq){stateChanged.wait(stateMutex);}
+    return stateSeq;
+  }
+
   ///\brief Store and print a log message.
   ///\param kind The type of message.
   ///\param message The message to be logged.
   void Log(std::string kind, std::string message, bool noWriteToLog){
+    Log(kind, message, noWriteToLog, 0);
+  }
+
+  ///\brief Store and print a log message that was logged at the given time.
+  ///\param kind The type of message.
+  ///\param message The message to be logged.
+  ///\param logTime Time of the message in seconds since the epoch, or 0 for now.
+  void Log(std::string kind, std::string message, bool noWriteToLog, uint64_t logTime){
     if (noWriteToLog){
       tthread::lock_guard<tthread::mutex> guard(logMutex);
       JSON::Value m;
-      uint64_t logTime = Util::epoch();
+      if (!logTime){logTime = Util::epoch();}
       m.append((long long)logTime);
       m.append(kind);
       m.append(message);
@@ -69,6 +122,7 @@ namespace Controller {
         rlxLogs->setString("kind", kind, logCounter-1);
         rlxLogs->setString("msg", message, logCounter-1);
         rlxLogs->setEndPos(logCounter);
+        notifyState();
       }
     }else{
       std::cerr << kind << "|MistController|" << getpid() << "||" << message << "\n";
@@ -90,6 +144,7 @@ namespace Controller {
       rlxAccs->setInt("down", down, newEndPos);
       rlxAccs->setString("tags", tags, newEndPos);
       rlxAccs->setEndPos(newEndPos + 1);
+      notifyState();
     }
   }
 
@@ -122,6 +177,15 @@ namespace Controller {
     }
     maxLogsRecs = (1024*1024 - rlxLogs->getOffset()) / rlxLogs->getRSize();
 
+    //The drain thread only starts reading once the ring is completely set up
+    if (LogRing::create(SHM_LOG_RING)){
+      //Only processes started by this controller log into the ring; everything else keeps using standard error
+      setenv(LOG_RING_ENV, "1", 1);
+    }else{
+      unsetenv(LOG_RING_ENV);
+      FAIL_MSG("Could not create log ring; child processes will log through the log pipe");
+    }
+
     shmAccs = new IPC::sharedPage(SHM_STATE_ACCS, 1024*1024, true);//max 1M of accesslogs cached
     if (!shmAccs->mapped){
       FAIL_MSG("Could not open memory page for access logs buffer");
@@ -157,9 +221,76 @@ namespace Controller {
       rlxStrm->setReady();
     }
     rlxStrm->setRCount((1024*1024 - rlxStrm->getOffset()) / rlxStrm->getRSize());
+
+    shmPages = new IPC::sharedPage(SHM_STATE_PAGES, SHM_STATE_PAGES_SIZE, true);
+    if (!shmPages->mapped){
+      FAIL_MSG("Could not open memory page for VoD page accounting");
+      return;
+    }
+    rlxPages = new Util::RelAccX(shmPages->mapped, false);
+    if (!rlxPages->isReady()){
+      //One record per input process, claimed by the input itself
+      rlxPages->addField("stream", RAX_128STRING);
+      rlxPages->addField("pid", RAX_32UINT);
+      rlxPages->addField("resident", RAX_64UINT);
+      rlxPages->addField("pages", RAX_32UINT);
+      rlxPages->addField("loads", RAX_64UINT);
+      rlxPages->addField("evictions", RAX_64UINT);
+      rlxPages->setRCount((SHM_STATE_PAGES_SIZE - rlxPages->getOffset()) / rlxPages->getRSize());
+      rlxPages->setEndPos(rlxPages->getRCount());
+      rlxPages->setReady();
+    }
+
+    shmMetrics = new IPC::sharedPage(SHM_STATE_METRICS, SHM_STATE_METRICS_SIZE, true);
+    if (!shmMetrics->mapped){
+      FAIL_MSG("Could not open memory page for metrics");
+      return;
+    }
+    rlxMetrics = new Util::RelAccX(shmMetrics->mapped, false);
+    if (!rlxMetrics->isReady()){
+      //One record per input or output process, claimed by the process itself
+      Metrics::addFields(*rlxMetrics);
+      rlxMetrics->setRCount((SHM_STATE_METRICS_SIZE - rlxMetrics->getOffset()) / rlxMetrics->getRSize());
+      rlxMetrics->setEndPos(rlxMetrics->getRCount());
+      rlxMetrics->setReady();
+    }
+
+    shmInfo = new IPC::sharedPage(SHM_STATE_INFO, SHM_STATE_INFO_SIZE, true);
+    if (!shmInfo->mapped){
+      FAIL_MSG("Could not open memory page for stream info cache");
+      return;
+    }
+    rlxInfo = new Util::RelAccX(shmInfo->mapped, false);
+    if (!rlxInfo->isReady()){
+      //One record per cached json_/info_ response, claimed by MistOutHTTP
+      rlxInfo->addField("key", RAX_64UINT);
+      rlxInfo->addField("etag", RAX_64UINT);
+      rlxInfo->addField("used", RAX_64UINT);
+      rlxInfo->addField("size", RAX_32UINT);
+      rlxInfo->addField("data", RAX_RAW, INFO_CACHE_MAX);
+      rlxInfo->setRCount((SHM_STATE_INFO_SIZE - rlxInfo->getOffset()) / rlxInfo->getRSize());
+      rlxInfo->setEndPos(rlxInfo->getRCount());
+      rlxInfo->setReady();
+    }
   }
 
   void deinitState(bool leaveBehind){
+    {
+      //Print whatever is left, then make processes go back to the log pipe
+      drainLogRing();
+      tthread::lock_guard<tthread::mutex> ringGuard(logRingMutex);
+      LogRing::destroy(leaveBehind);
+    }
+    if (rlxRoutes){
+      //The routing table is written by writeConfig, which holds the config mutex
+      tthread::lock_guard<tthread::mutex> confGuard(configMutex);
+      if (!leaveBehind){rlxRoutes->setExit();}
+      shmRoutes->master = !leaveBehind;
+      delete rlxRoutes;
+      rlxRoutes = 0;
+      delete shmRoutes;
+      shmRoutes = 0;
+    }
     tthread::lock_guard<tthread::mutex> guard(logMutex);
     if (!leaveBehind){
       rlxLogs->setExit();
@@ -168,10 +299,25 @@ namespace Controller {
       shmAccs->master = true;
       rlxStrm->setExit();
       shmStrm->master = true;
+      if (rlxPages){
+        rlxPages->setExit();
+        shmPages->master = true;
+      }
+      if (rlxMetrics){
+        rlxMetrics->setExit();
+        shmMetrics->master = true;
+      }
+      if (rlxInfo){
+        rlxInfo->setExit();
+        shmInfo->master = true;
+      }
     }else{
       shmLogs->master = false;
       shmAccs->master = false;
       shmStrm->master = false;
+      if (shmPages){shmPages->master = false;}
+      if (shmMetrics){shmMetrics->master = false;}
+      if (shmInfo){shmInfo->master = false;}
     }
     Util::RelAccX * tmp = rlxLogs;
     rlxLogs = 0;
@@ -188,12 +334,62 @@ namespace Controller {
     delete tmp;
     delete shmStrm;
     shmStrm = 0;
+    tmp = rlxPages;
+    rlxPages = 0;
+    delete tmp;
+    delete shmPages;
+    shmPages = 0;
+    tmp = rlxMetrics;
+    rlxMetrics = 0;
+    delete tmp;
+    delete shmMetrics;
+    shmMetrics = 0;
+    tmp = rlxInfo;
+    rlxInfo = 0;
+    delete tmp;
+    delete shmInfo;
+    shmInfo = 0;
   }
 
   void handleMsg(void *err){
     Util::logParser((long long)err, fileno(stdout), Controller::isColorized, &Log);
   }
 
+  /// Stores a message from the log ring, and adds it to the lines printed for the current batch.
+  static void logRingRecord(const LogRing::record & r){
+    const char * kind = DBG_LVL_LIST[r.level <= DLVL_DONTEVEN ? r.level : DLVL_DONTEVEN];
+    std::string message(r.message, r.msgLen);
+    char pid[128];
+    if (r.stream[0]){
+      snprintf(pid, 128, "%" PRIu32 ": %.*s", r.pid, (int)sizeof(r.stream), r.stream);
+    }else{
+      snprintf(pid, 128, "%" PRIu32, r.pid);
+    }
+    std::string program(r.program, strnlen(r.program, sizeof(r.program)));
+    std::string origin(r.origin, strnlen(r.origin, sizeof(r.origin)));
+    //Stamp the message with the time it was logged, not the time it was drained
+    Util::logFormat(logRingLines, Controller::isColorized, kind, program.c_str(), pid, origin.c_str(), message.c_str(), r.time / 1000);
+    Log(kind, message, true, r.time / 1000);
+  }
+
+  /// Stores and prints all messages currently in the log ring, with a single write.
+  /// \returns The amount of messages drained.
+  size_t drainLogRing(){
+    tthread::lock_guard<tthread::mutex> ringGuard(logRingMutex);
+    logRingLines.clear();
+    size_t count = LogRing::drain(logRingRecord);
+    if (logRingLines.size()){std::cout << logRingLines << std::flush;}
+    return count;
+  }
+
+  /// Thread that drains the log ring in batches until the controller shuts down.
+  /// Sleeps a little only when the ring was empty, so bursts are drained as fast as they come in.
+  void handleLogRing(void * config){
+    while (((Util::Config*)config)->is_active){
+      if (!drainLogRing()){Util::sleep(20);}
+    }
+  }
+
   /// Writes the current config to the location set in the configFile setting.
   /// On error, prints an error-level message and the config to stdout.
   void writeConfigToDisk(){
@@ -211,6 +407,72 @@ namespace Controller {
     }
   }
 
+  /// Adds a single url_match or url_prefix pattern of the given connector to the routing table, as record pos.
+  /// Does nothing but print a warning if pos has reached end.
+  static void addRoute(Util::RelAccX & routes, uint64_t & pos, uint64_t end, const std::string & connector, const std::string & pattern, bool isPrefix){
+    if (pos >= end){
+      WARN_MSG("No room left in the HTTP routing table for %s pattern %s", connector.c_str(), pattern.c_str());
+      return;
+    }
+    size_t found = pattern.find('$');
+    routes.setString("connector", connector, pos);
+    routes.setString("prefix", pattern.substr(0, found), pos);
+    routes.setString("suffix", found == std::string::npos ? "" : pattern.substr(found + 1), pos);
+    routes.setInt("flags", (isPrefix ? ROUTE_PREFIX : 0) | (found == std::string::npos ? 0 : ROUTE_CAPTURE), pos);
+    ++pos;
+  }
+
+  /// Compiles the url_match and url_prefix patterns of all HTTP-based connectors into a routing table on shared
+  /// memory, so MistOutHTTP can dispatch requests without locking and parsing the whole config.
+  /// The patterns are pre-split around their stream name placeholder, in the order they should be tried.
+  /// The table lives in the records from getDeleted() up to getEndPos(). A new table is written after the current
+  /// one, in the other half of the ring of records, and only then published by moving both positions past the old one.
+  static void writeRoutes(){
+    if (!shmRoutes){
+      shmRoutes = new IPC::sharedPage(SHM_ROUTES, SHM_ROUTES_SIZE, true);
+      if (!shmRoutes->mapped){
+        FAIL_MSG("Could not open HTTP routing table for writing");
+        delete shmRoutes;
+        shmRoutes = 0;
+        return;
+      }
+      rlxRoutes = new Util::RelAccX(shmRoutes->mapped, false);
+      if (!rlxRoutes->isReady()){
+        rlxRoutes->addField("connector", RAX_32STRING);
+        rlxRoutes->addField("prefix", RAX_128STRING);
+        rlxRoutes->addField("suffix", RAX_64STRING);
+        rlxRoutes->addField("flags", RAX_UINT);
+        rlxRoutes->setRCount((SHM_ROUTES_SIZE - rlxRoutes->getOffset()) / rlxRoutes->getRSize());
+        rlxRoutes->setReady();
+      }
+    }
+    Util::RelAccX & routes = *rlxRoutes;
+    uint64_t start = routes.getEndPos();
+    uint64_t count = start;
+    uint64_t end = start + routes.getRCount() / 2;
+    jsonForEach(capabilities["connectors"], it){
+      const JSON::Value & c = *it;
+      bool isHTTP = (c.isMember("name") && c["name"].asStringRef() == "HTTP");
+      bool needsHTTP = (c.isMember("deps") && c["deps"].asStringRef() == "HTTP");
+      if (!isHTTP && !needsHTTP){continue;}
+      const char * types[] = {"url_match", "url_prefix"};
+      for (unsigned int t = 0; t < 2; ++t){
+        if (!c.isMember(types[t])){continue;}
+        if (c[types[t]].isArray()){
+          jsonForEachConst(c[types[t]], pIt){addRoute(routes, count, end, it.key(), pIt->asStringRef(), t);}
+        }else if (c[types[t]].isString()){
+          addRoute(routes, count, end, it.key(), c[types[t]].asStringRef(), t);
+        }
+      }
+    }
+    //Readers check the start first: in between these two, they see the old routes followed by the new ones
+    __sync_synchronize();
+    routes.setEndPos(count);
+    __sync_synchronize();
+    routes.setDeleted(start);
+    INFO_MSG("HTTP routing table holds %llu routes", (unsigned long long)(count - start));
+  }
+
   /// Writes the current config to shared memory to be used in other processes
   void writeConfig(){
     static JSON::Value writeConf;
@@ -231,9 +493,12 @@ namespace Controller {
     if (writeConf["capabilities"] != capabilities){
       writeConf["capabilities"] = capabilities;
       VERYHIGH_MSG("Saving new config because of edit in capabilities");
+      writeRoutes();
       changed = true;
     }
     if (!changed){return;}//cancel further processing if no changes
+    //Lets outputs tell whether anything they derived from the config is still current
+    writeConf["version"] = (long long)Util::getMicros();
 
     static IPC::sharedPage mistConfOut(SHM_CONF, DEFAULT_CONF_PAGE_SIZE, true);
     if (!mistConfOut.mapped){
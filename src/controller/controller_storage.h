@@ -19,9 +19,15 @@ namespace Controller {
   Util::RelAccX * logAccessor();
   Util::RelAccX * accesslogAccessor();
   Util::RelAccX * streamsAccessor();
+  Util::RelAccX * pagesAccessor();
+  Util::RelAccX * metricsAccessor();
+  void notifyState();
+  uint64_t stateSequence();
+  uint64_t waitState(uint64_t seq);
 
   /// Store and print a log message.
   void Log(std::string kind, std::string message, bool noWriteToLog = false);
+  void Log(std::string kind, std::string message, bool noWriteToLog, uint64_t logTime);
   void logAccess(const std::string & sessId, const std::string & strm, const std::string & conn, const std::string & host, uint64_t duration, uint64_t up, uint64_t down, const std::string & tags);
 
   /// Write contents to Filename.
@@ -29,6 +35,8 @@ namespace Controller {
   void writeConfigToDisk();
   
   void handleMsg(void * err);
+  size_t drainLogRing();
+  void handleLogRing(void * config);
   void initState();
   void deinitState(bool leaveBehind);
   void writeConfig();
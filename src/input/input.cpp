@@ -5,6 +5,7 @@
 #include <mist/stream.h>
 #include <mist/defines.h>
 #include <mist/procs.h>
+#include <mist/metrics.h>
 #include <sys/wait.h>
 #include "input.h"
 #include <sstream>
@@ -21,6 +22,18 @@ namespace Mist {
       if (tid) {
         unsigned long keyNum = ((unsigned long)(data[i * 6 + 4]) << 8) | ((unsigned long)(data[i * 6 + 5]));
         bufferFrame(tid, keyNum + 1);//Try buffer next frame
+        //Remember where this viewer is and how fast it moves, so readAhead can load the pages it needs next
+        readAheadPos & pos = viewerPositions[std::make_pair(id, tid)];
+        //A viewer moving onto a page counts as a request for it; staying on it does not
+        if (!pos.lastSeen || keyNum != pos.keyNum){
+          unsigned long pageNum = pageForKey(tid, keyNum + 1);
+          if (pageNum && (!pos.lastSeen || pageNum != pageForKey(tid, pos.keyNum + 1)) && pageUsages[tid].count(pageNum)){
+            ++pageUsages[tid][pageNum].hits;
+          }
+        }
+        pos.keySpeed = (pos.lastSeen && keyNum > pos.keyNum ? keyNum - pos.keyNum : 0);
+        pos.keyNum = keyNum;
+        pos.lastSeen = Util::bootMS();
       }
     }
   }
@@ -28,6 +41,13 @@ namespace Mist {
   void Input::callbackWrapper(char * data, size_t len, unsigned int id){    
     singleton->userCallback(data, 30, id);//call the userCallback for this input
   }
+
+  /// Forgets the playback positions of a viewer whose user slot is being released,
+  /// so a new viewer that claims the same slot does not inherit them.
+  void Input::disconnectWrapper(char * data, size_t len, unsigned int id){
+    std::map<std::pair<unsigned int, unsigned long>, readAheadPos> & positions = singleton->viewerPositions;
+    positions.erase(positions.lower_bound(std::make_pair(id, 0ul)), positions.lower_bound(std::make_pair(id + 1, 0ul)));
+  }
   
   Input::Input(Util::Config * cfg) : InOutBase() {
     config = cfg;
@@ -64,6 +84,12 @@ namespace Mist {
     capa["optional"]["debug"]["type"] = "debug";
     
     packTime = 0;
+    residentBytes = 0;
+    loadCount = 0;
+    evictCount = 0;
+    pageBudget = 0;
+    pageBudgetTime = 0;
+    pageStatsRecord = 0;
     lastActive = Util::epoch();
     playing = 0;
     playUntil = 0;
@@ -95,6 +121,7 @@ namespace Mist {
   int Input::boot(int argc, char * argv[]){
     if (!(config->parseArgs(argc, argv))){return 1;}
     streamName = nProxy.streamName = config->getString("streamname");
+    LogRing::setStream(streamName);
    
     if (config->getBool("json")) {
       std::cout << capa.toString() << std::endl;
@@ -286,6 +313,15 @@ namespace Mist {
 
   /// The main loop for inputs in stream serving mode.
   void Input::serve(){
+    if (!isBuffer && concurrentPages()){
+      char semName[NAME_BUFFER_SIZE];
+      snprintf(semName, NAME_BUFFER_SIZE, SEM_PAGES, streamName.c_str());
+      pageLock.open(semName, O_CREAT | O_RDWR, ACCESSPERMS, 1);
+      //Start out unlocked, even if a previous input process died while holding the lock
+      if (pageLock && !pageLock.getVal()){pageLock.post();}
+      //Fork the workers now, while this process has no threads yet
+      if (pageLock){startPageWorkers();}
+    }
     if (!isBuffer){
       for (std::map<unsigned int,DTSC::Track>::iterator it = myMeta.tracks.begin(); it != myMeta.tracks.end(); it++){
         bufferFrame(it->first, 1);
@@ -302,9 +338,15 @@ namespace Mist {
     while (keepRunning()) {
       //load pages for connected clients on request
       //through the callbackWrapper function
-      userPage.parseEach(callbackWrapper);
+      userPage.parseEach(callbackWrapper, disconnectWrapper);
+      checkPageWorkers();
+      //load the pages viewers will need next, before they get there
+      bool readAheadDone = readAhead();
       //unload pages that haven't been used for a while
       removeUnused();
+      //and more if all inputs together use too much memory
+      if (!isBuffer){enforcePageBudget();}
+      Metrics::publish("MistIn" + capa["name"].asStringRef());
       //If users are connected and tracks exist, reset the activity counter
       //Also reset periodically if the stream is configured as Always on
       if (userPage.connectedUsers || ((Util::bootSecs() - activityCounter) > INPUT_TIMEOUT/2 && isAlwaysOn())) {
@@ -313,14 +355,20 @@ namespace Mist {
         }
       }
       INSANE_MSG("Connected: %d users, %d total", userPage.connectedUsers, userPage.amount);
-      //if not shutting down, wait 1 second before looping
-      if (config->is_active){
+      //if not shutting down and not behind on loading pages, wait 1 second before looping
+      if (config->is_active && readAheadDone){
         Util::wait(INPUT_USER_INTERVAL);
       }
     }
     if (streamStatus){streamStatus.mapped[0] = STRMSTAT_SHUTDOWN;}
     config->is_active = false;
     finish();
+    if (pageLock){
+      pageLock.unlink();
+      pageLock.close();
+    }
+    releasePageStats();
+    Metrics::publish("MistIn" + capa["name"].asStringRef());
     DEBUG_MSG(DLVL_DEVEL, "Input for stream %s closing clean", streamName.c_str());
     userPage.finishEach();
     //end player functionality
@@ -457,6 +505,8 @@ namespace Mist {
   }
 
   void Input::finish() {
+    //Let running page workers finish, so their pages are removed below
+    stopPageWorkers();
     for (std::map<unsigned int, std::map<unsigned int, unsigned int> >::iterator it = pageCounter.begin(); it != pageCounter.end(); it++) {
       for (std::map<unsigned int, unsigned int>::iterator it2 = it->second.begin(); it2 != it->second.end(); it2++) {
         it2->second = 1;
@@ -470,6 +520,193 @@ namespace Mist {
     }
   }
 
+  /// Loads the pages following each viewer's current page, so they are available before the viewer reaches them.
+  /// At least INPUT_READAHEAD_PAGES pages are loaded, more if needed to cover the amount of keys the viewer
+  /// played during the last two user intervals. Pages that are already loaded are kept loaded.
+  /// Stops loading new pages after spending INPUT_USER_INTERVAL milliseconds.
+  /// \returns True if all wanted pages are loaded, false if there is more to do.
+  bool Input::readAhead(){
+    uint64_t now = Util::bootMS();
+    std::map<std::pair<unsigned int, unsigned long>, readAheadPos>::iterator it = viewerPositions.begin();
+    while (it != viewerPositions.end()){
+      //Forget viewers that stopped reporting their position
+      if (now - it->second.lastSeen > 3 * INPUT_USER_INTERVAL){
+        viewerPositions.erase(it++);
+        continue;
+      }
+      unsigned long tid = it->first.second;
+      if (!nProxy.pagesByTrack.count(tid)){
+        ++it;
+        continue;
+      }
+      std::map<unsigned long, DTSCPageData> & pages = nProxy.pagesByTrack[tid];
+      unsigned long wantedKey = it->second.keyNum + 1 + 2 * it->second.keySpeed;
+      //Start at the page after the one holding the next key
+      std::map<unsigned long, DTSCPageData>::iterator pIt = pages.upper_bound(it->second.keyNum + 1);
+      for (unsigned int i = 0; pIt != pages.end() && (i < INPUT_READAHEAD_PAGES || pIt->first <= wantedKey); ++i, ++pIt){
+        if (Util::bootMS() - now > INPUT_USER_INTERVAL && !nProxy.isBuffered(tid, pIt->first)){return false;}
+        bufferFrame(tid, pIt->first);
+      }
+      ++it;
+    }
+    return true;
+  }
+
+  /// Returns the number of the page holding the given key of the given track, or 0 if there is none.
+  unsigned long Input::pageForKey(unsigned long track, unsigned long keyNum){
+    if (!nProxy.pagesByTrack.count(track)){return 0;}
+    std::map<unsigned long, DTSCPageData> & pages = nProxy.pagesByTrack[track];
+    std::map<unsigned long, DTSCPageData>::iterator it = pages.upper_bound(keyNum);
+    if (it == pages.begin()){return 0;}
+    return (--it)->first;
+  }
+
+  /// Keeps the given page loaded for another while, and records its usage.
+  /// Only actual loads count as a request here; viewers moving onto the page are counted by userCallback.
+  /// \param loaded Whether the page was just loaded.
+  /// \param loadTime If the page was just loaded, the time it took to load in milliseconds.
+  void Input::keepPage(unsigned int track, unsigned int pageNum, bool loaded, uint64_t loadTime){
+    pageCounter[track][pageNum] = 15;
+    std::map<unsigned int, pageUsage> & usages = pageUsages[track];
+    if (!usages.count(pageNum)){
+      residentBytes += nProxy.pagesByTrack[track][pageNum].dataSize;
+      ++loadCount;
+    }
+    pageUsage & usage = usages[pageNum];
+    usage.lastUsed = Util::bootMS();
+    if (loaded){
+      ++usage.hits;
+      usage.loadTime = loadTime;
+    }
+  }
+
+  /// Unloads the given page.
+  void Input::forgetPage(unsigned int track, unsigned int pageNum){
+    if (pageLock){
+      //Page workers may be registering pages on the same track index
+      IPC::semGuard guard(&pageLock);
+      bufferRemove(track, pageNum);
+    }else{
+      bufferRemove(track, pageNum);
+    }
+    pageCounter[track].erase(pageNum);
+    if (pageUsages[track].erase(pageNum)){
+      residentBytes -= nProxy.pagesByTrack[track][pageNum].dataSize;
+    }
+  }
+
+  /// Returns the server-wide VoD page memory budget in bytes, or 0 if there is none.
+  /// The configuration is only read once every INPUT_BUDGET_INTERVAL milliseconds.
+  uint64_t Input::getPageBudget(){
+    uint64_t now = Util::bootMS();
+    if (pageBudgetTime && now - pageBudgetTime < INPUT_BUDGET_INTERVAL){return pageBudget;}
+    pageBudgetTime = now;
+    IPC::sharedPage serverCfg(SHM_CONF, DEFAULT_CONF_PAGE_SIZE, false, false); ///< Contains server configuration and capabilities
+    if (!serverCfg.mapped){
+      pageBudget = 0;
+      return 0;
+    }
+    IPC::semaphore configLock(SEM_CONF, O_CREAT | O_RDWR, ACCESSPERMS, 1);
+    configLock.wait();
+    pageBudget = DTSC::Scan(serverCfg.mapped, serverCfg.len).getMember("config").getMember("vod_memory").asInt() * 1024 * 1024;
+    configLock.post();
+    return pageBudget;
+  }
+
+  /// Publishes our page counters on the controller's VoD page accounting page, claiming a record first if needed.
+  /// \returns False if the accounting page is not available.
+  bool Input::updatePageStats(){
+    if (pageStatsPage.mapped && (pageStats.isExit() || pageStats.getInt("pid", pageStatsRecord) != (uint64_t)getpid())){
+      //The controller restarted or released our record: start over
+      pageStatsPage.close();
+    }
+    if (!pageStatsPage.mapped){
+      pageStatsPage.init(SHM_STATE_PAGES, SHM_STATE_PAGES_SIZE, false, false);
+      if (!pageStatsPage.mapped){return false;}
+      pageStats = Util::RelAccX(pageStatsPage.mapped, false);
+      if (!pageStats.isReady()){
+        pageStatsPage.close();
+        return false;
+      }
+      IPC::semaphore pagesLock(SEM_STATE_PAGES, O_CREAT | O_RDWR, ACCESSPERMS, 1);
+      pagesLock.wait();
+      pageStatsRecord = pageStats.getEndPos();
+      for (uint64_t i = 0; i < pageStats.getEndPos(); ++i){
+        uint64_t pid = pageStats.getInt("pid", i);
+        if (!pid || !Util::Procs::isRunning(pid)){
+          pageStatsRecord = i;
+          pageStats.setInt("pid", getpid(), i);
+          pageStats.setString("stream", streamName, i);
+          break;
+        }
+      }
+      pagesLock.post();
+      if (pageStatsRecord == pageStats.getEndPos()){
+        WARN_MSG("No room left for VoD page accounting of stream %s", streamName.c_str());
+        pageStatsPage.close();
+        return false;
+      }
+    }
+    uint64_t pageCount = 0;
+    for (std::map<unsigned int, std::map<unsigned int, pageUsage> >::iterator it = pageUsages.begin(); it != pageUsages.end(); ++it){
+      pageCount += it->second.size();
+    }
+    pageStats.setInt("resident", residentBytes, pageStatsRecord);
+    pageStats.setInt("pages", pageCount, pageStatsRecord);
+    pageStats.setInt("loads", loadCount, pageStatsRecord);
+    pageStats.setInt("evictions", evictCount, pageStatsRecord);
+    return true;
+  }
+
+  /// Gives up our record on the controller's VoD page accounting page.
+  void Input::releasePageStats(){
+    if (!pageStatsPage.mapped){return;}
+    if (!pageStats.isExit() && pageStats.getInt("pid", pageStatsRecord) == (uint64_t)getpid()){
+      pageStats.setInt("resident", 0, pageStatsRecord);
+      pageStats.setInt("pages", 0, pageStatsRecord);
+      pageStats.setInt("pid", 0, pageStatsRecord);
+    }
+    pageStatsPage.close();
+  }
+
+  /// Evicts pages when all VoD inputs together use more page memory than the server-wide budget.
+  /// Every input frees a share of the excess proportional to its own usage. Pages are evicted
+  /// in order of least value first, where value grows with popularity (request count) and cost
+  /// to reload (load time), and decays with the time since the last request.
+  /// Pages requested during the last INPUT_EVICT_MIN_AGE milliseconds are never evicted.
+  void Input::enforcePageBudget(){
+    if (!updatePageStats()){return;}
+    uint64_t budget = getPageBudget();
+    if (!budget || !residentBytes){return;}
+    uint64_t total = 0;
+    for (uint64_t i = 0; i < pageStats.getEndPos(); ++i){
+      if (pageStats.getInt("pid", i)){total += pageStats.getInt("resident", i);}
+    }
+    if (total <= budget){return;}
+    uint64_t toFree = (total - budget) * residentBytes / total + 1;
+    uint64_t now = Util::bootMS();
+    std::multimap<double, std::pair<unsigned int, unsigned int> > candidates;
+    for (std::map<unsigned int, std::map<unsigned int, pageUsage> >::iterator it = pageUsages.begin(); it != pageUsages.end(); ++it){
+      for (std::map<unsigned int, pageUsage>::iterator it2 = it->second.begin(); it2 != it->second.end(); ++it2){
+        uint64_t age = now - it2->second.lastUsed;
+        if (age < INPUT_EVICT_MIN_AGE){continue;}
+        double value = (double)it2->second.hits * (it2->second.loadTime + 1) / (age / 1000 + 1);
+        candidates.insert(std::make_pair(value, std::make_pair(it->first, it2->first)));
+      }
+    }
+    uint64_t freed = 0;
+    for (std::multimap<double, std::pair<unsigned int, unsigned int> >::iterator it = candidates.begin(); it != candidates.end() && freed < toFree; ++it){
+      freed += nProxy.pagesByTrack[it->second.first][it->second.second].dataSize;
+      HIGH_MSG("Evicting page %u of track %u to stay within the VoD page memory budget", it->second.second, it->second.first);
+      forgetPage(it->second.first, it->second.second);
+      ++evictCount;
+    }
+    if (freed){
+      MEDIUM_MSG("Evicted %" PRIu64 " bytes of pages: server uses %" PRIu64 " of %" PRIu64 " bytes", freed, total, budget);
+      updatePageStats();
+    }
+  }
+
   void Input::removeUnused(){
     for (std::map<unsigned int, std::map<unsigned int, unsigned int> >::iterator it = pageCounter.begin(); it != pageCounter.end(); it++){
       for (std::map<unsigned int, unsigned int>::iterator it2 = it->second.begin(); it2 != it->second.end(); it2++){
@@ -480,8 +717,7 @@ namespace Mist {
         change = false;
         for (std::map<unsigned int, unsigned int>::iterator it2 = it->second.begin(); it2 != it->second.end(); it2++){
           if (!it2->second){
-            bufferRemove(it->first, it2->first);
-            pageCounter[it->first].erase(it2->first);
+            forgetPage(it->first, it2->first);
             change = true;
             break;
           }
@@ -643,7 +879,7 @@ namespace Mist {
           break;
         }
       }
-      pageCounter[track][pageNumber] = 15;
+      keepPage(track, pageNumber);
       VERYHIGH_MSG("Track %u, key %u is already buffered in page %d. Cancelling bufferFrame", track, keyNum, pageNumber); 
       return true;
     }
@@ -652,9 +888,189 @@ namespace Mist {
       return false;
     }
     //Update keynum to point to the corresponding page
-    uint64_t bufferTimer = Util::bootMS();
     MEDIUM_MSG("Loading key %u from page %lu", keyNum, (--(nProxy.pagesByTrack[track].upper_bound(keyNum)))->first);
     keyNum = (--(nProxy.pagesByTrack[track].upper_bound(keyNum)))->first;
+    if (pageWorkers.size()){
+      return requestPage(track, keyNum);
+    }
+    uint64_t loadStart = Util::bootMS();
+    if (!loadPage(track, keyNum)){return false;}
+    keepPage(track, keyNum, true, Util::bootMS() - loadStart);
+    return true;
+  }
+
+  /// Forks INPUT_PAGE_WORKERS page worker processes.
+  /// Must be called before this process starts any threads, since the workers keep running the code of this process.
+  /// All tracks are negotiated here first, so the workers share the resulting track index pages.
+  void Input::startPageWorkers(){
+    if (!nProxy.metaPages.count(0)){initiateMeta();}
+    for (std::map<unsigned int, DTSC::Track>::iterator it = myMeta.tracks.begin(); it != myMeta.tracks.end(); it++){
+      if (standAlone && !nProxy.trackMap.count(it->first)){nProxy.trackMap[it->first] = it->first;}
+      continueNegotiate(it->first);
+    }
+    for (unsigned int i = 0; i < INPUT_PAGE_WORKERS; ++i){
+      int request[2], result[2];
+      if (pipe(request)){break;}
+      if (pipe(result)){
+        close(request[0]);
+        close(request[1]);
+        break;
+      }
+      pid_t pid = fork();
+      if (pid == 0){
+        close(request[1]);
+        close(result[0]);
+        runPageWorker(request[0], result[1]);
+      }
+      close(request[0]);
+      close(result[1]);
+      if (pid == -1){
+        FAIL_MSG("Unable to start page worker");
+        close(request[1]);
+        close(result[0]);
+        break;
+      }
+      fcntl(result[0], F_SETFL, fcntl(result[0], F_GETFL) | O_NONBLOCK);
+      pageWorker worker;
+      worker.pid = pid;
+      worker.request = request[1];
+      worker.result = result[0];
+      worker.track = 0;
+      worker.pageNum = 0;
+      worker.startTime = 0;
+      pageWorkers.push_back(worker);
+    }
+    if (!pageWorkers.size()){WARN_MSG("No page workers available, loading pages directly");}
+  }
+
+  /// Main loop of a page worker process: loads the pages requested on the request pipe, and reports
+  /// on the result pipe whether that worked. Exits when the request pipe is closed.
+  void Input::runPageWorker(int request, int result){
+    //Skip all destructors: they belong to the main input process
+    for (std::vector<pageWorker>::iterator it = pageWorkers.begin(); it != pageWorkers.end(); ++it){
+      close(it->request);
+      close(it->result);
+    }
+    pageWorkers.clear();
+    Metrics::reset();
+    if (!openPageWorker()){_exit(1);}
+    while (true){
+      uint32_t req[2];
+      ssize_t r = read(request, req, sizeof(req));
+      if (r == -1 && errno == EINTR){continue;}
+      if (r != sizeof(req)){break;}
+      char loaded = loadPage(req[0], req[1]) ? 1 : 0;
+      Metrics::publish("MistIn" + capa["name"].asStringRef());
+      if (write(result, &loaded, 1) != 1){break;}
+    }
+    _exit(0);
+  }
+
+  /// Hands the given page to an idle page worker, unless a worker is already loading it.
+  /// Blocks while all workers are busy.
+  bool Input::requestPage(unsigned int track, unsigned int pageNum){
+    checkPageWorkers();
+    for (std::vector<pageWorker>::iterator it = pageWorkers.begin(); it != pageWorkers.end(); ++it){
+      if (it->track == track && it->pageNum == pageNum){
+        VERYHIGH_MSG("Track %u, page %u is already being loaded", track, pageNum);
+        return true;
+      }
+    }
+    if (nProxy.trackState[track] != FILL_ACC){
+      WARN_MSG("Track %u not accepted! Cancelling bufferFrame", track);
+      return false;
+    }
+    pageWorker * idle = 0;
+    while (!idle && config->is_active){
+      for (std::vector<pageWorker>::iterator it = pageWorkers.begin(); it != pageWorkers.end(); ++it){
+        if (!it->track){
+          idle = &*it;
+          break;
+        }
+      }
+      if (!idle){
+        if (!pageWorkers.size()){break;}
+        Util::sleep(5);
+        checkPageWorkers();
+      }
+    }
+    if (!idle){
+      //Shutting down, or all workers are gone
+      uint64_t loadStart = Util::bootMS();
+      if (!loadPage(track, pageNum)){return false;}
+      keepPage(track, pageNum, true, Util::bootMS() - loadStart);
+      return true;
+    }
+    uint32_t req[2] = {track, pageNum};
+    if (write(idle->request, req, sizeof(req)) != sizeof(req)){
+      FAIL_MSG("Unable to request page %u of track %u from page worker %d", pageNum, track, idle->pid);
+      return false;
+    }
+    idle->track = track;
+    idle->pageNum = pageNum;
+    idle->startTime = Util::bootMS();
+    return true;
+  }
+
+  /// Collects the results of busy page workers, and keeps the pages they loaded.
+  /// Workers that exited are forgotten; they are not replaced since this process may have threads by now.
+  void Input::checkPageWorkers(){
+    std::vector<pageWorker>::iterator it = pageWorkers.begin();
+    while (it != pageWorkers.end()){
+      if (!it->track){
+        ++it;
+        continue;
+      }
+      char loaded = 0;
+      ssize_t r = read(it->result, &loaded, 1);
+      if (r == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)){
+        ++it;
+        continue;
+      }
+      if (r == 1 && loaded && nProxy.isBuffered(it->track, it->pageNum)){
+        keepPage(it->track, it->pageNum, true, Util::bootMS() - it->startTime);
+      }else{
+        WARN_MSG("Page worker for track %u, page %u failed", it->track, it->pageNum);
+      }
+      it->track = 0;
+      if (r == 1){
+        ++it;
+        continue;
+      }
+      //The worker is gone
+      close(it->request);
+      close(it->result);
+      Util::Procs::childRunning(it->pid);
+      it = pageWorkers.erase(it);
+    }
+  }
+
+  /// Waits up to 10 seconds for busy page workers to finish, then tells all workers to exit.
+  void Input::stopPageWorkers(){
+    uint64_t workerTimeout = Util::bootMS() + 10000;
+    bool busy = true;
+    while (busy && Util::bootMS() < workerTimeout){
+      checkPageWorkers();
+      busy = false;
+      for (std::vector<pageWorker>::iterator it = pageWorkers.begin(); it != pageWorkers.end(); ++it){
+        if (it->track){busy = true;}
+      }
+      if (busy){Util::sleep(5);}
+    }
+    for (std::vector<pageWorker>::iterator it = pageWorkers.begin(); it != pageWorkers.end(); ++it){
+      //Closing the request pipe makes the worker exit once it finished its current page
+      close(it->request);
+      close(it->result);
+      if (it->track){Util::Procs::Stop(it->pid);}
+      waitpid(it->pid, 0, 0);
+    }
+    pageWorkers.clear();
+  }
+
+  /// Loads the given page of the given track into memory, from the current process.
+  bool Input::loadPage(unsigned int track, unsigned int keyNum){
+    uint64_t bufferTimer = Util::bootMS();
+    uint64_t loadStart = Util::getMicros();
     if (!bufferStart(track, keyNum)){
       WARN_MSG("bufferStart failed! Cancelling bufferFrame");
       return false;
@@ -688,10 +1104,16 @@ namespace Mist {
       }
       getNext();
     }
-    bufferFinalize(track);
+    if (pageLock){
+      //Other workers may be registering pages on the same track index
+      IPC::semGuard guard(&pageLock);
+      bufferFinalize(track);
+    }else{
+      bufferFinalize(track);
+    }
+    Metrics::record(Metrics::BUFFER_FRAME, Util::getMicros(loadStart));
     bufferTimer = Util::bootMS() - bufferTimer;
     DEBUG_MSG(DLVL_DEVEL, "Done buffering page %d (%llu packets, %llu bytes, %llu-%llums -> %llums) for track %d (%s) in %llums", keyNum, packCounter, byteCounter, myMeta.tracks[track].keys[keyNum - 1].getTime(), stopTime, lastBuffered, track, myMeta.tracks[track].codec.c_str(), bufferTimer);
-    pageCounter[track][keyNum] = 15;
     return true;
   }
   
@@ -1,11 +1,13 @@
 #include <set>
 #include <map>
+#include <vector>
 #include <cstdlib>
 #include <mist/config.h>
 #include <mist/json.h>
 #include <mist/timing.h>
 #include <mist/dtsc.h>
 #include <mist/shared_memory.h>
+#include <mist/util.h>
 
 #include "../io.h"
 
@@ -16,6 +18,30 @@ namespace Mist {
     int curPart;
   };
 
+  /// Playback position of a single viewer on a single track, used to load pages ahead of time.
+  struct readAheadPos {
+    unsigned long keyNum;///< Last key number the viewer reported.
+    unsigned long keySpeed;///< Amount of keys the viewer advanced between its last two reports.
+    uint64_t lastSeen;///< Time (in ms) of the last report.
+  };
+
+  /// A forked process loading pages on request.
+  struct pageWorker {
+    pid_t pid;
+    int request;///< Write end of the pipe the worker reads page requests from.
+    int result;///< Read end of the pipe the worker reports loaded pages on.
+    unsigned int track;///< Track of the page being loaded, or 0 if the worker is idle.
+    unsigned int pageNum;///< Page being loaded.
+    uint64_t startTime;///< Time (in ms) the worker was handed its page.
+  };
+
+  /// Usage of a single loaded VoD page, used to pick pages to evict when over the page memory budget.
+  struct pageUsage {
+    uint64_t lastUsed;///< Time (in ms) the page was last requested.
+    uint64_t hits;///< Amount of times the page was requested.
+    uint64_t loadTime;///< Time (in ms) it took to load the page.
+  };
+
   class Input : public InOutBase {
     public:
       Input(Util::Config * cfg);
@@ -30,11 +56,18 @@ namespace Mist {
 
     protected:
       static void callbackWrapper(char * data, size_t len, unsigned int id);
+      static void disconnectWrapper(char * data, size_t len, unsigned int id);
       virtual bool checkArguments() = 0;
       virtual bool readHeader() = 0;
       virtual bool needHeader(){return !readExistingHeader();}
       virtual bool preRun(){return true;}
       virtual bool isSingular(){return true;}
+      /// Whether pages may be loaded by forked worker processes, concurrently.
+      /// Inputs that return true must make sure a worker can seek and read without affecting
+      /// other workers, either by not sharing a file position or by re-opening in openPageWorker.
+      virtual bool concurrentPages(){return false;}
+      /// Called in a freshly forked page worker, before it loads its first page.
+      virtual bool openPageWorker(){return true;}
       virtual bool readExistingHeader();
       virtual bool atKeyFrame();
       virtual void getNext(bool smart = true) {}
@@ -49,6 +82,14 @@ namespace Mist {
       void quitPlay();
       void checkHeaderTimes(std::string streamFile);
       virtual void removeUnused();
+      bool readAhead();
+      unsigned long pageForKey(unsigned long track, unsigned long keyNum);
+      void keepPage(unsigned int track, unsigned int pageNum, bool loaded = false, uint64_t loadTime = 0);
+      void forgetPage(unsigned int track, unsigned int pageNum);
+      void enforcePageBudget();
+      uint64_t getPageBudget();
+      bool updatePageStats();
+      void releasePageStats();
       virtual void trackSelect(std::string trackSpec);
       virtual void userCallback(char * data, size_t len, unsigned int id);
       virtual void convert();
@@ -59,6 +100,12 @@ namespace Mist {
 
       virtual void parseHeader();
       bool bufferFrame(unsigned int track, unsigned int keyNum);
+      bool loadPage(unsigned int track, unsigned int pageNum);
+      void startPageWorkers();
+      void runPageWorker(int request, int result);
+      bool requestPage(unsigned int track, unsigned int pageNum);
+      void checkPageWorkers();
+      void stopPageWorkers();
 
       unsigned int packTime;///Media-timestamp of the last packet.
       int lastActive;///Timestamp of the last time we received or sent something.
@@ -78,6 +125,18 @@ namespace Mist {
       IPC::sharedPage streamStatus;
 
       std::map<unsigned int, std::map<unsigned int, unsigned int> > pageCounter;
+      std::map<std::pair<unsigned int, unsigned long>, readAheadPos> viewerPositions;///< Positions by user slot and track, erased when the slot is released.
+      std::vector<pageWorker> pageWorkers;///< Page worker processes, forked before serving starts.
+      std::map<unsigned int, std::map<unsigned int, pageUsage> > pageUsages;///< Usage of loaded pages, by track and page number.
+      uint64_t residentBytes;///< Total size of all loaded pages.
+      uint64_t loadCount;///< Amount of pages loaded so far.
+      uint64_t evictCount;///< Amount of pages evicted to stay within the page memory budget so far.
+      uint64_t pageBudget;///< Server-wide page memory budget in bytes, as last read by getPageBudget.
+      uint64_t pageBudgetTime;///< Time (in ms) getPageBudget last read the budget from the configuration.
+      IPC::sharedPage pageStatsPage;///< Server-wide VoD page accounting, managed by the controller.
+      Util::RelAccX pageStats;///< Accessor for pageStatsPage.
+      uint64_t pageStatsRecord;///< The record on pageStatsPage claimed by this input.
+      IPC::semaphore pageLock;///< Serializes page workers writing to the track index pages.
 
       static Input * singleton;
   };
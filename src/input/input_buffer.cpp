@@ -10,6 +10,7 @@
 #include <mist/stream.h>
 #include <mist/defines.h>
 #include <mist/bitfields.h>
+#include <mist/metrics.h>
 
 #include "input_buffer.h"
 
@@ -112,7 +113,7 @@ namespace Mist {
     streamName = config->getString("streamname");
     char pageName[NAME_BUFFER_SIZE];
 
-    //Set userpage to all 0xFF's, will disconnect all current clients.
+    //Close the user pages and mark every claimed slot as disconnecting, will disconnect all current clients.
     snprintf(pageName, NAME_BUFFER_SIZE, SHM_USERS, streamName.c_str());
     std::string baseName = pageName;
     for (long unsigned i = 0; i < 15; ++i){
@@ -121,7 +122,7 @@ namespace Mist {
       if (tmp.mapped){
         tmp.master = true;
         WARN_MSG("Wiping %s", std::string(baseName + (char)(i + (int)'A')).c_str());
-        memset(tmp.mapped, 0xFF, size);
+        IPC::sharedServer::disconnectAll(tmp.mapped, tmp.len, PLAY_EX_SIZE);
       }
     }
     //Delete the live stream semaphore, if any.
@@ -197,7 +198,11 @@ namespace Mist {
       snprintf(liveSemName, NAME_BUFFER_SIZE, SEM_LIVE, streamName.c_str());
       liveMeta = new IPC::semaphore(liveSemName, O_CREAT | O_RDWR, ACCESSPERMS, 1);
     }
-    liveMeta->wait();
+    Metrics::timer metaTimer(Metrics::META_UPDATE);
+    {
+      Metrics::timer waitTimer(Metrics::LIVE_WAIT);
+      liveMeta->wait();
+    }
 
     if (!nProxy.metaPages.count(0) || !nProxy.metaPages[0].mapped) {
       char pageName[NAME_BUFFER_SIZE];
@@ -46,6 +46,11 @@ namespace Mist {
     return config->getString("input").substr(0, 7) != "dtsc://" && config->getString("input") != "-";
   }
 
+  /// DTSC::File reads without a shared file position, so page workers can use it as-is.
+  bool inputDTSC::concurrentPages(){
+    return needsLock();
+  }
+
   void parseDTSCURI(const std::string & src, std::string & host, uint16_t & port, std::string & password, std::string & streamName) {
     host = "";
     port = 4200;
@@ -167,6 +172,7 @@ namespace Mist {
     prep["cmd"] = "play";
     prep["version"] = "MistServer " PACKAGE_VERSION;
     prep["stream"] = streamName;
+    if (password.size()){prep["password"] = password;}
     srcConn.SendNow("DTCM");
     char sSize[4] = {0, 0, 0, 0};
     Bit::htobl(sSize, prep.packedSize());
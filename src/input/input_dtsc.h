@@ -7,6 +7,7 @@ namespace Mist {
       inputDTSC(Util::Config * cfg);
       bool needsLock();
     protected:
+      bool concurrentPages();
       //Private Functions
       bool openStreamSource();
       void closeStreamSource();
@@ -48,8 +48,7 @@ namespace Mist {
     
   bool inputFLV::preRun() {
     //open File
-    inFile = fopen(config->getString("input").c_str(), "r");
-    if (!inFile) {
+    if (!inFile.open(config->getString("input"))) {
       return false;
     }
     struct stat statData;
@@ -77,20 +76,17 @@ namespace Mist {
   }
 
   bool inputFLV::readHeader() {
-    if (!inFile){return false;}
     //Create header file from FLV data
-    Util::fseek(inFile, 13, SEEK_SET);
+    inFile.seek(13);
     AMF::Object amf_storage;
     long long int lastBytePos = 13;
     uint64_t bench = Util::getMicros();
-    while (!feof(inFile) && !FLV::Parse_Error){
-      if (tmpTag.FileLoader(inFile)){
-        tmpTag.toMeta(myMeta, amf_storage);
-        if (!tmpTag.getDataLen()){continue;}
-        if (tmpTag.needsInitData() && tmpTag.isInitData()){continue;}
-        myMeta.update(tmpTag.tagTime(), tmpTag.offset(), tmpTag.getTrackID(), tmpTag.getDataLen(), lastBytePos, tmpTag.isKeyframe);
-        lastBytePos = Util::ftell(inFile);
-      }
+    while (!FLV::Parse_Error && inFile.readTag(tmpTag)){
+      tmpTag.toMeta(myMeta, amf_storage);
+      if (!tmpTag.getDataLen()){continue;}
+      if (tmpTag.needsInitData() && tmpTag.isInitData()){continue;}
+      myMeta.update(tmpTag.tagTime(), tmpTag.offset(), tmpTag.getTrackID(), tmpTag.getDataLen(), lastBytePos, tmpTag.isKeyframe);
+      lastBytePos = inFile.getPos();
     }
     bench = Util::getMicros(bench);
     INFO_MSG("Header generated in %llu ms: @%lld, %s, %s", bench/1000, lastBytePos, myMeta.vod?"VoD":"NOVoD", myMeta.live?"Live":"NOLive");
@@ -103,23 +99,23 @@ namespace Mist {
   }
   
   void inputFLV::getNext(bool smart) {
-    long long int lastBytePos = Util::ftell(inFile);
     if (selectedTracks.size() == 1){
       uint8_t targetTag = 0x08;
       if (selectedTracks.count(1)){targetTag = 0x09;}
       if (selectedTracks.count(3)){targetTag = 0x12;}
-      FLV::seekToTagType(inFile, targetTag);
-    }
-    while (!feof(inFile) && !FLV::Parse_Error){
-      if (tmpTag.FileLoader(inFile)){
-        if ( !selectedTracks.count(tmpTag.getTrackID())){
-          lastBytePos = Util::ftell(inFile);
-          continue;
-        }
-        break;
+      inFile.seekToTagType(targetTag);
+    }
+    long long int lastBytePos = inFile.getPos();
+    bool found = false;
+    while (!FLV::Parse_Error && inFile.readTag(tmpTag)){
+      if (!selectedTracks.count(tmpTag.getTrackID())){
+        lastBytePos = inFile.getPos();
+        continue;
       }
+      found = true;
+      break;
     }
-    if (feof(inFile)){
+    if (!found && !FLV::Parse_Error){
       thisPacket.null();
       return;
     }
@@ -158,7 +154,7 @@ namespace Mist {
       }
       seekPos = myMeta.tracks[trackSeek].keys[i].getBpos();
     }
-    Util::fseek(inFile, seekPos, SEEK_SET);
+    inFile.seek(seekPos);
   }
 
   void inputFLV::trackSelect(std::string trackSpec) {
@@ -10,6 +10,7 @@ namespace Mist {
       //Private Functions
       bool checkArguments();
       bool preRun();
+      bool concurrentPages(){return true;}
       bool readHeader();
       void getNext(bool smart = true);
       void seek(int seekTime);
@@ -17,7 +18,7 @@ namespace Mist {
       bool keepRunning();
       FLV::Tag tmpTag;
       uint64_t lastModTime;
-      FILE * inFile;
+      FLV::BlockReader inFile;
   };
 }
 
@@ -49,6 +49,13 @@ namespace Mist {
     return true;
   }
 
+  /// Opens the file again, so this page worker does not move the file position of other workers.
+  /// The inherited handle is deliberately not closed, as that may reposition the shared descriptor.
+  bool inputMP3::openPageWorker(){
+    inFile = fopen(config->getString("input").c_str(), "r");
+    return inFile;
+  }
+
   bool inputMP3::readHeader() {
     if (!inFile){return false;}
     myMeta = DTSC::Meta();
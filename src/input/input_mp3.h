@@ -18,6 +18,8 @@ namespace Mist {
       //Private Functions
       bool checkArguments();
       bool preRun();
+      bool concurrentPages(){return true;}
+      bool openPageWorker();
       bool readHeader();
       void getNext(bool smart = true);
       void seek(int seekTime);
@@ -264,6 +264,31 @@ namespace Mist {
     return 0;
   }
 
+  ///Returns the size to allocate for the next live data page of a track.
+  ///
+  ///The page is sized to hold FLIP_TARGET_DURATION plus two keyframe intervals at the measured bitrate, with 100% headroom.
+  ///Tracks without a measured bitrate get DEFAULT_DATA_PAGE_SIZE, except metadata tracks, which get MIN_DATA_PAGE_SIZE.
+  ///\param tid The trackid of the page to size
+  unsigned long long negotiationProxy::livePageSize(unsigned long tid, DTSC::Meta & myMeta) {
+    DTSC::Track & trk = myMeta.tracks[tid];
+    unsigned long long byteRate = std::max(trk.bps, trk.max_bps);
+    if (!byteRate){
+      if (trk.type == "meta"){return MIN_DATA_PAGE_SIZE;}
+      return DEFAULT_DATA_PAGE_SIZE;
+    }
+    unsigned long long keyInterval = AUDIO_KEY_INTERVAL;
+    if (trk.type == "video" && trk.keys.size() > 1){
+      keyInterval = (trk.keys.rbegin()->getTime() - trk.keys.begin()->getTime()) / (trk.keys.size() - 1);
+    }
+    unsigned long long pageSize = 2 * byteRate * (FLIP_TARGET_DURATION + 2 * keyInterval) / 1000;
+    //Round up to a whole 64KiB, and keep within the min/max page sizes
+    pageSize = (pageSize + 0xFFFF) & ~0xFFFFull;
+    pageSize = std::max(pageSize, (unsigned long long)(MIN_DATA_PAGE_SIZE));
+    pageSize = std::min(pageSize, (unsigned long long)(DEFAULT_DATA_PAGE_SIZE));
+    VERYHIGH_MSG("Sizing next page for %s track %lu at %llu bytes (%llu Bps, %llums keys)", trk.type.c_str(), tid, pageSize, byteRate, keyInterval);
+    return pageSize;
+  }
+
   ///Buffers the next packet on the currently opened page
   ///\param pack The packet to buffer
   void InOutBase::bufferNext(const DTSC::Packet & pack) {
@@ -476,18 +501,18 @@ namespace Mist {
       //If there is no page, create it
       if (!pagesByTrack.count(tid) || pagesByTrack[tid].size() == 0) {
         nextPageNum = 1;
-        pagesByTrack[tid][1].dataSize = DEFAULT_DATA_PAGE_SIZE;//Initialize op 25mb
+        pagesByTrack[tid][1].dataSize = livePageSize(tid, myMeta);
         pagesByTrack[tid][1].pageNum = 1;
         pagesByTrack[tid][1].firstTime = packet.getTime();
       }
       //Take the last allocated page
       std::map<unsigned long, DTSCPageData>::reverse_iterator tmpIt = pagesByTrack[tid].rbegin();
-      //Compare on 8 mb boundary
-      if (tmpIt->second.curOffset > FLIP_DATA_PAGE_SIZE || packet.getTime() - tmpIt->second.firstTime > FLIP_TARGET_DURATION) { 
+      //Compare on 8 mb boundary, or half the page for pages that were sized smaller
+      if (tmpIt->second.curOffset > FLIP_DATA_PAGE_SIZE || tmpIt->second.curOffset > tmpIt->second.dataSize / 2 || packet.getTime() - tmpIt->second.firstTime > FLIP_TARGET_DURATION) { 
         //Create the book keeping data for the new page
         nextPageNum = tmpIt->second.pageNum + tmpIt->second.keyNum;
         HIGH_MSG("We should go to next page now, transition from %lu to %d", tmpIt->second.pageNum, nextPageNum);
-        pagesByTrack[tid][nextPageNum].dataSize = DEFAULT_DATA_PAGE_SIZE;
+        pagesByTrack[tid][nextPageNum].dataSize = livePageSize(tid, myMeta);
         pagesByTrack[tid][nextPageNum].pageNum = nextPageNum;
         pagesByTrack[tid][nextPageNum].firstTime = packet.getTime();
       }
@@ -36,6 +36,7 @@ namespace Mist {
       void bufferSinglePacket(const DTSC::Packet & packet, DTSC::Meta & myMeta);
       bool isBuffered(unsigned long tid, unsigned long keyNum);
       unsigned long bufferedOnPage(unsigned long tid, unsigned long keyNum);
+      unsigned long long livePageSize(unsigned long tid, DTSC::Meta & myMeta);
 
 
 
@@ -2,6 +2,7 @@
 #include <mist/config.h>
 #include <mist/socket.h>
 #include <mist/defines.h>
+#include <mist/fanout.h>
 #include <mist/util.h>
 
 int spawnForked(Socket::Connection & S){
@@ -19,6 +20,12 @@ int main(int argc, char * argv[]) {
       return -1;
     }
     conf.activate();
+    if (conf.hasOption("fanouthub") && conf.getBool("fanouthub")){
+      FanOut::Hub hub(FanOut::hubPath(mistOut::capa["name"].asStringRef(), conf.getString("streamname")));
+      if (!hub.connected()){return 0;}
+      mistOut tmp(hub);
+      return tmp.runFanOut(hub);
+    }
     if (mistOut::listenMode()){
       mistOut::listener(conf, spawnForked);
     }else{
@@ -12,6 +12,8 @@
 #include <mist/http_parser.h>
 #include <mist/timing.h>
 #include <mist/util.h>
+#include <mist/metrics.h>
+#include <mist/procs.h>
 #include "output.h"
 
 namespace Mist{
@@ -26,6 +28,15 @@ namespace Mist{
     return Bit::btohll(mapped + offset + 12);
   }
 
+  /// Exchanges the mappings of two shared pages, without unmapping or re-opening either of them.
+  static void swapPages(IPC::sharedPage & a, IPC::sharedPage & b){
+    std::swap(a.handle, b.handle);
+    std::swap(a.name, b.name);
+    std::swap(a.len, b.len);
+    std::swap(a.master, b.master);
+    std::swap(a.mapped, b.mapped);
+  }
+
   void Output::init(Util::Config * cfg){
     capa["optional"]["debug"]["name"] = "debug";
     capa["optional"]["debug"]["help"] = "The debug level at which messages need to be printed.";
@@ -38,6 +49,12 @@ namespace Mist{
     option["help"] = "Do not start input if not already started";
     option["value"].append(0ll);
     cfg->addOption("noinput", option);
+
+    option.null();
+    option["long"] = "fanouthub";
+    option["help"] = "Serve all viewers handed over by other processes of this protocol for the stream, instead of a connection";
+    option["value"].append(0ll);
+    cfg->addOption("fanouthub", option);
   }
   
   void Output::bufferLivePacket(const DTSC::Packet & packet){
@@ -54,6 +71,7 @@ namespace Mist{
   }
   
   Output::Output(Socket::Connection & conn) : myConn(conn){
+    pageCacheClock = 0;
     pushing = false;
     pushIsOngoing = false;
     firstTime = 0;
@@ -61,9 +79,11 @@ namespace Mist{
     parseData = false;
     wantRequest = true;
     sought = false;
+    fanOutHub = 0;
     isInitialized = false;
     isBlocking = false;
     needsLookAhead = 0;
+    liveWait = 250;
     lastStats = 0;
     maxSkipAhead = 7500;
     realTime = 1000;
@@ -102,12 +122,14 @@ namespace Mist{
     }
     //read metadata from page to myMeta variable
     if (nProxy.metaPages[0].mapped){
+      Metrics::timer metaTimer(Metrics::META_UPDATE);
       IPC::semaphore * liveSem = 0;
       if (!myMeta.vod){
         static char liveSemName[NAME_BUFFER_SIZE];
         snprintf(liveSemName, NAME_BUFFER_SIZE, SEM_LIVE, streamName.c_str());
         liveSem = new IPC::semaphore(liveSemName, O_RDWR, ACCESSPERMS, 1, !myMeta.live);
         if (*liveSem){
+          Metrics::timer waitTimer(Metrics::LIVE_WAIT);
           liveSem->wait();
         }else{
           delete liveSem;
@@ -203,6 +225,7 @@ namespace Mist{
     isInitialized = false;
     myMeta.reset();
     nProxy.metaPages.clear();
+    pageCache.clear();
   }
 
   /// Connects or reconnects to the stream.
@@ -228,6 +251,7 @@ namespace Mist{
     }
     disconnect();
     nProxy.streamName = streamName;
+    LogRing::setStream(streamName);
     char userPageName[NAME_BUFFER_SIZE];
     snprintf(userPageName, NAME_BUFFER_SIZE, SHM_USERS, streamName.c_str());
     unsigned int attempts = 0;
@@ -248,7 +272,8 @@ namespace Mist{
       return;
     }
     isInitialized = true;
-    statsPage = IPC::sharedClient(SHM_STATISTICS, STAT_EX_SIZE, true);
+    //A hub reports its viewers itself, and is no viewer of its own
+    if (!fanOutHub){statsPage = IPC::sharedClient(SHM_STATISTICS, STAT_EX_SIZE, true);}
     stats(true);
     updateMeta();
     selectDefaultTracks();
@@ -487,6 +512,7 @@ namespace Mist{
   /// Overwrites any existing page for the same trackId.
   /// Automatically calls thisPacket.null() if necessary.
   void Output::loadPageForKey(long unsigned int trackId, long long int keyNum){
+    onPageLeave(trackId);
     if (!myMeta.tracks.count(trackId) || !myMeta.tracks[trackId].keys.size()){
       WARN_MSG("Load for track %lu key %lld aborted - track is empty", trackId, keyNum);
       return;
@@ -499,6 +525,7 @@ namespace Mist{
     }
     VERYHIGH_MSG("Loading track %lu, containing key %lld", trackId, keyNum);
     unsigned int timeout = 0;
+    uint64_t waitStart = Util::getMicros();
     unsigned long pageNum = pageNumForKey(trackId, keyNum);
     while (keepGoing() && pageNum == -1){
       if (!timeout){
@@ -512,6 +539,7 @@ namespace Mist{
       }
       if (timeout > 100){
         FAIL_MSG("Timeout while waiting for requested page %lld for track %lu. Aborting.", keyNum, trackId);
+        Metrics::record(Metrics::PAGE_WAIT, Util::getMicros(waitStart));
         nProxy.curPage.erase(trackId);
         currKeyOpen.erase(trackId);
         return;
@@ -525,6 +553,7 @@ namespace Mist{
       Util::wait(100);
       pageNum = pageNumForKey(trackId, keyNum);
     }
+    Metrics::record(Metrics::PAGE_WAIT, Util::getMicros(waitStart));
     
     if (!keepGoing()){
       return;
@@ -546,7 +575,29 @@ namespace Mist{
     }
     char id[NAME_BUFFER_SIZE];
     snprintf(id, NAME_BUFFER_SIZE, SHM_TRACK_DATA, streamName.c_str(), trackId, pageNum);
-    nProxy.curPage[trackId].init(id, DEFAULT_DATA_PAGE_SIZE);
+    std::map<unsigned long, cachedPage> & trkCache = pageCache[trackId];
+    //Keep the page we are leaving mapped, so going back to it later needs no syscalls
+    if (currKeyOpen.count(trackId) && nProxy.curPage.count(trackId) && nProxy.curPage[trackId].mapped){
+      cachedPage & leaving = trkCache[currKeyOpen[trackId]];
+      swapPages(nProxy.curPage[trackId], leaving.page);
+      leaving.lastUse = ++pageCacheClock;
+    }
+    //Re-use the cached mapping if we have one, unless the input deleted that page in the mean time
+    if (trkCache.count(pageNum) && trkCache[pageNum].page.mapped && trkCache[pageNum].page.exists()){
+      swapPages(nProxy.curPage[trackId], trkCache[pageNum].page);
+      trkCache.erase(pageNum);
+      VERYHIGH_MSG("Page %s re-used from cache for %s", id, streamName.c_str());
+    }else{
+      trkCache.erase(pageNum);
+      nProxy.curPage[trackId].init(id, DEFAULT_DATA_PAGE_SIZE);
+#ifdef SHM_HUGEPAGES
+      //VoD pages are completely written before they are announced, so they are safe to pre-fault in one go
+      if (!myMeta.live){
+        nProxy.curPage[trackId].populate();
+      }
+#endif
+    }
+    prunePageCache(trackId);
     if (!(nProxy.curPage[trackId].mapped)){
       FAIL_MSG("Initializing page %s failed", nProxy.curPage[trackId].name.c_str());
       currKeyOpen.erase(trackId);
@@ -556,6 +607,28 @@ namespace Mist{
     VERYHIGH_MSG("Page %s loaded for %s", id, streamName.c_str());
   }
 
+  /// Unmaps cached pages of the given track that were deleted by the input,
+  /// as well as the least recently used ones beyond OUTPUT_PAGE_CACHE_SIZE.
+  void Output::prunePageCache(long unsigned int trackId){
+    if (!pageCache.count(trackId)){return;}
+    std::map<unsigned long, cachedPage> & trkCache = pageCache[trackId];
+    std::map<unsigned long, cachedPage>::iterator it = trkCache.begin();
+    while (it != trkCache.end()){
+      if (!it->second.page.mapped || !it->second.page.exists()){
+        trkCache.erase(it++);
+      }else{
+        ++it;
+      }
+    }
+    while (trkCache.size() > OUTPUT_PAGE_CACHE_SIZE){
+      std::map<unsigned long, cachedPage>::iterator oldest = trkCache.begin();
+      for (it = trkCache.begin(); it != trkCache.end(); ++it){
+        if (it->second.lastUse < oldest->second.lastUse){oldest = it;}
+      }
+      trkCache.erase(oldest);
+    }
+  }
+
   ///Return the current time of the media buffer, or 0 if no buffer available.
   uint64_t Output::currentTime(){
     if (!buffer.size()){return 0;}
@@ -798,8 +871,10 @@ namespace Mist{
           initialize();
         }
         if ( !sentHeader){
+          if (handOffToFanOut()){break;}
           DONTEVEN_MSG("sendHeader");
           sendHeader();
+          if (fanOutHub){fanOutHub->setHeader();}
         }
         if (!sought){
           initialSeek();
@@ -844,7 +919,22 @@ namespace Mist{
               }
             }
 
+            uint64_t sendStart = Util::getMicros();
             sendNext();
+            if (fanOutHub){
+              //New viewers join on keyframes, or on anything if there is no video
+              bool startable = thisPacket.getFlag("keyframe") || myMeta.tracks[thisPacket.getTrackId()].type != "video";
+              if (startable && myMeta.tracks[thisPacket.getTrackId()].type != "video"){
+                for (std::set<unsigned long>::iterator it = selectedTracks.begin(); it != selectedTracks.end(); it++){
+                  if (myMeta.tracks[*it].type == "video"){
+                    startable = false;
+                    break;
+                  }
+                }
+              }
+              fanOutHub->sendPacket(thisPacket.getTime(), startable);
+            }
+            Metrics::record(Metrics::PACKET_SEND, Util::getMicros(sendStart));
           }else{
             INFO_MSG("Shutting down because of stream end");
             if (!onFinish()){
@@ -865,6 +955,54 @@ namespace Mist{
     return 0;
   }
   
+  /// Serves all viewers handed over to the given hub, which is used as the connection of this output.
+  /// Prepares every packet once for all of them, instead of once per viewer process.
+  int Output::runFanOut(FanOut::Hub & hub){
+    fanOutHub = &hub;
+    hub.setStats(streamName, getStatsName());
+    wantRequest = false;
+    parseData = true;
+    return run();
+  }
+
+  /// Hands the connection over to the process serving all viewers of this stream over this protocol, starting it if needed.
+  /// Only done for live streams, when enabled through the fanout option and supported for this request by canFanOut().
+  /// \returns True if the connection was handed over, in which case this output is done.
+  bool Output::handOffToFanOut(){
+    if (fanOutHub || !myMeta.live || !myConn || !config->hasOption("fanout") || !config->getInteger("fanout")){return false;}
+    if (!canFanOut()){return false;}
+    std::string path = FanOut::hubPath(capa["name"].asStringRef(), streamName);
+    bool handedOff = FanOut::handOff(path, myConn.getSocket(), getConnectedBinHost(), crc);
+    if (!handedOff){
+      std::deque<std::string> args;
+      args.push_back(Util::getMyPath() + "MistOut" + capa["name"].asStringRef());
+      args.push_back("--stream");
+      args.push_back(streamName);
+      args.push_back("--fanouthub");
+      if (Util::Config::printDebugLevel != DEBUG){
+        args.push_back("--debug");
+        args.push_back(JSON::Value((long long)Util::Config::printDebugLevel).asString());
+      }
+      int fdErr = 2;
+      pid_t pid = Util::Procs::StartPiped(args, 0, 0, &fdErr);
+      if (pid){
+        Util::Procs::forget(pid);
+        //Give the hub up to two seconds to start listening
+        for (unsigned int i = 0; i < 20 && !handedOff && keepGoing(); ++i){
+          Util::wait(100);
+          handedOff = FanOut::handOff(path, myConn.getSocket(), getConnectedBinHost(), crc);
+        }
+      }
+    }
+    if (!handedOff){
+      WARN_MSG("Could not hand viewer over to shared output for %s, serving it directly", streamName.c_str());
+      return false;
+    }
+    HIGH_MSG("Handed viewer over to shared output for %s", streamName.c_str());
+    myConn.drop();
+    return true;
+  }
+
   void Output::dropTrack(uint32_t trackId, std::string reason, bool probablyBad){
     //depending on whether this is probably bad and the current debug level, print a message
     unsigned int printLevel = DLVL_INFO;
@@ -880,6 +1018,7 @@ namespace Mist{
       }
     }
     selectedTracks.erase(trackId);
+    pageCache.erase(trackId);
   }
  
   ///Attempts to prepare a new packet for output.
@@ -890,7 +1029,7 @@ namespace Mist{
   bool Output::prepareNext(){
     static bool atLivePoint = false;
     static int nonVideoCount = 0;
-    static unsigned int emptyCount = 0;
+    static uint64_t emptyTime = 0;
     if (!buffer.size()){
       thisPacket.null();
       INFO_MSG("Buffer completely played out");
@@ -985,14 +1124,15 @@ namespace Mist{
       //if the next key hasn't shown up on another page, then we're waiting.
       //VoD might be slow, so we check VoD case also, just in case
       if (currKeyOpen.count(nxt.tid) && (currKeyOpen[nxt.tid] == (unsigned int)nextPage || nextPage == -1)){
-        if (++emptyCount < 100){
-          Util::wait(250);
+        if (emptyTime < 25000){
+          Util::wait(liveWait);
+          emptyTime += liveWait;
           //we're waiting for new data to show up
-          if (emptyCount % 64 == 0){
+          if (emptyTime / 16000 != (emptyTime - liveWait) / 16000){
             reconnect();//reconnect every 16 seconds
           }else{
             //updating meta is only useful with live streams
-            if (myMeta.live && emptyCount % 4 == 0){
+            if (myMeta.live && emptyTime / 1000 != (emptyTime - liveWait) / 1000){
               updateMeta();
             }
           }
@@ -1034,7 +1174,10 @@ namespace Mist{
       dropTrack(nxt.tid, "packet load failure");
       return false;
     }
-    emptyCount = 0;//valid packet - reset empty counter
+    if (emptyTime){
+      Metrics::record(Metrics::EMPTY_WAIT, emptyTime * 1000);
+      emptyTime = 0;//valid packet - reset empty timer
+    }
 
     //if there's a timestamp mismatch, print this.
     //except for live, where we never know the time in advance
@@ -1069,12 +1212,15 @@ namespace Mist{
       //Check whether returned keyframe is correct. If not, wait for approximately 10 seconds while checking.
       //Failure here will cause tracks to drop due to inconsistent internal state.
       nxtKeyNum[nxt.tid] = getKeyForTime(nxt.tid, thisPacket.getTime());
-      int counter = 0;
-      while(counter < 40 && myMeta.tracks[nxt.tid].getKey(nxtKeyNum[nxt.tid]).getTime() != thisPacket.getTime()){
-        if (counter++){
-          //Only sleep 250ms if this is not the first updatemeta try
-          Util::wait(250);
+      unsigned int waited = 0;
+      bool firstTry = true;
+      while(waited < 10000 && myMeta.tracks[nxt.tid].getKey(nxtKeyNum[nxt.tid]).getTime() != thisPacket.getTime()){
+        if (!firstTry){
+          //Only sleep if this is not the first updatemeta try
+          Util::wait(liveWait);
+          waited += liveWait;
         }
+        firstTry = false;
         updateMeta();
         nxtKeyNum[nxt.tid] = getKeyForTime(nxt.tid, thisPacket.getTime());
       }
@@ -1151,6 +1297,10 @@ namespace Mist{
       }
       statsPage.keepAlive();
     }
+    //Unmap cached pages the input removed, so evicted pages stop using memory within a second
+    for (std::map<unsigned long, std::map<unsigned long, cachedPage> >::iterator it = pageCache.begin(); it != pageCache.end(); ++it){
+      prunePageCache(it->first);
+    }
     int tNum = 0;
     if (!nProxy.userClient.getData()){
       char userPageName[NAME_BUFFER_SIZE];
@@ -1197,6 +1347,7 @@ namespace Mist{
       }
     }
     nProxy.userClient.keepAlive();
+    Metrics::publish("MistOut" + capa["name"].asStringRef());
     if (tNum > SIMUL_TRACKS){
       WARN_MSG("Too many tracks selected, using only first %d", SIMUL_TRACKS);
     }
@@ -1299,6 +1450,7 @@ namespace Mist{
           snprintf(liveSemName, NAME_BUFFER_SIZE, SEM_LIVE, streamName.c_str());
           liveSem = new IPC::semaphore(liveSemName, O_RDWR, ACCESSPERMS, 1, !myMeta.live);
           if (*liveSem){
+            Metrics::timer waitTimer(Metrics::LIVE_WAIT);
             liveSem->wait();
           }else{
             delete liveSem;
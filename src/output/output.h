@@ -7,6 +7,7 @@
 #include <mist/flv_tag.h>
 #include <mist/timing.h>
 #include <mist/dtsc.h>
+#include <mist/fanout.h>
 #include <mist/socket.h>
 #include <mist/shared_memory.h>
 #include "../io.h"
@@ -27,6 +28,13 @@ namespace Mist {
     unsigned int offset;
   };
 
+  /// A data page that is kept mapped after playback left it, for cheap re-use when seeking back.
+  struct cachedPage{
+    cachedPage() : lastUse(0){}
+    IPC::sharedPage page;
+    uint64_t lastUse;///< Value of Output::pageCacheClock when this page was last left.
+  };
+
   /// The output class is intended to be inherited by MistOut process classes.
   /// It contains all generic code and logic, while the child classes implement
   /// anything specific to particular protocols or containers.
@@ -57,6 +65,7 @@ namespace Mist {
       static bool listenMode(){return true;}
       uint32_t currTrackCount() const;
       virtual bool isReadyForPlay();
+      int runFanOut(FanOut::Hub & hub);
       //virtuals. The optional virtuals have default implementations that do as little as possible.
       /// This function is called whenever a packet is ready for sending.
       /// Inside it, thisPacket is guaranteed to contain a valid packet.
@@ -75,16 +84,27 @@ namespace Mist {
       virtual void sendHeader();
       virtual void onFail();
       virtual void requestHandler();
+      /// Called before the data page of the given track is switched, while it is still mapped.
+      /// Outputs that keep pointers into packet data past sendNext() must copy what they still need here.
+      virtual void onPageLeave(long unsigned int trackId){}
+      /// Returns true if all viewers of the current stream can be sent the exact same bytes after the header,
+      /// so they may be served by a single process. See runFanOut().
+      virtual bool canFanOut(){return false;}
       static Util::Config * config;
     private://these *should* not be messed with in child classes.
       std::map<unsigned long, unsigned int> currKeyOpen;
+      std::map<unsigned long, std::map<unsigned long, cachedPage> > pageCache;///< Per track, recently left data pages by page number.
+      uint64_t pageCacheClock;///< Incremented on every page switch, used for LRU eviction from pageCache.
       void loadPageForKey(long unsigned int trackId, long long int keyNum);
+      void prunePageCache(long unsigned int trackId);
       int pageNumForKey(long unsigned int trackId, long long int keyNum);
       int pageNumMax(long unsigned int trackId);
       unsigned int lastStats;///<Time of last sending of stats.
       std::map<unsigned long, unsigned long> nxtKeyNum;///< Contains the number of the next key, for page seeking purposes.
       std::set<sortedPageInfo> buffer;///< A sorted list of next-to-be-loaded packets.
       bool sought;///<If a seek has been done, this is set to true. Used for seeking on prepareNext().
+      FanOut::Hub * fanOutHub;///< If set, this output serves all viewers handed over to this hub.
+      bool handOffToFanOut();
     protected://these are to be messed with by child classes
       bool pushing;
       std::string UA; ///< User Agent string, if known.
@@ -105,6 +125,7 @@ namespace Mist {
       unsigned int maxSkipAhead;///< Maximum ms that we will go ahead of the intended timestamps.
       unsigned int realTime;///< Playback speed in ms of data per second. eg: 0 is infinite, 1000 real-time, 5000 is 0.2X speed, 500 = 2X speed.
       uint32_t needsLookAhead;///< Amount of millis we need to be able to look ahead in the metadata
+      uint32_t liveWait;///< Millis to wait between checks for new data when at the live point
 
       //Read/write status variables
       Socket::Connection & myConn;///< Connection to the client.
@@ -0,0 +1,521 @@
+#include "output_cmaf.h"
+#include <iomanip>
+#include <mist/bitfields.h>
+#include <mist/defines.h>
+#include <mist/mp4.h>
+#include <mist/mp4_generic.h>
+#include <mist/stream.h>
+#include <mist/timing.h>
+
+/// Formats a duration in milliseconds as an ISO 8601 duration, e.g. "PT12.345S".
+static std::string isoDuration(uint64_t ms){
+  std::stringstream r;
+  r << "PT" << (ms / 1000) << "." << std::setfill('0') << std::setw(3) << (ms % 1000) << "S";
+  return r.str();
+}
+
+/// Formats a unix time in milliseconds as an ISO 8601 UTC date/time, e.g. "2017-01-01T12:34:56.789Z".
+static std::string isoTime(uint64_t ms){
+  std::stringstream r;
+  r << Util::getUTCString(ms / 1000) << "." << std::setfill('0') << std::setw(3) << (ms % 1000) << "Z";
+  return r.str();
+}
+
+/// Returns the RFC 6381 codec string for the given track.
+static std::string codecString(DTSC::Track & Trk){
+  std::stringstream r;
+  if (Trk.codec == "H264"){
+    r << "avc1.";
+    for (unsigned int i = 1; i < 4; ++i){
+      r << std::hex << std::setw(2) << std::setfill('0') << (int)(Trk.init.size() > i ? (unsigned char)Trk.init[i] : 0) << std::dec;
+    }
+  }
+  if (Trk.codec == "AAC"){
+    r << "mp4a.40." << (Trk.init.size() ? ((unsigned char)Trk.init[0] >> 3) : 2);
+  }
+  return r.str();
+}
+
+/// Returns the start time of the first key after the one starting at fragTime, or all ones if there is none yet.
+static uint64_t nextKeyTime(DTSC::Track & Trk, uint64_t fragTime){
+  for (std::deque<DTSC::Key>::iterator it = Trk.keys.begin(); it != Trk.keys.end(); ++it){
+    if (it->getTime() > fragTime){return it->getTime();}
+  }
+  return 0xFFFFFFFFFFFFFFFFull;
+}
+
+/// Writes a SegmentTimeline entry for count consecutive segments of the same length, if count is non-zero.
+static void timelineEntry(std::ostream & r, uint64_t start, uint64_t len, size_t count){
+  if (!count){return;}
+  r << "<S t=\"" << start << "\" d=\"" << len << "\"";
+  if (count > 1){r << " r=\"" << (count - 1) << "\"";}
+  r << "/>\n";
+}
+
+namespace Mist {
+  OutCMAF::OutCMAF(Socket::Connection & conn) : HTTPOutput(conn){
+    realTime = 0;
+    //Check for new data often, so chunks go out as soon as their last sample is in
+    liveWait = 20;
+    chunkDuration = config->getInteger("chunkduration");
+    if (!chunkDuration){chunkDuration = 1;}
+    fragActive = false;
+  }
+
+  OutCMAF::~OutCMAF(){}
+
+  void OutCMAF::init(Util::Config * cfg){
+    HTTPOutput::init(cfg);
+    capa["name"] = "CMAF";
+    capa["desc"] = "Enables low-latency MPEG-DASH using CMAF segments, which are sent in small chunks as they are being received.";
+    capa["url_rel"] = "/cmaf/$/index.mpd";
+    capa["url_prefix"] = "/cmaf/$/";
+    capa["codecs"][0u][0u].append("H264");
+    capa["codecs"][0u][1u].append("AAC");
+    capa["methods"][0u]["handler"] = "http";
+    capa["methods"][0u]["type"] = "dash/video/mp4";
+    capa["methods"][0u]["priority"] = 8ll;
+    capa["optional"]["chunkduration"]["name"] = "Chunk duration";
+    capa["optional"]["chunkduration"]["help"] = "Minimum duration in milliseconds of the chunks a live segment is sent in. Lower means less latency, but more overhead.";
+    capa["optional"]["chunkduration"]["type"] = "uint";
+    capa["optional"]["chunkduration"]["default"] = 40ll;
+    capa["optional"]["chunkduration"]["option"] = "--chunkduration";
+    cfg->addOption("chunkduration", JSON::fromString("{\"arg\":\"integer\",\"value\":[40],\"short\":\"c\",\"long\":\"chunkduration\",\"help\":\"Minimum duration in milliseconds of the chunks a live segment is sent in.\"}"));
+  }
+
+  /// Builds the MPD for all H264 and AAC tracks of the stream.
+  /// Every key is a segment, named after its start time. For live streams, the segment currently
+  /// being received is left out of the timeline, but announced as available early through
+  /// availabilityTimeOffset, since it can already be requested and will be sent chunk by chunk.
+  std::string OutCMAF::dashIndex(){
+    updateMeta();
+    uint64_t maxKeyLen = 0;
+    uint64_t lastms = 0;
+    for (std::map<unsigned int, DTSC::Track>::iterator it = myMeta.tracks.begin(); it != myMeta.tracks.end(); ++it){
+      if (it->second.codec != "H264" && it->second.codec != "AAC"){continue;}
+      lastms = std::max(lastms, (uint64_t)it->second.lastms);
+      for (std::deque<DTSC::Key>::iterator kIt = it->second.keys.begin(); kIt != it->second.keys.end(); ++kIt){
+        maxKeyLen = std::max(maxKeyLen, (uint64_t)kIt->getLength());
+      }
+    }
+    if (!maxKeyLen){maxKeyLen = AUDIO_KEY_INTERVAL;}
+    uint64_t now = Util::getMS();
+
+    std::stringstream r;
+    r << "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n";
+    r << "<MPD xmlns=\"urn:mpeg:dash:schema:mpd:2011\" profiles=\"urn:mpeg:dash:profile:isoff-live:2011,urn:mpeg:dash:profile:cmaf:2019\" ";
+    if (myMeta.live){
+      //Wall clock time of media timestamp zero
+      uint64_t startTime = now - lastms;
+      if (myMeta.bootMsOffset){startTime = now - Util::bootMS() + myMeta.bootMsOffset;}
+      r << "type=\"dynamic\" availabilityStartTime=\"" << isoTime(startTime) << "\" publishTime=\"" << isoTime(now) << "\" ";
+      r << "timeShiftBufferDepth=\"" << isoDuration(myMeta.bufferWindow) << "\" minimumUpdatePeriod=\"" << isoDuration(maxKeyLen) << "\" ";
+      r << "maxSegmentDuration=\"" << isoDuration(maxKeyLen) << "\" minBufferTime=\"" << isoDuration(chunkDuration * 2) << "\">\n";
+    }else{
+      r << "type=\"static\" mediaPresentationDuration=\"" << isoDuration(lastms) << "\" ";
+      r << "maxSegmentDuration=\"" << isoDuration(maxKeyLen) << "\" minBufferTime=\"" << isoDuration(maxKeyLen) << "\">\n";
+    }
+    r << "<Period id=\"0\" start=\"PT0S\">\n";
+    for (int pass = 0; pass < 2; ++pass){
+      std::string type = (pass ? "audio" : "video");
+      bool started = false;
+      for (std::map<unsigned int, DTSC::Track>::iterator it = myMeta.tracks.begin(); it != myMeta.tracks.end(); ++it){
+        DTSC::Track & Trk = it->second;
+        if (Trk.type != type || (Trk.codec != "H264" && Trk.codec != "AAC") || !Trk.keys.size()){continue;}
+        if (!started){
+          r << "<AdaptationSet id=\"" << pass << "\" contentType=\"" << type << "\" mimeType=\"" << type << "/mp4\" segmentAlignment=\"true\" startWithSAP=\"1\"";
+          if (Trk.lang.size() && Trk.lang != "und"){r << " lang=\"" << Trk.lang << "\"";}
+          r << ">\n";
+          started = true;
+        }
+        r << "<Representation id=\"" << it->first << "\" codecs=\"" << codecString(Trk) << "\" bandwidth=\"" << (Trk.bps * 8) << "\"";
+        if (type == "video"){
+          r << " width=\"" << Trk.width << "\" height=\"" << Trk.height << "\"";
+          if (Trk.fpks){r << " frameRate=\"" << Trk.fpks << "/1000\"";}
+          r << ">\n";
+        }else{
+          r << " audioSamplingRate=\"" << Trk.rate << "\">\n";
+          r << "<AudioChannelConfiguration schemeIdUri=\"urn:mpeg:dash:23003:3:audio_channel_configuration:2011\" value=\"" << Trk.channels << "\"/>\n";
+        }
+        r << "<SegmentTemplate timescale=\"1000\" initialization=\"$RepresentationID$/init.mp4\" media=\"$RepresentationID$/$Time$.m4s\"";
+        if (myMeta.live){
+          //The segment being received can be requested as soon as it starts; allow up to its longest length early
+          uint64_t trackKeyLen = 0;
+          for (std::deque<DTSC::Key>::iterator kIt = Trk.keys.begin(); kIt != Trk.keys.end(); ++kIt){
+            trackKeyLen = std::max(trackKeyLen, (uint64_t)kIt->getLength());
+          }
+          if (trackKeyLen > chunkDuration){
+            r << " availabilityTimeOffset=\"" << (double)(trackKeyLen - chunkDuration) / 1000 << "\" availabilityTimeComplete=\"false\"";
+          }
+        }
+        r << ">\n<SegmentTimeline>\n";
+        //The last key of a live track is still being received, and has no known length yet
+        size_t keyCount = Trk.keys.size() - (myMeta.live ? 1 : 0);
+        uint64_t runStart = 0, runLen = 0;
+        size_t runCount = 0;
+        for (size_t i = 0; i < keyCount; ++i){
+          uint64_t keyLen = Trk.keys[i].getLength();
+          if (!keyLen){keyLen = Trk.lastms - Trk.keys[i].getTime();}
+          if (runCount && keyLen == runLen){
+            ++runCount;
+            continue;
+          }
+          timelineEntry(r, runStart, runLen, runCount);
+          runStart = Trk.keys[i].getTime();
+          runLen = keyLen;
+          runCount = 1;
+        }
+        timelineEntry(r, runStart, runLen, runCount);
+        r << "</SegmentTimeline>\n</SegmentTemplate>\n</Representation>\n";
+      }
+      if (started){r << "</AdaptationSet>\n";}
+    }
+    r << "</Period>\n";
+    if (myMeta.live){
+      r << "<UTCTiming schemeIdUri=\"urn:mpeg:dash:utc:direct:2014\" value=\"" << isoTime(now) << "\"/>\n";
+    }
+    r << "</MPD>\n";
+    DEBUG_MSG(DLVL_HIGH, "Sending this manifest: %s", r.str().c_str());
+    return r.str();
+  }
+
+  /// Builds the CMAF header for a single track: a ftyp and a moov without any samples.
+  std::string OutCMAF::initSegment(unsigned int tid){
+    DTSC::Track & Trk = myMeta.tracks[tid];
+    MP4::FTYP ftypBox(false);
+    ftypBox.setMajorBrand("cmfc");
+    ftypBox.setMinorVersion("\000\000\000\000");
+    ftypBox.setCompatibleBrands("cmfc", 0);
+    ftypBox.setCompatibleBrands("iso6", 1);
+    ftypBox.setCompatibleBrands("dash", 2);
+    ftypBox.setCompatibleBrands("Mist", 3);
+
+    MP4::MOOV moovBox;
+    MP4::MVHD mvhdBox(0);
+    mvhdBox.setTrackID(tid + 1);
+    moovBox.setContent(mvhdBox, 0);
+
+    MP4::TRAK trakBox;
+    MP4::TKHD tkhdBox(Trk, true);
+    tkhdBox.setDuration(0);
+    trakBox.setContent(tkhdBox, 0);
+    MP4::MDIA mdiaBox;
+    MP4::MDHD mdhdBox(0);
+    mdhdBox.setLanguage(Trk.lang);
+    mdiaBox.setContent(mdhdBox, 0);
+    MP4::HDLR hdlrBox(Trk.type, Trk.getIdentifier());
+    mdiaBox.setContent(hdlrBox, 1);
+    MP4::MINF minfBox;
+    if (Trk.type == "video"){
+      MP4::VMHD vmhdBox;
+      vmhdBox.setFlags(1);
+      minfBox.setContent(vmhdBox, 0);
+    }else{
+      MP4::SMHD smhdBox;
+      minfBox.setContent(smhdBox, 0);
+    }
+    MP4::DINF dinfBox;
+    MP4::DREF drefBox;
+    dinfBox.setContent(drefBox, 0);
+    minfBox.setContent(dinfBox, 1);
+    //All sample tables are empty: the samples are described in the fragments
+    MP4::STBL stblBox;
+    MP4::STSD stsdBox(0);
+    if (Trk.type == "video"){
+      MP4::VisualSampleEntry sampleEntry(Trk);
+      stsdBox.setEntry(sampleEntry, 0);
+    }else{
+      MP4::AudioSampleEntry sampleEntry(Trk);
+      stsdBox.setEntry(sampleEntry, 0);
+    }
+    stblBox.setContent(stsdBox, 0);
+    MP4::STTS sttsBox(0);
+    stblBox.setContent(sttsBox, 1);
+    MP4::STSC stscBox(0);
+    stblBox.setContent(stscBox, 2);
+    MP4::STSZ stszBox(0);
+    stblBox.setContent(stszBox, 3);
+    MP4::STCO stcoBox(0);
+    stblBox.setContent(stcoBox, 4);
+    minfBox.setContent(stblBox, 2);
+    mdiaBox.setContent(minfBox, 2);
+    trakBox.setContent(mdiaBox, 1);
+    moovBox.setContent(trakBox, 1);
+
+    MP4::MVEX mvexBox;
+    MP4::TREX trexBox(tid);
+    mvexBox.setContent(trexBox, 0);
+    moovBox.setContent(mvexBox, 2);
+
+    std::string result(ftypBox.asBox(), ftypBox.boxedSize());
+    result.append(moovBox.asBox(), moovBox.boxedSize());
+    return result;
+  }
+
+  /// Starts sending the fragment of the given track that starts at the given time.
+  /// For live streams, waits up to ten seconds for the fragment to start being received.
+  void OutCMAF::sendFragment(unsigned int tid, uint64_t fragTime){
+    if (myMeta.live){
+      updateMeta();
+      if (!myMeta.tracks[tid].keys.size() || fragTime < myMeta.tracks[tid].keys.front().getTime()){
+        H.Clean();
+        H.setCORSHeaders();
+        H.SetBody("The requested fragment is no longer kept in memory on the server and cannot be served.\n");
+        myConn.SendNow(H.BuildResponse("404", "Fragment out of range"));
+        H.Clean();
+        WARN_MSG("Fragment @ %" PRIu64 " too old", fragTime);
+        return;
+      }
+      unsigned int timeout = 0;
+      while (keepGoing() && myMeta.tracks[tid].lastms < fragTime && ++timeout < 100){
+        Util::wait(100);
+        updateMeta();
+      }
+    }
+    DTSC::Track & Trk = myMeta.tracks[tid];
+    bool found = false;
+    for (std::deque<DTSC::Key>::iterator it = Trk.keys.begin(); it != Trk.keys.end(); ++it){
+      if (it->getTime() == fragTime){
+        fragNumber = it->getNumber();
+        found = true;
+        break;
+      }
+    }
+    if (!found){
+      H.Clean();
+      H.setCORSHeaders();
+      H.SetBody("No fragment starts at the requested time.\n");
+      myConn.SendNow(H.BuildResponse("404", "Fragment not found"));
+      H.Clean();
+      MEDIUM_MSG("No fragment @ %" PRIu64 " for track %u", fragTime, tid);
+      return;
+    }
+    fragTrack = tid;
+    fragStart = fragTime;
+    fragEnd = nextKeyTime(Trk, fragTime);
+    chunkNumber = 0;
+    samples.clear();
+
+    std::string method = H.method;
+    H.Clean();
+    H.SetHeader("Content-Type", Trk.type + "/mp4");
+    H.setCORSHeaders();
+    if (method == "HEAD"){
+      H.SendResponse("200", "OK", myConn);
+      H.Clean();
+      return;
+    }
+    H.StartResponse(H, myConn);
+    selectedTracks.clear();
+    selectedTracks.insert(tid);
+    fragActive = true;
+    parseData = true;
+    wantRequest = false;
+    seek(fragTime);
+  }
+
+  void OutCMAF::onHTTP(){
+    std::string method = H.method;
+    if (method == "OPTIONS"){
+      H.Clean();
+      H.SetHeader("Content-Type", "application/octet-stream");
+      H.SetHeader("Cache-Control", "no-cache");
+      H.setCORSHeaders();
+      H.SendResponse("200", "OK", myConn);
+      H.Clean();
+      return;
+    }
+
+    initialize();
+    if (!keepGoing()){
+      onFail();
+      return;
+    }
+
+    std::string request = H.getUrl().substr(6 + streamName.size());
+    if (request == "/index.mpd"){
+      H.Clean();
+      H.SetHeader("Content-Type", "application/dash+xml");
+      H.SetHeader("Cache-Control", "no-cache");
+      H.setCORSHeaders();
+      if (!myMeta.tracks.size()){
+        H.SendResponse("404", "Not online or found", myConn);
+        H.Clean();
+        return;
+      }
+      if (method == "HEAD"){
+        H.SendResponse("200", "OK", myConn);
+        H.Clean();
+        return;
+      }
+      H.SetBody(dashIndex());
+      H.SendResponse("200", "OK", myConn);
+      H.Clean();
+      return;
+    }
+
+    //Everything else is either tid/init.mp4 or tid/time.m4s
+    size_t slash = request.find('/', 1);
+    unsigned int tid = atoi(request.substr(1).c_str());
+    std::string file = (slash == std::string::npos ? "" : request.substr(slash + 1));
+    if (!myMeta.tracks.count(tid) || (myMeta.tracks[tid].codec != "H264" && myMeta.tracks[tid].codec != "AAC") ||
+        (file != "init.mp4" && (file.size() < 5 || file.substr(file.size() - 4) != ".m4s"))){
+      DEBUG_MSG(DLVL_MEDIUM, "Could not parse URL: %s", H.getUrl().c_str());
+      H.Clean();
+      H.setCORSHeaders();
+      H.SetBody("The CMAF URL wasn't understood - what did you want, exactly?\n");
+      myConn.SendNow(H.BuildResponse("404", "URL mismatch"));
+      H.Clean();
+      return;
+    }
+    if (file == "init.mp4"){
+      H.Clean();
+      H.SetHeader("Content-Type", myMeta.tracks[tid].type + "/mp4");
+      H.setCORSHeaders();
+      if (method == "HEAD"){
+        H.SendResponse("200", "OK", myConn);
+        H.Clean();
+        return;
+      }
+      H.SetBody(initSegment(tid));
+      H.SendResponse("200", "OK", myConn);
+      H.Clean();
+      return;
+    }
+    sendFragment(tid, atoll(file.c_str()));
+  }
+
+  /// Returns true if thisPacket is the first packet after the current fragment.
+  /// If the fragment end was not known when the request came in, it is the start of a new key: any
+  /// keyframe for video, while other tracks are only split up in the metadata, once we see a packet
+  /// that may start a new key.
+  bool OutCMAF::fragmentEnds(){
+    if (thisPacket.getTime() >= fragEnd){return true;}
+    if (fragEnd != 0xFFFFFFFFFFFFFFFFull || !myMeta.live){return false;}
+    if (myMeta.tracks[fragTrack].type == "video"){
+      if (!thisPacket.getFlag("keyframe") || thisPacket.getTime() <= fragStart){return false;}
+      fragEnd = thisPacket.getTime();
+      return true;
+    }
+    if (thisPacket.getTime() - fragStart < AUDIO_KEY_INTERVAL){return false;}
+    //Wait for the metadata to include this packet, so we know whether it starts a new key
+    updateMeta();
+    unsigned int timeout = 0;
+    while (keepGoing() && myMeta.tracks[fragTrack].lastms < thisPacket.getTime() && ++timeout < 500){
+      Util::wait(liveWait);
+      updateMeta();
+    }
+    fragEnd = nextKeyTime(myMeta.tracks[fragTrack], fragStart);
+    return thisPacket.getTime() >= fragEnd;
+  }
+
+  /// Sends the first count samples as a single moof+mdat chunk, and removes them.
+  void OutCMAF::sendChunk(size_t count){
+    if (!count){return;}
+    bool isVideo = (myMeta.tracks[fragTrack].type == "video");
+    MP4::MFHD mfhdBox;
+    //Unique and increasing within a track, as long as a fragment has less than 1024 chunks
+    mfhdBox.setSequenceNumber((fragNumber << 10) + std::min(chunkNumber, (uint32_t)1023));
+    ++chunkNumber;
+
+    MP4::TFHD tfhdBox;
+    tfhdBox.setFlags(MP4::tfhdBaseIsMoof);
+    tfhdBox.setTrackID(fragTrack);
+
+    MP4::TFDT tfdtBox(samples.front().time);
+
+    MP4::TRUN trunBox;
+    trunBox.setFlags(MP4::trundataOffset | MP4::trunsampleDuration | MP4::trunsampleSize | MP4::trunsampleFlags | (isVideo ? MP4::trunsampleOffsets : 0));
+    trunBox.setDataOffset(0);
+    uint32_t mdatSize = 8;
+    for (size_t i = 0; i < count; ++i){
+      MP4::trunSampleInformation trunSample;
+      trunSample.sampleDuration = samples[i].duration;
+      trunSample.sampleSize = samples[i].data.size();
+      if (isVideo){
+        trunSample.sampleFlags = (samples[i].keyframe ? MP4::isIPicture | MP4::isKeySample : MP4::noIPicture | MP4::noKeySample);
+      }else{
+        trunSample.sampleFlags = MP4::isIPicture | MP4::isKeySample;
+      }
+      trunSample.sampleOffset = samples[i].offset;
+      trunBox.setSampleInformation(trunSample, i);
+      mdatSize += samples[i].data.size();
+    }
+
+    MP4::TRAF trafBox;
+    trafBox.setContent(tfhdBox, 0);
+    trafBox.setContent(tfdtBox, 1);
+    trafBox.setContent(trunBox, 2);
+    MP4::MOOF moofBox;
+    moofBox.setContent(mfhdBox, 0);
+    moofBox.setContent(trafBox, 1);
+    //Now that the moof size is known, point the data offset past the mdat header
+    trunBox.setDataOffset(moofBox.boxedSize() + 8);
+    trafBox.setContent(trunBox, 2);
+    moofBox.setContent(trafBox, 1);
+
+    std::string chunk;
+    chunk.reserve(moofBox.boxedSize() + mdatSize);
+    chunk.append(moofBox.asBox(), moofBox.boxedSize());
+    char mdatHeader[8];
+    Bit::htobl(mdatHeader, mdatSize);
+    memcpy(mdatHeader + 4, "mdat", 4);
+    chunk.append(mdatHeader, 8);
+    for (size_t i = 0; i < count; ++i){chunk.append(samples[i].data);}
+    H.Chunkify(chunk.data(), chunk.size(), myConn);
+    samples.erase(samples.begin(), samples.begin() + count);
+  }
+
+  /// Sends out all remaining samples, and ends the response.
+  /// The last sample gets the duration of the sample before it, unless the fragment end is known.
+  void OutCMAF::endFragment(){
+    if (samples.size()){
+      cmafSample & last = samples.back();
+      if (fragEnd != 0xFFFFFFFFFFFFFFFFull && fragEnd > last.time){
+        last.duration = fragEnd - last.time;
+      }else if (samples.size() > 1){
+        last.duration = samples[samples.size() - 2].duration;
+      }else{
+        last.duration = (myMeta.tracks[fragTrack].parts.size() ? myMeta.tracks[fragTrack].parts.back().getDuration() : 0);
+      }
+      sendChunk(samples.size());
+    }
+    H.Chunkify("", 0, myConn);
+    H.Clean();
+    fragActive = false;
+    stop();
+    wantRequest = true;
+  }
+
+  /// Collects the samples of the fragment, holding back the newest one until its duration is known.
+  /// Whenever the held back samples span at least chunkDuration, all complete ones are sent as a chunk.
+  void OutCMAF::sendNext(){
+    if (fragmentEnds()){
+      if (samples.size()){samples.back().duration = thisPacket.getTime() - samples.back().time;}
+      endFragment();
+      return;
+    }
+    if (samples.size()){samples.back().duration = thisPacket.getTime() - samples.back().time;}
+    samples.push_back(cmafSample());
+    cmafSample & sample = samples.back();
+    sample.time = thisPacket.getTime();
+    sample.duration = 0;
+    sample.offset = (thisPacket.hasMember("offset") ? thisPacket.getInt("offset") : 0);
+    sample.keyframe = thisPacket.getFlag("keyframe");
+    char * dataPointer = 0;
+    unsigned int len = 0;
+    thisPacket.getString("data", dataPointer, len);
+    sample.data.assign(dataPointer, len);
+    if (samples.size() > 1 && sample.time - samples.front().time >= chunkDuration){
+      sendChunk(samples.size() - 1);
+    }
+  }
+
+  /// Called when no more packets are coming, e.g. at the end of a VoD stream.
+  /// Completes the fragment that is being sent, if any, and waits for the next request.
+  bool OutCMAF::onFinish(){
+    if (!fragActive){return false;}
+    endFragment();
+    return true;
+  }
+}
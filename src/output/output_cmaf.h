@@ -0,0 +1,40 @@
+#include "output_http.h"
+#include <deque>
+
+namespace Mist {
+  /// A single sample of the fragment currently being sent, waiting to be packed into a chunk.
+  struct cmafSample{
+    uint64_t time;
+    uint32_t duration;
+    uint32_t offset;
+    bool keyframe;
+    std::string data;
+  };
+
+  class OutCMAF : public HTTPOutput {
+    public:
+      OutCMAF(Socket::Connection & conn);
+      ~OutCMAF();
+      static void init(Util::Config * cfg);
+      void onHTTP();
+      void sendNext();
+      bool onFinish();
+    protected:
+      std::string dashIndex();
+      std::string initSegment(unsigned int tid);
+      void sendFragment(unsigned int tid, uint64_t fragTime);
+      bool fragmentEnds();
+      void sendChunk(size_t count);
+      void endFragment();
+      uint32_t chunkDuration;///< Minimum duration of a single moof+mdat chunk, in ms.
+      unsigned int fragTrack;///< Track of the fragment currently being sent.
+      uint64_t fragStart;///< Start time of the fragment currently being sent.
+      uint64_t fragEnd;///< Start time of the next fragment, or all ones if not known yet.
+      uint32_t fragNumber;///< Key number of the fragment currently being sent.
+      uint32_t chunkNumber;///< Number of chunks of the current fragment sent so far.
+      bool fragActive;///< True while a fragment response is in progress.
+      std::deque<cmafSample> samples;///< Samples not sent yet. The last one has no known duration yet.
+  };
+}
+
+typedef Mist::OutCMAF mistOut;
@@ -0,0 +1,116 @@
+#include "output_dtsc.h"
+#include <mist/defines.h>
+#include <mist/stream.h>
+#include <mist/bitfields.h>
+
+namespace Mist {
+  OutDTSC::OutDTSC(Socket::Connection & conn) : Output(conn) {
+    headerSent = false;
+    lastMetaCheck = 0;
+    JSON::Value hi;
+    hi["cmd"] = "hi";
+    hi["version"] = "MistServer " PACKAGE_VERSION;
+    sendCmd(hi);
+    setBlocking(false);
+  }
+
+  OutDTSC::~OutDTSC() {}
+
+  void OutDTSC::init(Util::Config * cfg){
+    Output::init(cfg);
+    capa["name"] = "DTSC";
+    capa["desc"] = "Enables the DTSC protocol for efficient inter-server stream exchange. Other MistServer instances can pull streams from this one using dtsc:// URLs.";
+    capa["deps"] = "";
+    capa["codecs"][0u][0u].append("+*");
+    capa["optional"]["password"]["name"] = "Password";
+    capa["optional"]["password"]["help"] = "If set, only servers pulling with this password (as in dtsc://password@host/stream) are sent streams. Without it, anyone who can connect may pull, like with the other playback protocols.";
+    capa["optional"]["password"]["type"] = "str";
+    capa["optional"]["password"]["option"] = "--password";
+    cfg->addOption("password", JSON::fromString("{\"arg\":\"string\",\"value\":[\"\"],\"short\":\"P\",\"long\":\"password\",\"help\":\"Password that pulling servers must send, if any.\"}"));
+    cfg->addConnectorOptions(4200, capa);
+    config = cfg;
+  }
+
+  /// Sends a DTCM command message, containing the given data.
+  void OutDTSC::sendCmd(const JSON::Value & data){
+    std::string cmd(DTSC::Magic_Command, 4);
+    cmd.append("\000\000\000\000", 4);
+    data.toPacked(cmd);
+    Bit::htobl((char*)cmd.data() + 4, cmd.size() - 8);
+    myConn.SendNow(cmd);
+  }
+
+  /// Parses incoming DTCM command messages.
+  /// The only supported command is "play", which starts sending the requested stream.
+  /// If a password is configured, play commands must carry it.
+  void OutDTSC::onRequest(){
+    while (myConn.Received().available(8)){
+      if (myConn.Received().copy(4) != "DTCM"){
+        WARN_MSG("Invalid DTSC command message received - aborting connection");
+        myConn.close();
+        return;
+      }
+      std::string toRec = myConn.Received().copy(8);
+      unsigned long rSize = Bit::btohl(toRec.c_str() + 4);
+      if (!myConn.Received().available(8 + rSize)){return;}//abort - not enough data yet
+      std::string dataPacket = myConn.Received().remove(8 + rSize);
+      DTSC::Packet cmdPack(dataPacket.data(), dataPacket.size(), true);
+      std::string cmd;
+      cmdPack.getString("cmd", cmd);
+      if (cmd == "play"){
+        if (streamName.size()){
+          WARN_MSG("Ignoring play command for %s: already playing %s", cmdPack.getScan().getMember("stream").asString().c_str(), streamName.c_str());
+          continue;
+        }
+        std::string password;
+        cmdPack.getString("password", password);
+        if (config->getString("password").size() && password != config->getString("password")){
+          FAIL_MSG("Pull of %s by %s rejected - incorrect password", cmdPack.getScan().getMember("stream").asString().c_str(), getConnectedHost().c_str());
+          JSON::Value err;
+          err["cmd"] = "error";
+          err["msg"] = "Incorrect password";
+          sendCmd(err);
+          myConn.close();
+          return;
+        }
+        cmdPack.getString("stream", streamName);
+        Util::sanitizeName(streamName);
+        INFO_MSG("Sending stream %s over DTSC to %s", streamName.c_str(), getConnectedHost().c_str());
+        parseData = true;
+        continue;
+      }
+      WARN_MSG("Unimplemented DTSC command '%s' received - ignoring", cmd.c_str());
+    }
+  }
+
+  /// Sends the stream header for all selected tracks.
+  /// If a header was sent before, the receiving side is told to reset its track list first.
+  void OutDTSC::sendHeader(){
+    if (headerSent){
+      JSON::Value reset;
+      reset["cmd"] = "reset";
+      sendCmd(reset);
+    }
+    myMeta.send(myConn, true, selectedTracks);
+    headerSent = true;
+    sentHeader = true;
+  }
+
+  /// Sends packets straight from the data pages, as-is.
+  /// For live streams, checks for added tracks every few seconds; if found, they are selected and
+  /// a new header is sent before continuing.
+  void OutDTSC::sendNext(){
+    if (myMeta.live && Util::epoch() > lastMetaCheck + 5){
+      lastMetaCheck = Util::epoch();
+      updateMeta();
+      if (myMeta.tracks.size() != selectedTracks.size() && selectDefaultTracks()){
+        INFO_MSG("Track selection changed - resending headers and continuing");
+        sendHeader();
+        //The current packet may be the keyframe the receiver is waiting for: still send it, if its track is still selected
+        if (!selectedTracks.count(thisPacket.getTrackId())){return;}
+      }
+    }
+    myConn.SendNow(thisPacket.getData(), thisPacket.getDataLen());
+  }
+
+}
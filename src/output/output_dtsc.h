@@ -0,0 +1,19 @@
+#include "output.h"
+
+namespace Mist {
+  class OutDTSC : public Output {
+    public:
+      OutDTSC(Socket::Connection & conn);
+      ~OutDTSC();
+      static void init(Util::Config * cfg);
+      void onRequest();
+      void sendNext();
+      void sendHeader();
+    private:
+      void sendCmd(const JSON::Value & data);
+      bool headerSent;///< True once a DTSC_HEAD has been sent; later headers are preceded by a reset command.
+      long long int lastMetaCheck;///< Time (in seconds) of the last check for added live tracks.
+  };
+}
+
+typedef Mist::OutDTSC mistOut;
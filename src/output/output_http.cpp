@@ -81,6 +81,30 @@ namespace Mist {
     return false;
   }
   
+  /// Matches the url against a single route of the controller's compiled routing table.
+  /// Behaves like isMatch or isPrefix on the original pattern, which was split around its $ into prefix and suffix.
+  static bool routeMatch(const std::string & url, const char * prefix, const char * suffix, uint8_t flags, std::string & streamname){
+    size_t preLen = strlen(prefix);
+    if (url.size() < preLen || url.compare(0, preLen, prefix)){return false;}
+    if (!(flags & ROUTE_CAPTURE)){
+      return (flags & ROUTE_PREFIX) || url.size() == preLen;
+    }
+    size_t sufLen = strlen(suffix);
+    if (url.size() < preLen + sufLen + 1){return false;}
+    size_t sufPos;
+    if (flags & ROUTE_PREFIX){
+      sufPos = url.find(suffix, preLen);
+      if (sufPos == std::string::npos){return false;}
+    }else{
+      sufPos = url.size() - sufLen;
+      if (url.compare(sufPos, sufLen, suffix)){return false;}
+    }
+    //stream names never contain slashes
+    if (url.find('/', preLen) < sufPos){return false;}
+    streamname = url.substr(preLen, sufPos - preLen);
+    return true;
+  }
+  
   /// - anything else: The request should be dispatched to a connector on the named socket.
   std::string HTTPOutput::getHandler(){
     std::string url = H.getUrl();
@@ -119,51 +143,33 @@ namespace Mist {
       }
     }
     
-    //loop over the connectors
-    IPC::semaphore configLock(SEM_CONF, O_CREAT | O_RDWR, ACCESSPERMS, 1);
-    configLock.wait();
-    IPC::sharedPage serverCfg(SHM_CONF, DEFAULT_CONF_PAGE_SIZE);
-    DTSC::Scan capa = DTSC::Scan(serverCfg.mapped, serverCfg.len).getMember("capabilities").getMember("connectors");
-    unsigned int capa_ctr = capa.getSize();
-    for (unsigned int i = 0; i < capa_ctr; ++i){
-      DTSC::Scan c = capa.getIndice(i);
-      //if it depends on HTTP and has a match or prefix...
-      if ((c.getMember("name").asString() == "HTTP" || c.getMember("deps").asString() == "HTTP") && (c.getMember("url_match") || c.getMember("url_prefix"))){
-        bool match = false;
-        std::string streamname;
-        //if there is a matcher, try to match
-        if (c.getMember("url_match")){
-          if (c.getMember("url_match").getSize()){
-            for (unsigned int j = 0; j < c.getMember("url_match").getSize(); ++j){
-              match |= isMatch(url, c.getMember("url_match").getIndice(j).asString(), streamname);
-            }
-          }else{
-            match |= isMatch(url, c.getMember("url_match").asString(), streamname);
-          }
-        }
-        //if there is a prefix, try to match
-        if (c.getMember("url_prefix")){
-          if (c.getMember("url_prefix").getSize()){
-            for (unsigned int j = 0; j < c.getMember("url_prefix").getSize(); ++j){
-              match |= isPrefix(url, c.getMember("url_prefix").getIndice(j).asString(), streamname);
-            }
-          }else{
-            match |= isPrefix(url, c.getMember("url_prefix").asString(), streamname);
-          }
-        }
-        if (match){
-          if (streamname.size()){
-            Util::sanitizeName(streamname);
-            H.SetVar("stream", streamname);
-          }
-          configLock.post();
-          configLock.close();
-          return capa.getIndiceName(i);
+    //try the compiled routing table of all connectors, written by the controller
+    static IPC::sharedPage routesPage;
+    static Util::RelAccX routes;
+    if (routesPage.mapped && (!routes.isReady() || routes.isExit())){routesPage.close();}
+    if (!routesPage.mapped){
+      routesPage.init(SHM_ROUTES, SHM_ROUTES_SIZE, false, false);
+      if (!routesPage.mapped){return "";}
+      routes = Util::RelAccX(routesPage.mapped, false);
+      if (!routes.isReady()){
+        routesPage.close();
+        return "";
+      }
+    }
+    //The controller publishes a new table by moving the end first, then the start: read them the other way around
+    uint64_t routeStart = routes.getDeleted();
+    __sync_synchronize();
+    uint64_t routeEnd = routes.getEndPos();
+    for (uint64_t i = routeStart; i < routeEnd; ++i){
+      std::string streamname;
+      if (routeMatch(url, routes.getPointer("prefix", i), routes.getPointer("suffix", i), routes.getInt("flags", i), streamname)){
+        if (streamname.size()){
+          Util::sanitizeName(streamname);
+          H.SetVar("stream", streamname);
         }
+        return routes.getPointer("connector", i);
       }
     }
-    configLock.post();
-    configLock.close();
     return "";
   }
   
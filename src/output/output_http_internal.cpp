@@ -3,6 +3,7 @@
 #include <mist/stream.h>
 #include <mist/encode.h>
 #include <mist/langcodes.h>
+#include <mist/bitfields.h>
 #include "flashPlayer.h"
 #include "oldFlashPlayer.h"
 #include <mist/websocket.h>
@@ -287,6 +288,140 @@ namespace Mist {
     }
   }
 
+  /// Mixes the given bytes into a 64-bit FNV-1a hash, a machine word at a time.
+  static uint64_t hashBytes(uint64_t hash, const char * data, size_t len){
+    uint64_t word;
+    while (len >= sizeof(word)){
+      memcpy(&word, data, sizeof(word));
+      hash = (hash ^ word) * 0x100000001b3ull;
+      data += sizeof(word);
+      len -= sizeof(word);
+    }
+    while (len){
+      hash = (hash ^ (uint8_t)*(data++)) * 0x100000001b3ull;
+      --len;
+    }
+    return hash;
+  }
+
+  /// Returns the cache key for the stream info of the given stream, as seen by the given host and user agent.
+  static uint64_t statusKey(const std::string & streamName, const std::string & reqHost, const std::string & useragent){
+    uint64_t hash = hashBytes(0xcbf29ce484222325ull, streamName.data(), streamName.size() + 1);
+    hash = hashBytes(hash, reqHost.data(), reqHost.size() + 1);
+    return hashBytes(hash, useragent.data(), useragent.size());
+  }
+
+  /// Returns a version tag for the stream info with the given cache key, for use as ETag.
+  /// It changes whenever the server config changes, tracks are added or removed, or a track gets a new keyframe.
+  /// It is zero if the stream is not ready.
+  /// This does not connect to the stream: only the track IDs and keyframe counters are read from the
+  /// metadata page, under the stream's live metadata lock.
+  static uint64_t statusVersion(uint64_t key, const std::string & streamName){
+    if (Util::getStreamStatus(streamName) != STRMSTAT_READY){return 0;}
+    char pageName[NAME_BUFFER_SIZE];
+    snprintf(pageName, NAME_BUFFER_SIZE, SHM_STREAM_INDEX, streamName.c_str());
+    IPC::sharedPage metaPage(pageName, DEFAULT_STRM_PAGE_SIZE, false, false);
+    if (!metaPage.mapped){return 0;}
+    IPC::semaphore configLock(SEM_CONF, O_CREAT | O_RDWR, ACCESSPERMS, 1);
+    configLock.wait();
+    IPC::sharedPage serverCfg(SHM_CONF, DEFAULT_CONF_PAGE_SIZE);
+    uint64_t confVersion = DTSC::Scan(serverCfg.mapped, serverCfg.len).getMember("version").asInt();
+    configLock.post();
+    configLock.close();
+    uint64_t hash = hashBytes(key, (const char *)&confVersion, sizeof(confVersion));
+    char liveSemName[NAME_BUFFER_SIZE];
+    snprintf(liveSemName, NAME_BUFFER_SIZE, SEM_LIVE, streamName.c_str());
+    IPC::semaphore metaLocker(liveSemName, O_CREAT | O_RDWR, ACCESSPERMS, 1);
+    metaLocker.wait();
+    if (metaPage.mapped[0] != 'D' || metaPage.mapped[1] != 'T' || Bit::btohl(metaPage.mapped + 4) + 8 > (uint64_t)metaPage.len){
+      metaLocker.post();
+      return 0;
+    }
+    DTSC::Scan trcks = DTSC::Packet(metaPage.mapped, Bit::btohl(metaPage.mapped + 4) + 8, true).getScan().getMember("tracks");
+    unsigned int trcks_ctr = trcks.getSize();
+    for (unsigned int i = 0; i < trcks_ctr; ++i){
+      DTSC::Scan trk = trcks.getIndice(i);
+      char * keys = 0;
+      unsigned int keysLen = 0;
+      trk.getMember("keys").getString(keys, keysLen);
+      //Track ID, amount of keys and number of the last key
+      uint64_t counters[3];
+      counters[0] = trk.getMember("trackid").asInt();
+      counters[1] = keysLen / PACKED_KEY_SIZE;
+      counters[2] = (counters[1] ? ((DTSC::Key *)(keys + (counters[1] - 1) * PACKED_KEY_SIZE))->getNumber() : 0);
+      hash = hashBytes(hash, (const char *)counters, sizeof(counters));
+    }
+    metaLocker.post();
+    return hash ? hash : 1;
+  }
+
+  /// Opens the controller's stream info cache, if available.
+  static Util::RelAccX * infoCache(){
+    static IPC::sharedPage cachePage;
+    static Util::RelAccX cache;
+    if (cachePage.mapped && cache.isExit()){cachePage.close();}
+    if (!cachePage.mapped){
+      cachePage.init(SHM_STATE_INFO, SHM_STATE_INFO_SIZE, false, false);
+      if (!cachePage.mapped){return 0;}
+      cache = Util::RelAccX(cachePage.mapped, false);
+    }
+    return cache.isReady() ? &cache : 0;
+  }
+
+  /// Copies the cached stream info with the given version into response.
+  /// Records are read without locking: a record is only valid if its etag is the same before and after copying.
+  static bool readStatusCache(uint64_t etag, std::string & response){
+    Util::RelAccX * cache = (etag ? infoCache() : 0);
+    if (!cache){return false;}
+    Util::FieldAccX etags = cache->getFieldAccX("etag");
+    for (uint64_t i = 0; i < cache->getEndPos(); ++i){
+      if (etags.uint(i) != etag){continue;}
+      uint32_t size = cache->getInt("size", i);
+      if (size > INFO_CACHE_MAX){return false;}
+      response.assign(cache->getPointer("data", i), size);
+      __sync_synchronize();
+      if (etags.uint(i) != etag){
+        response.clear();
+        return false;
+      }
+      cache->setInt("used", Util::bootSecs(), i);
+      return true;
+    }
+    return false;
+  }
+
+  /// Stores the stream info with the given version and key in the cache.
+  /// Replaces an older version of the same key if there is one, or the least recently used record otherwise.
+  static void writeStatusCache(uint64_t key, uint64_t etag, const std::string & response){
+    if (response.size() > INFO_CACHE_MAX){return;}
+    Util::RelAccX * cache = infoCache();
+    if (!cache){return;}
+    IPC::semaphore cacheLock(SEM_STATE_INFO, O_CREAT | O_RDWR, ACCESSPERMS, 1);
+    cacheLock.wait();
+    uint64_t recordNo = 0;
+    uint64_t oldest = 0xFFFFFFFFFFFFFFFFull;
+    for (uint64_t i = 0; i < cache->getEndPos(); ++i){
+      if (cache->getInt("key", i) == key){
+        recordNo = i;
+        break;
+      }
+      if (cache->getInt("used", i) < oldest){
+        oldest = cache->getInt("used", i);
+        recordNo = i;
+      }
+    }
+    //Invalidate the record while overwriting it, so lock-free readers never see a mix of old and new data
+    cache->setInt("etag", 0, recordNo);
+    __sync_synchronize();
+    cache->setInt("key", key, recordNo);
+    cache->setInt("used", Util::bootSecs(), recordNo);
+    cache->setInt("size", response.size(), recordNo);
+    memcpy(cache->getPointer("data", recordNo), response.data(), response.size());
+    __sync_synchronize();
+    cache->setInt("etag", etag, recordNo);
+    cacheLock.post();
+  }
+
   void OutHTTP::HTMLResponse(){
     std::string method = H.method;
     HTTP::URL fullURL(H.GetHeader("Host"));
@@ -583,8 +718,23 @@ namespace Mist {
       }
       std::string response;
       std::string rURL = H.url;
+      //The stream info is cached per stream, host and user agent, for as long as the config and metadata stay the same
+      std::string etag;
+      std::string statusJSON;
+      uint64_t statusCacheKey = statusKey(streamName, reqHost, useragent);
+      uint64_t statusCacheVersion = 0;
+      bool notModified = false;
       if(method != "OPTIONS" && method != "HEAD"){
-        initialize();
+        statusCacheVersion = statusVersion(statusCacheKey, streamName);
+        if (statusCacheVersion){
+          std::stringstream tag;
+          tag << "\"" << std::hex << statusCacheVersion << "\"";
+          etag = tag.str();
+          notModified = (H.GetHeader("If-None-Match") == etag);
+        }
+        if (!notModified && !readStatusCache(statusCacheVersion, statusJSON)){
+          initialize();
+        }
       }
       H.Clean();
       H.SetHeader("Server", "MistServer/" PACKAGE_VERSION);
@@ -599,14 +749,31 @@ namespace Mist {
         H.Clean();
         return;
       }
+      if (notModified){
+        H.SetHeader("ETag", etag);
+        H.SetHeader("Cache-Control", "no-cache");
+        H.SendResponse("304", "Not Modified", myConn);
+        H.Clean();
+        return;
+      }
+      bool hasError = false;
+      if (!statusJSON.size()){
+        JSON::Value json_resp = getStatusJSON(reqHost, useragent);
+        hasError = json_resp.isMember("error");
+        statusJSON = json_resp.toString();
+        if (statusCacheVersion && !hasError){writeStatusCache(statusCacheKey, statusCacheVersion, statusJSON);}
+      }
+      if (etag.size() && !hasError){
+        H.SetHeader("ETag", etag);
+        H.SetHeader("Cache-Control", "no-cache");
+      }
       response = "// Generating info code for stream " + streamName + "\n\nif (!mistvideo){var mistvideo = {};}\n";
-      JSON::Value json_resp = getStatusJSON(reqHost, useragent);
       if (rURL.substr(0, 6) != "/json_"){
-        response += "mistvideo['" + streamName + "'] = " + json_resp.toString() + ";\n";
+        response += "mistvideo['" + streamName + "'] = " + statusJSON + ";\n";
       }else{
-        response = json_resp.toString();
+        response = statusJSON;
       }
-      if (rURL.substr(0, 7) == "/embed_" && !json_resp.isMember("error")){
+      if (rURL.substr(0, 7) == "/embed_" && !hasError){
         #include "embed.js.h"
         response.append("\n(");
         if (embed_js[embed_js_len - 2] == ';'){//check if we have a trailing ;\n or just \n
@@ -628,144 +795,217 @@ namespace Mist {
       if (!fullURL.protocol.size()){
         fullURL.protocol = getProtocolForPort(fullURL.getPort());
       }
-      std::string response;
-      std::string rURL = H.url;
-      H.Clean();
-      H.SetHeader("Server", "MistServer/" PACKAGE_VERSION);
-      H.setCORSHeaders();
-      H.SetHeader("Content-Type", "application/javascript");
-      if(method == "OPTIONS" || method == "HEAD"){
-        H.SendResponse("200", "OK", myConn);
-        H.Clean();
-        return;
-      }
-      
-      response.append("if (typeof mistoptions == 'undefined') { mistoptions = {}; }\nif (!('host' in mistoptions)) { mistoptions.host = '"+fullURL.getUrl()+"'; }\n");
+      std::string prefix = "if (typeof mistoptions == 'undefined') { mistoptions = {}; }\nif (!('host' in mistoptions)) { mistoptions.host = '"+fullURL.getUrl()+"'; }\n";
+      staticAsset asset("application/javascript");
+      asset.add(prefix.data(), prefix.size());
       #include "core.js.h"
-      response.append((char*)core_js, (size_t)core_js_len);
+      asset.add(core_js, core_js_len);
       jsonForEach(config->getOption("wrappers",true),it){
         bool used = false;
         if (it->asStringRef() == "html5"){
           #include "html5.js.h"
-          response.append((char*)html5_js, (size_t)html5_js_len);
+          asset.add(html5_js, html5_js_len);
           used = true;
         }
         if (it->asStringRef() == "flash_strobe"){
           #include "flash_strobe.js.h"
-          response.append((char*)flash_strobe_js, (size_t)flash_strobe_js_len);
+          asset.add(flash_strobe_js, flash_strobe_js_len);
           used = true;
         }
         if (it->asStringRef() == "silverlight"){
           #include "silverlight.js.h"
-          response.append((char*)silverlight_js, (size_t)silverlight_js_len);
+          asset.add(silverlight_js, silverlight_js_len);
           used = true;
         }
         if (it->asStringRef() == "theoplayer"){
           #include "theoplayer.js.h"
-          response.append((char*)theoplayer_js, (size_t)theoplayer_js_len);
+          asset.add(theoplayer_js, theoplayer_js_len);
           used = true;
         }
         if (it->asStringRef() == "jwplayer"){
           #include "jwplayer.js.h"
-          response.append((char*)jwplayer_js, (size_t)jwplayer_js_len);
+          asset.add(jwplayer_js, jwplayer_js_len);
           used = true;
         }
         if (it->asStringRef() == "polytrope"){
           #include "polytrope.js.h"
-          response.append((char*)polytrope_js, (size_t)polytrope_js_len);
+          asset.add(polytrope_js, polytrope_js_len);
           used = true;
         }
         if (it->asStringRef() == "dashjs"){
           #include "dashjs.js.h"
-          response.append((char*)dash_js, (size_t)dash_js_len);
+          asset.add(dash_js, dash_js_len);
           used = true;
         }
         if (it->asStringRef() == "videojs"){
           #include "videojs.js.h"
-          response.append((char*)video_js, (size_t)video_js_len);
+          asset.add(video_js, video_js_len);
           used = true;
         }
         if (it->asStringRef() == "img"){
           #include "img.js.h"
-          response.append((char*)img_js, (size_t)img_js_len);
+          asset.add(img_js, img_js_len);
           used = true;
         }
         if (!used) {
           WARN_MSG("Unknown player type: %s",it->asStringRef().c_str());
         }
       }
-      
-      H.SetBody(response);
-      H.SendResponse("200", "OK", myConn);
-      H.Clean();
+      sendAsset(method, asset);
       return;
-      
     }
     
     if (H.url == "/player.css"){
-      std::string response;
-      H.Clean();
-      H.SetHeader("Server", "MistServer/" PACKAGE_VERSION);
-      H.setCORSHeaders();
-      H.SetHeader("Content-Type", "text/css");
-      if (method == "OPTIONS" || method == "HEAD"){
-        H.SendResponse("200", "OK", myConn);
-        H.Clean();
-        return;
-      }
-      
+      staticAsset asset("text/css");
       #include "mist.css.h"
-      response.append((char*)mist_css, (size_t)mist_css_len);
-      
-      H.SetBody(response);
-      H.SendResponse("200", "OK", myConn);
-      H.Clean();
+      asset.add(mist_css, mist_css_len);
+#ifdef ASSETS_GZIP
+      #include "playercss.gz.h"
+      asset.gzip = playercss_gz;
+      asset.gzipLen = playercss_gz_len;
+#endif
+#ifdef ASSETS_BROTLI
+      #include "playercss.br.h"
+      asset.brotli = playercss_br;
+      asset.brotliLen = playercss_br_len;
+#endif
+      sendAsset(method, asset);
       return;
     }
     if (H.url == "/videojs.js"){
-      std::string response;
-      H.Clean();
-      H.SetHeader("Server", "MistServer/" PACKAGE_VERSION);
-      H.setCORSHeaders();
-      H.SetHeader("Content-Type", "application/javascript");
-      if (method == "OPTIONS" || method == "HEAD"){
-        H.SendResponse("200", "OK", myConn);
-        H.Clean();
-        return;
-      }
-      
+      staticAsset asset("application/javascript");
       #include "playervideo.js.h"
-      response.append((char*)playervideo_js, (size_t)playervideo_js_len);
+      asset.add(playervideo_js, playervideo_js_len);
       #include "playerhlsvideo.js.h"
-      response.append((char*)playerhlsvideo_js, (size_t)playerhlsvideo_js_len);
-      
-      H.SetBody(response);
-      H.SendResponse("200", "OK", myConn);
-      H.Clean();
+      asset.add(playerhlsvideo_js, playerhlsvideo_js_len);
+#ifdef ASSETS_GZIP
+      #include "videojs.gz.h"
+      asset.gzip = videojs_gz;
+      asset.gzipLen = videojs_gz_len;
+#endif
+#ifdef ASSETS_BROTLI
+      #include "videojs.br.h"
+      asset.brotli = videojs_br;
+      asset.brotliLen = videojs_br_len;
+#endif
+      sendAsset(method, asset);
       return;
     }
     if (H.url == "/dashjs.js"){
-      std::string response;
-      H.Clean();
-      H.SetHeader("Server", "MistServer/" PACKAGE_VERSION);
-      H.setCORSHeaders();
-      H.SetHeader("Content-Type", "application/javascript");
-      if (method == "OPTIONS" || method == "HEAD"){
-        H.SendResponse("200", "OK", myConn);
-        H.Clean();
-        return;
-      }
-      
+      staticAsset asset("application/javascript");
       #include "playerdashlic.js.h"
-      response.append((char*)playerdashlic_js, (size_t)playerdashlic_js_len);
+      asset.add(playerdashlic_js, playerdashlic_js_len);
       #include "playerdash.js.h"
-      response.append((char*)playerdash_js, (size_t)playerdash_js_len);
-      
-      H.SetBody(response);
+      asset.add(playerdash_js, playerdash_js_len);
+#ifdef ASSETS_GZIP
+      #include "dashjs.gz.h"
+      asset.gzip = dashjs_gz;
+      asset.gzipLen = dashjs_gz_len;
+#endif
+#ifdef ASSETS_BROTLI
+      #include "dashjs.br.h"
+      asset.brotli = dashjs_br;
+      asset.brotliLen = dashjs_br_len;
+#endif
+      sendAsset(method, asset);
+      return;
+    }
+  }
+
+  staticAsset::staticAsset(const char * contentType){
+    type = contentType;
+    gzip = 0;
+    gzipLen = 0;
+    brotli = 0;
+    brotliLen = 0;
+  }
+
+  /// Appends a part to the uncompressed contents. The data is not copied, and must outlive the asset.
+  void staticAsset::add(const char * data, size_t len){
+    parts.push_back(std::make_pair(data, len));
+  }
+
+  /// Returns true if the given Accept-Encoding header value allows the given content coding.
+  static bool acceptsEncoding(const std::string & accept, const std::string & coding){
+    size_t pos = 0;
+    while (pos < accept.size()){
+      size_t end = accept.find(',', pos);
+      if (end == std::string::npos){end = accept.size();}
+      std::string entry = accept.substr(pos, end - pos);
+      pos = end + 1;
+      size_t params = entry.find(';');
+      std::string name = entry.substr(0, params);
+      name.erase(0, name.find_first_not_of(" \t"));
+      name.erase(name.find_last_not_of(" \t") + 1);
+      if (strcasecmp(name.c_str(), coding.c_str())){continue;}
+      //A quality of zero means the coding is explicitly refused
+      if (params != std::string::npos){
+        size_t q = entry.find("q=", params);
+        if (q != std::string::npos && atof(entry.c_str() + q + 2) <= 0){return false;}
+      }
+      return true;
+    }
+    return false;
+  }
+
+  /// Sends the given static asset as response to the current request.
+  /// Uses a pre-compressed variant if the client accepts it, supports conditional requests through a strong ETag,
+  /// and writes the compiled-in data straight to the socket instead of copying it into a response body first.
+  void OutHTTP::sendAsset(const std::string & method, const staticAsset & asset){
+    std::string acceptEncoding = H.GetHeader("Accept-Encoding");
+    std::string ifNoneMatch = H.GetHeader("If-None-Match");
+    const char * data = 0;
+    size_t dataLen = 0;
+    std::string encoding;
+    if (asset.brotli && acceptsEncoding(acceptEncoding, "br")){
+      data = asset.brotli;
+      dataLen = asset.brotliLen;
+      encoding = "br";
+    }else if (asset.gzip && acceptsEncoding(acceptEncoding, "gzip")){
+      data = asset.gzip;
+      dataLen = asset.gzipLen;
+      encoding = "gzip";
+    }
+    uint64_t hash = 0xcbf29ce484222325ull;
+    size_t totalLen = 0;
+    for (std::deque<std::pair<const char *, size_t> >::const_iterator it = asset.parts.begin(); it != asset.parts.end(); ++it){
+      hash = hashBytes(hash, it->first, it->second);
+      totalLen += it->second;
+    }
+    std::stringstream tag;
+    tag << "\"" << std::hex << hash << (encoding.size() ? "-" : "") << encoding << "\"";
+    std::string etag = tag.str();
+
+    H.Clean();
+    H.SetHeader("Server", "MistServer/" PACKAGE_VERSION);
+    H.setCORSHeaders();
+    H.SetHeader("Content-Type", asset.type);
+    if (method == "OPTIONS" || method == "HEAD"){
       H.SendResponse("200", "OK", myConn);
       H.Clean();
       return;
     }
+    H.SetHeader("ETag", etag);
+    H.SetHeader("Cache-Control", "public, max-age=3600");
+    if (asset.gzip || asset.brotli){H.SetHeader("Vary", "Accept-Encoding");}
+    if (ifNoneMatch.find(etag) != std::string::npos){
+      H.SendResponse("304", "Not Modified", myConn);
+      H.Clean();
+      return;
+    }
+    if (data){
+      H.SetHeader("Content-Encoding", encoding);
+      H.SetHeader("Content-Length", (long long)dataLen);
+      H.SendResponse("200", "OK", myConn);
+      myConn.SendNow(data, dataLen);
+    }else{
+      H.SetHeader("Content-Length", (long long)totalLen);
+      H.SendResponse("200", "OK", myConn);
+      for (std::deque<std::pair<const char *, size_t> >::const_iterator it = asset.parts.begin(); it != asset.parts.end(); ++it){
+        myConn.SendNow(it->first, it->second);
+      }
+    }
+    H.Clean();
   }
 
   void OutHTTP::sendIcon(){
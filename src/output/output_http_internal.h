@@ -1,7 +1,19 @@
 #include "output_http.h"
-
+#include <deque>
 
 namespace Mist {
+  /// A static response compiled into the binary, made of one or more parts, with optional pre-compressed variants.
+  struct staticAsset{
+    staticAsset(const char * contentType);
+    void add(const char * data, size_t len);
+    const char * type;
+    std::deque<std::pair<const char *, size_t> > parts;///< The uncompressed contents, in order.
+    const char * gzip;///< All parts compressed with gzip, or null if not available.
+    size_t gzipLen;
+    const char * brotli;///< All parts compressed with brotli, or null if not available.
+    size_t brotliLen;
+  };
+
   class OutHTTP : public HTTPOutput {
     public:
       OutHTTP(Socket::Connection & conn);
@@ -14,6 +26,7 @@ namespace Mist {
       void HTMLResponse();
       void onHTTP();
       void sendIcon();
+      void sendAsset(const std::string & method, const staticAsset & asset);
       bool websocketHandler();
       JSON::Value getStatusJSON(std::string & reqHost, const std::string & useragent = "");
       bool stayConnected;
@@ -28,6 +28,17 @@ namespace Mist {
     capa["methods"][0u]["type"] = "flash/7";
     capa["methods"][0u]["priority"] = 5ll;
     capa["methods"][0u]["player_url"] = "/oldflashplayer.swf";
+    capa["optional"]["fanout"]["name"] = "Shared live viewing";
+    capa["optional"]["fanout"]["help"] = "Serve all live viewers of a stream from a single process, which prepares every tag once for all of them. Viewers that fall too far behind are disconnected.";
+    capa["optional"]["fanout"]["type"] = "uint";
+    capa["optional"]["fanout"]["default"] = 0ll;
+    capa["optional"]["fanout"]["option"] = "--fanout";
+    cfg->addOption("fanout", JSON::fromString("{\"arg\":\"integer\",\"value\":[0],\"long\":\"fanout\",\"help\":\"Serve all live viewers of a stream from a single process, if nonzero.\"}"));
+  }
+
+  /// All viewers get the same tags, so they can always share a process.
+  bool OutProgressiveFLV::canFanOut(){
+    return true;
   }
   
   void OutProgressiveFLV::sendNext(){
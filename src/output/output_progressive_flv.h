@@ -9,6 +9,7 @@ namespace Mist {
       void onHTTP();
       void sendNext();
       void sendHeader();
+      bool canFanOut();
     private:
       FLV::Tag tag;
   };
@@ -30,8 +30,12 @@ namespace Mist {
     unsigned int track = thisPacket.getTrackId();
 
 
+    //The segment references the packet in the data page, it is copied only if the page is left before it was sent
     OGG::oggSegment newSegment;
-    thisPacket.getString("data", newSegment.dataString);
+    char * dataPointer = 0;
+    unsigned int len = 0;
+    thisPacket.getString("data", dataPointer, len);
+    newSegment.setData(dataPointer, len);
     pageBuffer[track].totalFrames = ((double)thisPacket.getTime() / (1000000.0f / myMeta.tracks[track].fpks)) + 1.5; //should start at 1. added .5 for rounding.
 
     if (pageBuffer[track].codec == OGG::THEORA){
@@ -57,6 +61,12 @@ namespace Mist {
     }
   }
 
+  void OutProgressiveOGG::onPageLeave(long unsigned int trackId){
+    if (pageBuffer.count(trackId)){
+      pageBuffer[trackId].ownSegments();
+    }
+  }
+
   bool OutProgressiveOGG::onFinish(){
     for (std::map<long long unsigned int, OGG::Page>::iterator it = pageBuffer.begin(); it != pageBuffer.end(); it++){
       it->second.setHeaderType(OGG::EndOfStream);
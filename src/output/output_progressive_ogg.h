@@ -12,6 +12,7 @@ namespace Mist {
       void sendNext();
       void sendHeader();
       bool onFinish();
+      void onPageLeave(long unsigned int trackId);
       bool parseInit(std::string & initData, std::deque<std::string> & output);
     protected:
       HTTP::Parser HTTP_R;//Received HTTP
@@ -5,6 +5,7 @@
 #include <mist/encode.h>
 #include <mist/util.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include <cstring>
 #include <cstdlib>
 
@@ -125,31 +126,25 @@ namespace Mist {
                          0x12, //byte 7 = msg_type_id
                          1, 0, 0, 0, //bytes 8-11 = msg_stream_id = 1
                          0, 0, 0, 0}; //bytes 12-15 = extended timestamp
-    char dataheader[] ={0, 0, 0, 0, 0};
-    unsigned int dheader_len = 1;
+    const trackEncoding & enc = getEncoding(thisPacket.getTrackId());
+    char dataheader[] ={enc.tagHeader, 0, 0, 0, 0};
+    unsigned int dheader_len = enc.headerLen;
     static Util::ResizeablePointer swappy;
     char * tmpData = 0;//pointer to raw media data
     unsigned int data_len = 0;//length of processed media data
     thisPacket.getString("data", tmpData, data_len);
-    DTSC::Track & track = myMeta.tracks[thisPacket.getTrackId()];
-    
-    //set msg_type_id
-    if (track.type == "video"){
-      rtmpheader[7] = 0x09;
-      if (track.codec == "H264"){
-        dheader_len += 4;
-        dataheader[0] = 7;
+    rtmpheader[7] = enc.msgType;
+    if (enc.msgType == 0x09){
+      if (dheader_len > 1){
+        //H264: AVC NALU, with the composition time offset
         dataheader[1] = 1;
-        if (thisPacket.getInt("offset") > 0){
-          long long offset = thisPacket.getInt("offset");
+        long long offset = thisPacket.getInt("offset");
+        if (offset > 0){
           dataheader[2] = (offset >> 16) & 0xFF;
           dataheader[3] = (offset >> 8) & 0xFF;
           dataheader[4] = offset & 0xFF;
         }
       }
-      if (track.codec == "H263"){
-        dataheader[0] = 2;
-      }
       if (thisPacket.getFlag("keyframe")){
         dataheader[0] |= 0x10;
       }else{
@@ -159,65 +154,16 @@ namespace Mist {
         dataheader[0] |= 0x30;
       }
     }
-    
-    if (track.type == "audio"){
-      rtmpheader[7] = 0x08;
-      if (track.codec == "AAC"){
-        dataheader[0] += 0xA0;
-        dheader_len += 1;
+    if (enc.msgType == 0x08){
+      if (dheader_len > 1){
         dataheader[1] = 1; //raw AAC data, not sequence header
       }
-      if (track.codec == "MP3"){
-        dataheader[0] += 0x20;
-        if (track.rate == 8000){
-          dataheader[0] |= 0xE0;
-        }else{
-          dataheader[0] |= 0x20;
-        }
-      }
-      if (track.codec == "ADPCM"){
-        dataheader[0] |= 0x10;
-      }
-      if (track.codec == "PCM"){
-        if (track.size == 16 && swappy.allocate(data_len)){
-          for (uint32_t i = 0; i < data_len; i+=2){
-            swappy[i] = tmpData[i+1];
-            swappy[i+1] = tmpData[i];
-          }
-          tmpData = swappy;
-        }
-        dataheader[0] |= 0x30;
-      }
-      if (track.codec == "Nellymoser"){
-        if (track.rate == 8000){
-          dataheader[0] |= 0x50;
-        }else if(track.rate == 16000){
-          dataheader[0] |= 0x40;
-        }else{
-          dataheader[0] |= 0x60;
+      if (enc.swapBytes && swappy.allocate(data_len)){
+        for (uint32_t i = 0; i < data_len; i+=2){
+          swappy[i] = tmpData[i+1];
+          swappy[i+1] = tmpData[i];
         }
-      }
-      if (track.codec == "ALAW"){
-        dataheader[0] |= 0x70;
-      }
-      if (track.codec == "ULAW"){
-        dataheader[0] |= 0x80;
-      }
-      if (track.codec == "Speex"){
-        dataheader[0] |= 0xB0;
-      }
-      if (track.rate >= 44100){
-        dataheader[0] |= 0x0C;
-      }else if (track.rate >= 22050){
-        dataheader[0] |= 0x08;
-      }else if (track.rate >= 11025){
-        dataheader[0] |= 0x04;
-      }
-      if (track.size != 8){
-        dataheader[0] |= 0x02;
-      }
-      if (track.channels > 1){
-        dataheader[0] |= 0x01;
+        tmpData = swappy;
       }
     }
     data_len += dheader_len;
@@ -292,46 +238,127 @@ namespace Mist {
       rtmpheader[3] = timestamp & 0xff;
     }
     
-    //send the header
-    myConn.setBlocking(true);
-    myConn.SendNow(rtmpheader, header_len);
-    RTMPStream::snd_cnt += header_len; //update the sent data counter
-    //set the header's first byte to the "continue" type chunk, for later use
-    rtmpheader[0] = 0xC4;
+    //Send the message as a single gather write, straight from the data page:
+    //only the chunk headers are specific to this connection
+    unsigned int cont_len = (timestamp >= 0x00ffffff) ? 5 : 1;
+    char contheader[5] ={(char)0xC4, 0, 0, 0, 0}; //"continue" type chunk header
     if (timestamp >= 0x00ffffff){
-      rtmpheader[1] = (timestamp >> 24) & 0xff;
-      rtmpheader[2] = (timestamp >> 16) & 0xff;
-      rtmpheader[3] = (timestamp >> 8) & 0xff;
-      rtmpheader[4] = timestamp & 0xff;
+      contheader[1] = (timestamp >> 24) & 0xff;
+      contheader[2] = (timestamp >> 16) & 0xff;
+      contheader[3] = (timestamp >> 8) & 0xff;
+      contheader[4] = timestamp & 0xff;
     }
-
-    //sent actual data - never send more than chunk_snd_max at a time
+    sendVecs.clear();
+    struct iovec vec;
+    vec.iov_base = rtmpheader;
+    vec.iov_len = header_len;
+    sendVecs.push_back(vec);
+    vec.iov_base = dataheader;
+    vec.iov_len = dheader_len;
+    sendVecs.push_back(vec);
+    unsigned int snd_len = header_len;
+    //never send more than chunk_snd_max at a time
     //interleave blocks of max chunk_snd_max bytes with 0xC4 bytes to indicate continue
     unsigned int len_sent = 0;
     while (len_sent < data_len){
       unsigned int to_send = std::min(data_len - len_sent, RTMPStream::chunk_snd_max);
       if (!len_sent){
-        myConn.SendNow(dataheader, dheader_len);
-        RTMPStream::snd_cnt += dheader_len; //update the sent data counter
         to_send -= dheader_len;
         len_sent += dheader_len;
       }
-      myConn.SendNow(tmpData+len_sent-dheader_len, to_send);
+      vec.iov_base = tmpData + len_sent - dheader_len;
+      vec.iov_len = to_send;
+      sendVecs.push_back(vec);
       len_sent += to_send;
       if (len_sent < data_len){
-        if (timestamp >= 0x00ffffff){
-          myConn.SendNow(rtmpheader, 5);
-          RTMPStream::snd_cnt += 5; //update the sent data counter
+        vec.iov_base = contheader;
+        vec.iov_len = cont_len;
+        sendVecs.push_back(vec);
+        snd_len += cont_len;
+      }
+    }
+    myConn.SendNow(&sendVecs[0], sendVecs.size());
+    RTMPStream::snd_cnt += snd_len + dheader_len; //update the sent data counter
+  }
+
+  /// Returns how packets of the given track are wrapped into RTMP messages, working it out on first use.
+  const OutRTMP::trackEncoding & OutRTMP::getEncoding(unsigned long trackId){
+    std::map<unsigned long, trackEncoding>::iterator it = encodings.find(trackId);
+    if (it != encodings.end()){return it->second;}
+    DTSC::Track & track = myMeta.tracks[trackId];
+    trackEncoding & enc = encodings[trackId];
+    enc.msgType = 0x12;
+    enc.tagHeader = 0;
+    enc.headerLen = 1;
+    enc.swapBytes = false;
+    if (track.type == "video"){
+      enc.msgType = 0x09;
+      if (track.codec == "H264"){
+        enc.headerLen += 4;
+        enc.tagHeader = 7;
+      }
+      if (track.codec == "H263"){
+        enc.tagHeader = 2;
+      }
+    }
+    if (track.type == "audio"){
+      enc.msgType = 0x08;
+      if (track.codec == "AAC"){
+        enc.tagHeader += 0xA0;
+        enc.headerLen += 1;
+      }
+      if (track.codec == "MP3"){
+        enc.tagHeader += 0x20;
+        if (track.rate == 8000){
+          enc.tagHeader |= 0xE0;
         }else{
-          myConn.SendNow(rtmpheader, 1);
-          RTMPStream::snd_cnt += 1; //update the sent data counter
+          enc.tagHeader |= 0x20;
         }
       }
+      if (track.codec == "ADPCM"){
+        enc.tagHeader |= 0x10;
+      }
+      if (track.codec == "PCM"){
+        enc.swapBytes = (track.size == 16);
+        enc.tagHeader |= 0x30;
+      }
+      if (track.codec == "Nellymoser"){
+        if (track.rate == 8000){
+          enc.tagHeader |= 0x50;
+        }else if(track.rate == 16000){
+          enc.tagHeader |= 0x40;
+        }else{
+          enc.tagHeader |= 0x60;
+        }
+      }
+      if (track.codec == "ALAW"){
+        enc.tagHeader |= 0x70;
+      }
+      if (track.codec == "ULAW"){
+        enc.tagHeader |= 0x80;
+      }
+      if (track.codec == "Speex"){
+        enc.tagHeader |= 0xB0;
+      }
+      if (track.rate >= 44100){
+        enc.tagHeader |= 0x0C;
+      }else if (track.rate >= 22050){
+        enc.tagHeader |= 0x08;
+      }else if (track.rate >= 11025){
+        enc.tagHeader |= 0x04;
+      }
+      if (track.size != 8){
+        enc.tagHeader |= 0x02;
+      }
+      if (track.channels > 1){
+        enc.tagHeader |= 0x01;
+      }
     }
-    myConn.setBlocking(false);
+    return enc;
   }
 
   void OutRTMP::sendHeader(){
+    encodings.clear();
     FLV::Tag tag;
     tag.DTSCMetaInit(myMeta, selectedTracks);
     if (tag.len){
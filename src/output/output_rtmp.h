@@ -2,6 +2,8 @@
 #include <mist/flv_tag.h>
 #include <mist/amf.h>
 #include <mist/rtmpchunks.h>
+#include <sys/uio.h>
+#include <vector>
 
 
 namespace Mist {
@@ -23,6 +25,17 @@ namespace Mist {
       void parseChunk(Socket::Buffer & inputBuffer);
       void parseAMFCommand(AMF::Object & amfData, int messageType, int streamId);
       void sendCommand(AMF::Object & amfReply, int messageType, int streamId);
+    private:
+      /// How packets of a track are wrapped into RTMP messages.
+      struct trackEncoding{
+        char msgType; ///< RTMP message type: 8 for audio, 9 for video.
+        char tagHeader; ///< First byte of the FLV tag data, before adding per-packet frame type flags.
+        unsigned int headerLen; ///< Bytes of FLV tag data in front of the media data.
+        bool swapBytes; ///< 16-bit PCM, which must be sent in little-endian byte order.
+      };
+      std::map<unsigned long, trackEncoding> encodings;
+      const trackEncoding & getEncoding(unsigned long trackId);
+      std::vector<struct iovec> sendVecs; ///< Kept between packets to avoid reallocating.
   };
 }
 
@@ -89,10 +89,10 @@ namespace Mist {
         if (Trk.codec == "H264"){
           if (!haveAvcc){
             avccbox.setPayload(Trk.init);
+            avccAnnexB = avccbox.asAnnexB();
             haveAvcc = true;
           }
-          bs = avccbox.asAnnexB();
-          extraSize += bs.size();
+          extraSize += avccAnnexB.size();
         }
       }
       
@@ -116,9 +116,8 @@ namespace Mist {
           }
           if (keyframe){
             if (Trk.codec == "H264"){
-              bs = avccbox.asAnnexB();
-              fillPacket(bs.data(), bs.size(), firstPack, video, keyframe, pkgPid, contPkg);
-              alreadySent += bs.size();
+              fillPacket(avccAnnexB.data(), avccAnnexB.size(), firstPack, video, keyframe, pkgPid, contPkg);
+              alreadySent += avccAnnexB.size();
             }
           }
         }
@@ -27,6 +27,7 @@ namespace Mist {
       TS::Packet packData;
       bool haveAvcc;
       MP4::AVCC avccbox;
+      std::string avccAnnexB;///< Cached Annex B form of avccbox, sent before every H264 keyframe.
       bool appleCompat;
       uint64_t sendRepeatingHeaders; ///< Amount of ms between PAT/PMT. Zero means do not repeat.
       uint64_t lastHeaderTime; ///< Timestamp last PAT/PMT were sent.
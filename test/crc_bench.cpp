@@ -0,0 +1,79 @@
+/// \file crc_bench.cpp
+/// Measures CRC-32 throughput for TS PSI sized and Ogg page sized buffers.
+/// Compares checksum::crc32 and checksum::crc32c against the byte-at-a-time table lookup they replaced,
+/// and checks all lengths and start values give the same results.
+/// Usage: crc_bench [rounds]
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <mist/checksum.h>
+#include <mist/timing.h>
+
+/// Reference implementation: one table lookup per byte, most significant bit first.
+static unsigned int refCRC(unsigned int crc, const char * data, size_t len){
+  static unsigned int table[256];
+  if (!table[1]){
+    for (unsigned int i = 0; i < 256; ++i){
+      unsigned int c = i << 24;
+      for (int j = 0; j < 8; ++j){c = (c << 1) ^ ((c & 0x80000000U) ? 0x04C11DB7U : 0);}
+      table[i] = c;
+    }
+  }
+  while (len--){crc = table[((unsigned char)*(data++)) ^ (crc >> 24)] ^ (crc << 8);}
+  return crc;
+}
+
+static unsigned int swap32(unsigned int v){
+  return (v >> 24) | ((v >> 8) & 0xFF00U) | ((v << 8) & 0xFF0000U) | (v << 24);
+}
+
+/// Times rounds CRCs over bufSize bytes each, for both the reference and the library implementation.
+static void bench(const std::string & data, size_t bufSize, unsigned long long rounds){
+  unsigned int refSum = 0, libSum = 0;
+  size_t offsets = data.size() - bufSize;
+  unsigned long long start = Util::getMicros();
+  for (unsigned long long i = 0; i < rounds; ++i){
+    refSum ^= refCRC(0, data.data() + (i * 64) % offsets, bufSize);
+  }
+  unsigned long long refTime = Util::getMicros() - start;
+  start = Util::getMicros();
+  for (unsigned long long i = 0; i < rounds; ++i){
+    libSum ^= checksum::crc32c(0, data.data() + (i * 64) % offsets, bufSize);
+  }
+  unsigned long long libTime = Util::getMicros() - start;
+  if (!refTime){refTime = 1;}
+  if (!libTime){libTime = 1;}
+  std::cout << bufSize << " byte buffers: byte-at-a-time " << (rounds * bufSize / refTime) << " MB/s, checksum::crc32c "
+            << (rounds * bufSize / libTime) << " MB/s" << (refSum == libSum ? "" : " (MISMATCH)") << std::endl;
+}
+
+int main(int argc, char ** argv){
+  unsigned long long rounds = (argc > 1 ? atoll(argv[1]) : 200000);
+  std::string data;
+  srand(42);
+  for (unsigned int i = 0; i < 1024 * 1024; ++i){data += (char)(rand() % 256);}
+
+  //Every length up to a few folding rounds, at varying alignments and start values
+  for (size_t len = 0; len < 1024; ++len){
+    unsigned int init = (len % 3 ? 0 : 0xFFFFFFFFU) ^ (len * 0x9E3779B9U);
+    const char * p = data.data() + len % 61;
+    if (checksum::crc32c(init, p, len) != refCRC(init, p, len)){
+      std::cerr << "crc32c mismatch at length " << len << std::endl;
+      return 1;
+    }
+    if (checksum::crc32(init, p, len) != swap32(refCRC(swap32(init), p, len))){
+      std::cerr << "crc32 mismatch at length " << len << std::endl;
+      return 1;
+    }
+  }
+  if (checksum::crc32c(0, data.data(), data.size()) != refCRC(0, data.data(), data.size())){
+    std::cerr << "crc32c mismatch on full buffer" << std::endl;
+    return 1;
+  }
+
+  bench(data, 184, rounds);
+  bench(data, 4096, rounds / 10);
+  bench(data, 65025, rounds / 100);
+  return 0;
+}
@@ -0,0 +1,80 @@
+/// \file dtsc_read_bench.cpp
+/// Measures how many packets per second DTSC::File can read in playback order, like inputDTSC does.
+/// Writes a synthetic two-track DTSC file of the given size first, unless it already exists.
+/// Usage: dtsc_read_bench [file] [megabytes]
+
+#include <cstdlib>
+#include <iostream>
+#include <sys/stat.h>
+#include <mist/dtsc.h>
+#include <mist/timing.h>
+
+/// Writes an interleaved video (25fps, ~16KiB packets) and audio (~50fps, ~512 byte packets) file.
+static bool writeBenchFile(const std::string & fileName, unsigned long long megabytes){
+  DTSC::File F(fileName, true);
+  if (!F){
+    std::cerr << "Could not create " << fileName << std::endl;
+    return false;
+  }
+  JSON::Value meta;
+  meta["tracks"]["video1"]["trackid"] = 1ll;
+  meta["tracks"]["video1"]["type"] = "video";
+  meta["tracks"]["video1"]["codec"] = "H264";
+  meta["tracks"]["audio2"]["trackid"] = 2ll;
+  meta["tracks"]["audio2"]["type"] = "audio";
+  meta["tracks"]["audio2"]["codec"] = "AAC";
+  meta["vod"] = 1ll;
+  std::string header = meta.toPacked();
+  F.writeHeader(header, true);
+  std::string videoData(16 * 1024, 'v'), audioData(512, 'a');
+  unsigned long long written = 0;
+  for (unsigned long long time = 0; written < megabytes * 1024 * 1024; time += 20){
+    JSON::Value pack;
+    pack["trackid"] = 2ll;
+    pack["time"] = (long long)time;
+    pack["data"] = audioData;
+    std::string packed = pack.toNetPacked();
+    F.writePacket(packed);
+    written += packed.size();
+    if (time % 40 == 0){
+      pack["trackid"] = 1ll;
+      pack["data"] = videoData;
+      if (time % 2000 == 0){pack["keyframe"] = 1ll;}
+      packed = pack.toNetPacked();
+      F.writePacket(packed);
+      written += packed.size();
+    }
+  }
+  return true;
+}
+
+int main(int argc, char ** argv){
+  std::string fileName = (argc > 1 ? argv[1] : "/tmp/dtsc_read_bench.dtsc");
+  unsigned long long megabytes = (argc > 2 ? atoll(argv[2]) : 1024);
+  struct stat st;
+  if (stat(fileName.c_str(), &st) && !writeBenchFile(fileName, megabytes)){return 1;}
+  DTSC::File F(fileName);
+  if (!F){
+    std::cerr << "Could not open " << fileName << std::endl;
+    return 1;
+  }
+  std::set<unsigned long> tracks;
+  tracks.insert(1);
+  tracks.insert(2);
+  unsigned long long start = Util::getMicros();
+  F.selectTracks(tracks);
+  unsigned long long packets = 0, bytes = 0, lastTime = 0;
+  for (F.seekNext(); F.getPacket(); F.seekNext()){
+    if (F.getPacket().getTime() < lastTime){
+      std::cerr << "Packets out of order at " << F.getPacket().getTime() << std::endl;
+      return 1;
+    }
+    lastTime = F.getPacket().getTime();
+    bytes += F.getPacket().getDataLen();
+    ++packets;
+  }
+  unsigned long long duration = Util::getMicros() - start;
+  if (!duration){duration = 1;}
+  std::cout << packets << " packets (" << (bytes / 1024 / 1024) << "MiB, up to " << lastTime << "ms) in " << (duration / 1000) << "ms: " << (packets * 1000000 / duration) << " packets/s" << std::endl;
+  return 0;
+}
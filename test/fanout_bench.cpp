@@ -0,0 +1,134 @@
+/// \file fanout_bench.cpp
+/// Measures how many live viewers a single FanOut::Hub can serve per core.
+/// Hands the given amount of socket pairs over to a hub, drains the other ends from a forked reader process,
+/// and writes FLV-like packets (25 video tags of 10KiB and 50 audio tags of 512 bytes per second of media, about 2 Mbit/s)
+/// into the hub at the given multiple of real time speed. CPU time of the hub process is compared to the media time delivered.
+/// Usage: fanout_bench [viewers] [seconds of media] [speed]
+
+#include <cstdlib>
+#include <iostream>
+#include <signal.h>
+#include <string>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+#include <mist/fanout.h>
+#include <mist/stream.h>
+#include <mist/timing.h>
+
+#define VIDEO_SIZE 10240
+#define AUDIO_SIZE 512
+
+/// Reads everything from the given sockets until all of them are closed.
+/// \returns The amount of bytes read.
+static unsigned long long drain(const std::vector<int> & socks){
+  unsigned long long total = 0;
+  int ep = epoll_create1(0);
+  for (unsigned int i = 0; i < socks.size(); ++i){
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.fd = socks[i];
+    epoll_ctl(ep, EPOLL_CTL_ADD, socks[i], &ev);
+  }
+  unsigned int open = socks.size();
+  char buf[65536];
+  struct epoll_event events[256];
+  while (open){
+    int count = epoll_wait(ep, events, 256, 1000);
+    for (int i = 0; i < count; ++i){
+      ssize_t r = read(events[i].data.fd, buf, sizeof(buf));
+      if (r <= 0){
+        close(events[i].data.fd);
+        --open;
+      }else{
+        total += r;
+      }
+    }
+  }
+  return total;
+}
+
+static unsigned long long cpuMicros(){
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return (unsigned long long)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000 + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+int main(int argc, char ** argv){
+  unsigned int viewerCount = (argc > 1 ? atoi(argv[1]) : 200);
+  unsigned int seconds = (argc > 2 ? atoi(argv[2]) : 20);
+  unsigned int speed = (argc > 3 ? atoi(argv[3]) : 4);
+  if (!speed){speed = 1;}
+  signal(SIGPIPE, SIG_IGN);
+
+  std::string path = Util::getTmpFolder() + "MstFanBench";
+  FanOut::Hub hub(path);
+  if (!hub.connected()){
+    std::cerr << "Could not start hub on " << path << std::endl;
+    return 1;
+  }
+
+  std::vector<int> hubEnds, readerEnds;
+  for (unsigned int i = 0; i < viewerCount; ++i){
+    int pair[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair)){break;}
+    hubEnds.push_back(pair[0]);
+    readerEnds.push_back(pair[1]);
+  }
+  int result[2];
+  if (pipe(result)){return 1;}
+  pid_t reader = fork();
+  if (!reader){
+    for (unsigned int i = 0; i < hubEnds.size(); ++i){close(hubEnds[i]);}
+    unsigned long long total = drain(readerEnds);
+    if (write(result[1], &total, sizeof(total)) < 0){_exit(1);}
+    _exit(0);
+  }
+  for (unsigned int i = 0; i < readerEnds.size(); ++i){close(readerEnds[i]);}
+  for (unsigned int i = 0; i < hubEnds.size(); ++i){
+    if (!FanOut::handOff(path, hubEnds[i], std::string(16, '\000'), i)){std::cerr << "Hand-off " << i << " failed" << std::endl;}
+    close(hubEnds[i]);
+  }
+  while (hub.viewerCount() < hubEnds.size()){Util::sleep(10);}
+
+  std::string video(VIDEO_SIZE, 'v');
+  std::string audio(AUDIO_SIZE, 'a');
+  hub.SendNow("FLV header");
+  hub.setHeader();
+  unsigned long long cpuStart = cpuMicros();
+  unsigned long long start = Util::getMicros();
+  //Packets in time order: one video tag every 40ms, one audio tag every 20ms
+  for (unsigned long long ms = 0; ms < seconds * 1000ull; ms += 20){
+    if (ms % 40 == 0){
+      hub.SendNow(video);
+      hub.sendPacket(ms, ms % 2000 == 0);
+    }
+    hub.SendNow(audio);
+    hub.sendPacket(ms, false);
+    //Like a live stream, don't run ahead of the clock
+    unsigned long long mediaTime = ms * 1000 / speed;
+    unsigned long long now = Util::getMicros() - start;
+    if (mediaTime > now + 1000){Util::sleep((mediaTime - now) / 1000);}
+  }
+  //Let the queues empty before disconnecting everyone
+  Util::sleep(500);
+  size_t served = hub.viewerCount();
+  uint64_t dropped = hub.droppedCount();
+  unsigned long long cpu = cpuMicros() - cpuStart;
+  unsigned long long duration = Util::getMicros() - start;
+  hub.close();
+  unsigned long long bytes = 0;
+  if (read(result[0], &bytes, sizeof(bytes)) != sizeof(bytes)){bytes = 0;}
+  waitpid(reader, 0, 0);
+  if (!cpu){cpu = 1;}
+
+  unsigned long long rate = 25 * VIDEO_SIZE + 50 * AUDIO_SIZE;
+  std::cout << served << " viewers received " << (bytes / 1048576) << "MiB (" << (bytes / rate) << "s of media in total) in "
+            << (duration / 1000) << "ms, using " << (cpu / 1000) << "ms of hub CPU time" << std::endl;
+  std::cout << dropped << " viewers dropped for falling behind" << std::endl;
+  std::cout << "About " << (bytes / rate * 1000000 / cpu) << " viewers per core at " << (rate * 8 / 1000) << " kbit/s" << std::endl;
+  return 0;
+}
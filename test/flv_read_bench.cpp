@@ -0,0 +1,96 @@
+/// \file flv_read_bench.cpp
+/// Compares reading all tags of an FLV file through FLV::Tag::FileLoader and through FLV::BlockReader,
+/// the way inputFLV::readHeader used to and now does.
+/// Writes a synthetic FLV file of the given size first, unless it already exists.
+/// Usage: flv_read_bench [file] [megabytes]
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sys/stat.h>
+#include <mist/flv_tag.h>
+#include <mist/timing.h>
+#include <mist/util.h>
+
+/// Writes a single tag of the given type, time and body size, followed by its previous tag size.
+static void writeTag(FILE * f, char type, unsigned long long time, unsigned int size){
+  static char body[32 * 1024];
+  char hdr[11];
+  hdr[0] = type;
+  hdr[1] = (size >> 16) & 0xFF;
+  hdr[2] = (size >> 8) & 0xFF;
+  hdr[3] = size & 0xFF;
+  hdr[4] = (time >> 16) & 0xFF;
+  hdr[5] = (time >> 8) & 0xFF;
+  hdr[6] = time & 0xFF;
+  hdr[7] = (time >> 24) & 0xFF;
+  hdr[8] = hdr[9] = hdr[10] = 0;
+  fwrite(hdr, 11, 1, f);
+  fwrite(body, size, 1, f);
+  unsigned int prev = size + 11;
+  char trailer[4] = {(char)(prev >> 24), (char)(prev >> 16), (char)(prev >> 8), (char)prev};
+  fwrite(trailer, 4, 1, f);
+}
+
+/// Writes an interleaved video (25fps, ~16KiB tags) and audio (~50fps, ~512 byte tags) file.
+static bool writeBenchFile(const std::string & fileName, unsigned long long megabytes){
+  FILE * f = fopen(fileName.c_str(), "w");
+  if (!f){
+    std::cerr << "Could not create " << fileName << std::endl;
+    return false;
+  }
+  fwrite(FLV::Header, 13, 1, f);
+  unsigned long long written = 0;
+  for (unsigned long long time = 0; written < megabytes * 1024 * 1024; time += 20){
+    writeTag(f, 0x08, time, 512);
+    written += 527;
+    if (time % 40 == 0){
+      writeTag(f, 0x09, time, 16 * 1024);
+      written += 16 * 1024 + 15;
+    }
+  }
+  fclose(f);
+  return true;
+}
+
+int main(int argc, char ** argv){
+  std::string fileName = (argc > 1 ? argv[1] : "/tmp/flv_read_bench.flv");
+  unsigned long long megabytes = (argc > 2 ? atoll(argv[2]) : 1024);
+  struct stat st;
+  if (stat(fileName.c_str(), &st) && !writeBenchFile(fileName, megabytes)){return 1;}
+  FLV::Tag tag;
+
+  FILE * f = fopen(fileName.c_str(), "r");
+  if (!f){
+    std::cerr << "Could not open " << fileName << std::endl;
+    return 1;
+  }
+  Util::fseek(f, 13, SEEK_SET);
+  unsigned long long start = Util::getMicros();
+  unsigned long long tags = 0, lastPos = 0;
+  while (!feof(f) && !FLV::Parse_Error){
+    if (tag.FileLoader(f)){
+      ++tags;
+      lastPos = Util::ftell(f);
+    }
+  }
+  unsigned long long duration = Util::getMicros() - start;
+  fclose(f);
+  if (!duration){duration = 1;}
+  std::cout << "FileLoader: " << tags << " tags up to byte " << lastPos << " in " << (duration / 1000) << "ms: " << (tags * 1000000 / duration) << " tags/s" << std::endl;
+
+  FLV::BlockReader reader;
+  if (!reader.open(fileName)){return 1;}
+  reader.seek(13);
+  start = Util::getMicros();
+  tags = 0;
+  while (!FLV::Parse_Error && reader.readTag(tag)){
+    ++tags;
+    lastPos = reader.getPos();
+  }
+  duration = Util::getMicros() - start;
+  if (!duration){duration = 1;}
+  std::cout << "BlockReader: " << tags << " tags up to byte " << lastPos << " in " << (duration / 1000) << "ms: " << (tags * 1000000 / duration) << " tags/s" << std::endl;
+  return FLV::Parse_Error ? 1 : 0;
+}
@@ -0,0 +1,56 @@
+/// \file http_parser_bench.cpp
+/// Measures how many segment-style requests per second HTTP::Parser can parse and answer.
+/// Every iteration parses a typical HLS segment request from a pipelined buffer and renders a
+/// response with CORS headers, like the HTTP outputs do for every segment.
+/// Usage: http_parser_bench [requests]
+
+#include <cstdlib>
+#include <iostream>
+#include <mist/http_parser.h>
+#include <mist/timing.h>
+
+#define BENCH_BATCH 64
+
+static const char *benchRequest =
+    "GET /hls/live/1234_5678/segment_1234.ts?sessId=5678&tkn=abcdef HTTP/1.1\r\n"
+    "Host: edge.example.com:8080\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko)\r\n"
+    "Accept: */*\r\n"
+    "Accept-Language: en-US,en;q=0.5\r\n"
+    "Accept-Encoding: gzip, deflate\r\n"
+    "Origin: https://player.example.com\r\n"
+    "Connection: keep-alive\r\n"
+    "Referer: https://player.example.com/watch\r\n"
+    "X-Playback-Session-Id: 0123456789ABCDEF\r\n"
+    "\r\n";
+
+int main(int argc, char **argv){
+  unsigned long long requests = (argc > 1 ? atoll(argv[1]) : 1000000);
+  std::string batch;
+  for (unsigned int i = 0; i < BENCH_BATCH; ++i){batch += benchRequest;}
+  HTTP::Parser H;
+  std::string buffer;
+  unsigned long long handled = 0, bytes = 0;
+  unsigned long long start = Util::getMicros();
+  while (handled < requests){
+    buffer = batch;
+    while (H.Read(buffer)){
+      if (H.GetHeader("Connection") == "close" || !H.GetVar("sessId").size()){
+        std::cerr << "Request was not parsed correctly" << std::endl;
+        return 1;
+      }
+      H.Clean();
+      H.SetHeader("Content-Type", "video/mp2t");
+      H.setCORSHeaders();
+      H.SetHeader("Content-Length", 1234567);
+      bytes += H.BuildResponse("200", "OK").size();
+      H.Clean();
+      ++handled;
+    }
+  }
+  unsigned long long duration = Util::getMicros() - start;
+  if (!duration){duration = 1;}
+  std::cout << handled << " requests in " << (duration / 1000) << "ms: " << (handled * 1000000 / duration)
+            << " requests/s (" << (bytes / handled) << " response header bytes each)" << std::endl;
+  return 0;
+}
@@ -0,0 +1,105 @@
+/// \file input_page_bench.cpp
+/// Measures time-to-page of a running VoD input under concurrent seek load.
+/// Registers the given amount of viewers on the stream's user page, like outputs do. Each viewer
+/// repeatedly requests a random key of a random track, and waits until the page holding it is loaded.
+/// Start the input first, e.g.: MistInDTSC -s bench file.dtsc
+/// Usage: input_page_bench stream [viewers] [seeks]
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+#include <mist/bitfields.h>
+#include <mist/defines.h>
+#include <mist/dtsc.h>
+#include <mist/shared_memory.h>
+#include <mist/timing.h>
+
+/// A single simulated viewer.
+struct benchViewer {
+  IPC::sharedClient user;
+  unsigned long track;
+  unsigned long keyNum;
+  uint64_t seekStart;
+};
+
+/// Returns true if the given key is listed on the given track index page.
+static bool keyLoaded(IPC::sharedPage & index, unsigned long keyNum){
+  for (unsigned int i = 0; i < SHM_TRACK_INDEX_SIZE / 8; ++i){
+    unsigned long pageNum = Bit::btohl(index.mapped + i * 8);
+    unsigned long keyAmount = Bit::btohl(index.mapped + i * 8 + 4);
+    if (keyAmount && pageNum <= keyNum && keyNum < pageNum + keyAmount){return true;}
+  }
+  return false;
+}
+
+int main(int argc, char ** argv){
+  if (argc < 2){
+    std::cerr << "Usage: " << argv[0] << " stream [viewers] [seeks]" << std::endl;
+    return 1;
+  }
+  std::string streamName = argv[1];
+  unsigned int viewerCount = (argc > 2 ? atoi(argv[2]) : 300);
+  unsigned int seekCount = (argc > 3 ? atoi(argv[3]) : 1000);
+
+  char pageName[NAME_BUFFER_SIZE];
+  snprintf(pageName, NAME_BUFFER_SIZE, SHM_STREAM_INDEX, streamName.c_str());
+  IPC::sharedPage metaPage(pageName, DEFAULT_STRM_PAGE_SIZE, false, false);
+  if (!metaPage.mapped){
+    std::cerr << "Stream " << streamName << " is not loaded" << std::endl;
+    return 1;
+  }
+  DTSC::Meta meta;
+  meta.reinit(DTSC::Packet(metaPage.mapped, metaPage.len, true));
+  std::map<unsigned long, IPC::sharedPage> indexes;
+  std::vector<unsigned long> tracks;
+  for (std::map<unsigned int, DTSC::Track>::iterator it = meta.tracks.begin(); it != meta.tracks.end(); ++it){
+    snprintf(pageName, NAME_BUFFER_SIZE, SHM_TRACK_INDEX, streamName.c_str(), (unsigned long)it->first);
+    indexes[it->first].init(pageName, SHM_TRACK_INDEX_SIZE, false);
+    if (!indexes[it->first].mapped){
+      std::cerr << "Track " << it->first << " has no index page" << std::endl;
+      return 1;
+    }
+    tracks.push_back(it->first);
+  }
+
+  snprintf(pageName, NAME_BUFFER_SIZE, SHM_USERS, streamName.c_str());
+  std::vector<benchViewer> viewers(viewerCount);
+  srand(42);
+  for (std::vector<benchViewer>::iterator it = viewers.begin(); it != viewers.end(); ++it){
+    it->user = IPC::sharedClient(pageName, PLAY_EX_SIZE, true);
+    it->seekStart = 0;
+  }
+
+  std::vector<uint64_t> times;
+  uint64_t start = Util::bootMS();
+  while (times.size() < seekCount){
+    for (std::vector<benchViewer>::iterator it = viewers.begin(); it != viewers.end(); ++it){
+      if (it->seekStart && keyLoaded(indexes[it->track], it->keyNum + 1)){
+        times.push_back(Util::bootMS() - it->seekStart);
+        it->seekStart = 0;
+      }
+      if (!it->seekStart){
+        //Seek to a random key of a random track
+        it->track = tracks[rand() % tracks.size()];
+        it->keyNum = rand() % meta.tracks[it->track].keys.size();
+        it->seekStart = Util::bootMS();
+        IPC::userConnection userConn(it->user.getData());
+        userConn.setTrackId(0, it->track);
+        userConn.setKeynum(0, it->keyNum);
+      }
+      it->user.keepAlive();
+    }
+    Util::sleep(1);
+  }
+  uint64_t duration = Util::bootMS() - start;
+  for (std::vector<benchViewer>::iterator it = viewers.begin(); it != viewers.end(); ++it){it->user.finish();}
+
+  std::sort(times.begin(), times.end());
+  uint64_t total = 0;
+  for (std::vector<uint64_t>::iterator it = times.begin(); it != times.end(); ++it){total += *it;}
+  std::cout << times.size() << " seeks by " << viewerCount << " viewers in " << duration << "ms: time-to-page average "
+            << (total / times.size()) << "ms, median " << times[times.size() / 2] << "ms, 95th percentile "
+            << times[times.size() * 95 / 100] << "ms" << std::endl;
+  return 0;
+}
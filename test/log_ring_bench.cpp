@@ -0,0 +1,95 @@
+/// \file log_ring_bench.cpp
+/// Compares logging from many processes through the standard error pipe parsed by Util::logParser,
+/// the way child processes of the controller used to log, against logging through the shared memory LogRing.
+/// Forks the given amount of writers that each log the given amount of messages as fast as they can,
+/// while the parent formats everything it receives and writes it to /dev/null.
+/// Usage: log_ring_bench [writers] [messages per writer]
+
+#include <cstdlib>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+#include <mist/defines.h>
+#include <mist/log_ring.h>
+#include <mist/timing.h>
+#include <mist/util.h>
+
+#define BENCH_RING "MstLogRingBench"
+
+static std::string lines;
+static unsigned long long received = 0;
+
+static void formatRecord(const LogRing::record & r){
+  std::string message(r.message, r.msgLen);
+  Util::logFormat(lines, false, DBG_LVL_LIST[r.level], r.program, "0", r.origin, message.c_str());
+  ++received;
+}
+
+/// Forks writerCount processes that log msgCount messages each, with standard error going to errFd.
+static std::vector<pid_t> startWriters(unsigned int writerCount, unsigned int msgCount, int errFd, bool useRing){
+  std::vector<pid_t> writers;
+  for (unsigned int i = 0; i < writerCount; ++i){
+    pid_t pid = fork();
+    if (!pid){
+      dup2(errFd, STDERR_FILENO);
+      if (useRing && !LogRing::attach(BENCH_RING)){_exit(1);}
+      for (unsigned int j = 0; j < msgCount; ++j){
+        LogRing::log(DLVL_INFO, __FILE__, __LINE__, "Writer %u message %u: %s", i, j, "some typical log message content");
+      }
+      _exit(0);
+    }
+    writers.push_back(pid);
+  }
+  return writers;
+}
+
+static void report(const char * name, unsigned long long count, unsigned long long duration){
+  if (!duration){duration = 1;}
+  std::cout << name << ": " << count << " messages in " << (duration / 1000) << "ms: " << (count * 1000000 / duration) << " messages/s" << std::endl;
+}
+
+int main(int argc, char ** argv){
+  unsigned int writerCount = (argc > 1 ? atoi(argv[1]) : 8);
+  unsigned int msgCount = (argc > 2 ? atoi(argv[2]) : 100000);
+  int devNull = open("/dev/null", O_WRONLY);
+
+  //Pipe: all writers share the write end, the parent parses the read end
+  int pipes[2];
+  if (pipe(pipes)){return 1;}
+  unsigned long long start = Util::getMicros();
+  std::vector<pid_t> writers = startWriters(writerCount, msgCount, pipes[1], false);
+  close(pipes[1]);
+  Util::logParser(pipes[0], devNull, false);
+  close(pipes[0]);
+  for (unsigned int i = 0; i < writers.size(); ++i){waitpid(writers[i], 0, 0);}
+  report("Log pipe", (unsigned long long)writerCount * msgCount, Util::getMicros() - start);
+
+  //Ring: writers append without system calls, the parent drains in batches
+  if (!LogRing::create(BENCH_RING)){
+    std::cerr << "Could not create ring" << std::endl;
+    return 1;
+  }
+  start = Util::getMicros();
+  writers = startWriters(writerCount, msgCount, devNull, true);
+  unsigned int running = writers.size();
+  while (true){
+    if (LogRing::drain(formatRecord)){
+      if (write(devNull, lines.data(), lines.size()) < 0){break;}
+      lines.clear();
+      continue;
+    }
+    if (!running){break;}
+    pid_t pid = waitpid(-1, 0, WNOHANG);
+    if (pid > 0){
+      --running;
+    }else{
+      Util::sleep(1);
+    }
+  }
+  report("Log ring", received, Util::getMicros() - start);
+  std::cout << LogRing::overflows() << " messages went to standard error instead, because the ring was full" << std::endl;
+  LogRing::destroy(false);
+  return 0;
+}
@@ -0,0 +1,97 @@
+/// \file nal_scan_bench.cpp
+/// Measures Annex B start code scanning and emulation prevention removal throughput.
+/// Compares nalu::scanAnnexB against a plain byte-by-byte search, and checks both find the same start codes.
+/// Reads a raw Annex B H264 file if given, or generates a pseudo-random one otherwise.
+/// Usage: nal_scan_bench [file] [rounds]
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <mist/nal.h>
+#include <mist/timing.h>
+
+/// Reference implementation: checks every single byte position.
+static const char * scalarScan(const char * data, uint32_t dataSize){
+  for (uint32_t i = 0; i + 2 < dataSize; ++i){
+    if (!data[i] && !data[i + 1] && data[i + 2] == 1){return data + i;}
+  }
+  return 0;
+}
+
+/// Generates 64MiB of random NAL units of 1-64KiB, with the occasional emulation prevention sequence.
+static std::string generateData(){
+  std::string result;
+  srand(42);
+  while (result.size() < 64 * 1024 * 1024){
+    result.append("\000\000\000\001", 4);
+    unsigned int nalSize = 1024 + rand() % (63 * 1024);
+    for (unsigned int i = 0; i < nalSize; ++i){
+      char c = rand() % 256;
+      if (!c){
+        result.append("\000\000\003", 3);
+        i += 2;
+        continue;
+      }
+      result += c;
+    }
+  }
+  return result;
+}
+
+/// Counts start codes in data using the given scanner, printing the throughput.
+static unsigned long long runScan(const std::string & data, unsigned int rounds, const char * name, const char * (*scanner)(const char *, uint32_t)){
+  unsigned long long found = 0;
+  unsigned long long start = Util::getMicros();
+  for (unsigned int r = 0; r < rounds; ++r){
+    const char * p = data.data();
+    const char * end = data.data() + data.size();
+    while (p < end){
+      p = scanner(p, end - p);
+      if (!p){break;}
+      ++found;
+      p += 3;
+    }
+  }
+  unsigned long long duration = Util::getMicros() - start;
+  if (!duration){duration = 1;}
+  std::cout << name << ": " << (found / rounds) << " start codes, " << (data.size() * rounds / duration) << " MB/s" << std::endl;
+  return found;
+}
+
+int main(int argc, char ** argv){
+  std::string data;
+  if (argc > 1){
+    std::ifstream inFile(argv[1], std::ios::binary);
+    std::stringstream contents;
+    contents << inFile.rdbuf();
+    data = contents.str();
+  }else{
+    data = generateData();
+  }
+  if (data.size() < 3){
+    std::cerr << "Not enough data to scan" << std::endl;
+    return 1;
+  }
+  unsigned int rounds = (argc > 2 ? atoi(argv[2]) : 10);
+  if (!rounds){rounds = 1;}
+  if (runScan(data, rounds, "scalar", scalarScan) != runScan(data, rounds, "scanAnnexB", nalu::scanAnnexB)){
+    std::cerr << "Scanners disagree on the number of start codes!" << std::endl;
+    return 1;
+  }
+  std::string copy;
+  unsigned long long newSize = 0;
+  unsigned long long start = Util::getMicros();
+  for (unsigned int r = 0; r < rounds; ++r){
+    copy = data;
+    newSize = nalu::removeEmulationPrevention((char *)copy.data(), copy.size());
+  }
+  unsigned long long duration = Util::getMicros() - start;
+  if (!duration){duration = 1;}
+  if (copy.substr(0, newSize) != nalu::removeEmulationPrevention(data)){
+    std::cerr << "In-place and copying emulation prevention removal disagree!" << std::endl;
+    return 1;
+  }
+  std::cout << "removeEmulationPrevention: " << (data.size() - newSize) << " bytes removed, " << (data.size() * rounds / duration) << " MB/s" << std::endl;
+  return 0;
+}
@@ -0,0 +1,79 @@
+/// \file proc_watch_bench.cpp
+/// Measures how quickly exits of child processes are noticed, and what checking many processes for liveness costs.
+/// Forks the given amount of idle processes, then compares a round of Util::Procs::isRunning calls over all of them
+/// (as sharedServer::parseEach used to do) against a round through Util::PidWatch.
+/// Only the first PIDWATCH_MAX processes are watched through pidfds; the rest fall back to signals, like isRunning.
+/// Afterwards, kills children started through Util::Procs one by one and times until the exit handler is called.
+/// Usage: proc_watch_bench [processes] [rounds]
+
+#include <cstdlib>
+#include <iostream>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+#include <mist/procs.h>
+#include <mist/timing.h>
+
+static volatile unsigned long long exitTime = 0;
+
+static void childExited(pid_t pid, int exitCode){exitTime = Util::getMicros();}
+
+int main(int argc, char ** argv){
+  unsigned int procCount = (argc > 1 ? atoi(argv[1]) : PIDWATCH_MAX);
+  unsigned int rounds = (argc > 2 ? atoi(argv[2]) : 1000);
+
+  std::vector<pid_t> procs;
+  for (unsigned int i = 0; i < procCount; ++i){
+    pid_t pid = fork();
+    if (!pid){
+      pause();
+      _exit(0);
+    }
+    procs.push_back(pid);
+  }
+
+  unsigned long long running = 0;
+  unsigned long long start = Util::getMicros();
+  for (unsigned int r = 0; r < rounds; ++r){
+    for (unsigned int i = 0; i < procs.size(); ++i){running += Util::Procs::isRunning(procs[i]);}
+  }
+  unsigned long long duration = Util::getMicros() - start;
+  std::cout << "Util::Procs::isRunning: " << (duration * 1000 / rounds / procCount) << "ns per process per round ("
+            << (running / rounds) << " running)" << std::endl;
+
+  Util::PidWatch watch;
+  running = 0;
+  start = Util::getMicros();
+  for (unsigned int r = 0; r < rounds; ++r){
+    watch.update();
+    for (unsigned int i = 0; i < procs.size(); ++i){running += watch.isRunning(procs[i]);}
+    watch.prune();
+  }
+  duration = Util::getMicros() - start;
+  std::cout << "Util::PidWatch: " << (duration * 1000 / rounds / procCount) << "ns per process per round ("
+            << (running / rounds) << " running)" << std::endl;
+
+  for (unsigned int i = 0; i < procs.size(); ++i){kill(procs[i], SIGKILL);}
+  for (unsigned int i = 0; i < procs.size(); ++i){waitpid(procs[i], 0, 0);}
+
+  //Exit notification latency through the reaper thread
+  Util::Procs::setExitHandler(childExited);
+  const char * sleepArgs[] = {"sleep", "60", 0};
+  unsigned long long total = 0, worst = 0;
+  unsigned int kills = 10;
+  for (unsigned int i = 0; i < kills; ++i){
+    int fdIn = 0, fdOut = 0, fdErr = 0;
+    pid_t pid = Util::Procs::StartPiped(sleepArgs, &fdIn, &fdOut, &fdErr);
+    Util::sleep(50);
+    exitTime = 0;
+    start = Util::getMicros();
+    kill(pid, SIGKILL);
+    while (!exitTime){Util::sleep(1);}
+    unsigned long long latency = exitTime - start;
+    total += latency;
+    if (latency > worst){worst = latency;}
+  }
+  std::cout << "Exit handler called " << (total / kills) << "us after kill on average, " << worst << "us at worst" << std::endl;
+  return 0;
+}
@@ -0,0 +1,132 @@
+/// \file rtmp_send_bench.cpp
+/// Compares two ways of sending RTMP media messages: a separate blocking write for the chunk header, the FLV tag
+/// data header and every chunk of media data, against a single gather write per message.
+/// Both are simplified copies of the chunking OutRTMP::sendNext did before and after switching to gather writes,
+/// with fixed headers; this does not run OutRTMP itself. It first checks that the two copies produce the same bytes,
+/// then times both over a socket pair drained by a forked reader.
+/// Usage: rtmp_send_bench [messages] [message size] [chunk size]
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+#include <mist/socket.h>
+#include <mist/timing.h>
+
+/// Connection that keeps everything written to it.
+class Capture : public Socket::Connection{
+public:
+  std::string data;
+  Capture() : Socket::Connection(-1){}
+  bool connected() const{return true;}
+  void setBlocking(bool blocking){}
+
+protected:
+  unsigned int iwrite(const void * buffer, int len){
+    data.append((const char *)buffer, len);
+    return len;
+  }
+  unsigned int iwritev(const struct iovec * vec, int count){
+    unsigned int ret = 0;
+    for (int i = 0; i < count; ++i){ret += iwrite(vec[i].iov_base, vec[i].iov_len);}
+    return ret;
+  }
+};
+
+static const char header[] ={0x44, 0, 0, 40, 0, 0, 0, 0x09};
+static const char dataheader[] ={0x27, 1, 0, 0, 0};
+
+static void sendPieces(Socket::Connection & conn, const char * data, unsigned int len, unsigned int chunk){
+  conn.SendNow(header, 8);
+  unsigned int total = len + 5, sent = 0;
+  while (sent < total){
+    unsigned int toSend = std::min(total - sent, chunk);
+    if (!sent){
+      conn.SendNow(dataheader, 5);
+      toSend -= 5;
+      sent += 5;
+    }
+    conn.SendNow(data + sent - 5, toSend);
+    sent += toSend;
+    if (sent < total){conn.SendNow("\304", 1);}
+  }
+}
+
+static void sendGathered(Socket::Connection & conn, std::vector<struct iovec> & vecs, const char * data, unsigned int len, unsigned int chunk){
+  vecs.clear();
+  struct iovec vec;
+  vec.iov_base = (void *)header;
+  vec.iov_len = 8;
+  vecs.push_back(vec);
+  vec.iov_base = (void *)dataheader;
+  vec.iov_len = 5;
+  vecs.push_back(vec);
+  unsigned int total = len + 5, sent = 0;
+  while (sent < total){
+    unsigned int toSend = std::min(total - sent, chunk);
+    if (!sent){
+      toSend -= 5;
+      sent += 5;
+    }
+    vec.iov_base = (void *)(data + sent - 5);
+    vec.iov_len = toSend;
+    vecs.push_back(vec);
+    sent += toSend;
+    if (sent < total){
+      vec.iov_base = (void *)"\304";
+      vec.iov_len = 1;
+      vecs.push_back(vec);
+    }
+  }
+  conn.SendNow(&vecs[0], vecs.size());
+}
+
+int main(int argc, char ** argv){
+  unsigned int count = (argc > 1 ? atoi(argv[1]) : 100000);
+  unsigned int size = (argc > 2 ? atoi(argv[2]) : 8192);
+  unsigned int chunk = (argc > 3 ? atoi(argv[3]) : 4096);
+  std::string data(size, 'x');
+  for (unsigned int i = 0; i < size; ++i){data[i] = (char)(i * 7);}
+  std::vector<struct iovec> vecs;
+
+  Capture a, b;
+  sendPieces(a, data.data(), size, chunk);
+  sendGathered(b, vecs, data.data(), size, chunk);
+  if (a.data != b.data){
+    std::cerr << "Output differs!" << std::endl;
+    return 1;
+  }
+
+  for (unsigned int method = 0; method < 2; ++method){
+    int pair[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair)){return 1;}
+    pid_t reader = fork();
+    if (!reader){
+      close(pair[0]);
+      char buf[65536];
+      while (read(pair[1], buf, sizeof(buf)) > 0){}
+      _exit(0);
+    }
+    close(pair[1]);
+    Socket::Connection conn(pair[0]);
+    unsigned long long start = Util::getMicros();
+    for (unsigned int i = 0; i < count; ++i){
+      if (method){
+        sendGathered(conn, vecs, data.data(), size, chunk);
+      }else{
+        sendPieces(conn, data.data(), size, chunk);
+      }
+    }
+    unsigned long long duration = Util::getMicros() - start;
+    conn.close();
+    waitpid(reader, 0, 0);
+    std::cout << (method ? "Gather write" : "Separate writes") << ": " << (duration * 1000 / count) << "ns per message" << std::endl;
+  }
+  return 0;
+}
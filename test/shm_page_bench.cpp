@@ -0,0 +1,67 @@
+/// \file shm_page_bench.cpp
+/// Measures the cost of switching between shared data pages, the way a viewer does when crossing key pages.
+/// Reports the time per page switch and the minor faults taken per viewer.
+/// Build with and without -DSHM_HUGEPAGES=1 to compare; huge pages need /dev/shm mounted with huge=advise.
+/// Usage: shm_page_bench [viewers] [switches]
+
+#include <cstdlib>
+#include <iostream>
+#include <cstring>
+#include <cstdio>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <mist/shared_memory.h>
+#include <mist/timing.h>
+#include <mist/defines.h>
+
+#define BENCH_PAGES 4
+
+/// Maps every benchmark page in turn and reads all of its contents, like an output playing through them.
+static void viewer(unsigned int switches, bool populate){
+  struct rusage before, after;
+  getrusage(RUSAGE_SELF, &before);
+  unsigned long long start = Util::getMicros();
+  unsigned long long sum = 0;
+  IPC::sharedPage page;
+  char pageName[NAME_BUFFER_SIZE];
+  for (unsigned int i = 0; i < switches; ++i){
+    snprintf(pageName, NAME_BUFFER_SIZE, "MstBench_%u", i % BENCH_PAGES);
+    page.init(pageName, DEFAULT_DATA_PAGE_SIZE);
+    if (!page.mapped){
+      std::cerr << "Could not open " << pageName << std::endl;
+      return;
+    }
+    if (populate){page.populate();}
+    for (long long j = 0; j < page.len; j += 64){sum += page.mapped[j];}
+  }
+  unsigned long long duration = Util::getMicros() - start;
+  getrusage(RUSAGE_SELF, &after);
+  std::cout << (populate ? "populated" : "faulting ") << " viewer " << getpid() << ": " << (duration / switches) << "us/switch, " << ((after.ru_minflt - before.ru_minflt) / switches) << " minor faults/switch (" << (sum & 1) << ")" << std::endl;
+}
+
+int main(int argc, char ** argv){
+  unsigned int viewers = (argc > 1 ? atoi(argv[1]) : 8);
+  unsigned int switches = (argc > 2 ? atoi(argv[2]) : 100);
+  IPC::sharedPage pages[BENCH_PAGES];
+  char pageName[NAME_BUFFER_SIZE];
+  for (unsigned int i = 0; i < BENCH_PAGES; ++i){
+    snprintf(pageName, NAME_BUFFER_SIZE, "MstBench_%u", i);
+    pages[i].init(pageName, DEFAULT_DATA_PAGE_SIZE, true);
+    if (!pages[i].mapped){
+      std::cerr << "Could not create " << pageName << std::endl;
+      return 1;
+    }
+    memset(pages[i].mapped, i + 1, pages[i].len);
+  }
+  for (unsigned int pass = 0; pass < 2; ++pass){
+    for (unsigned int i = 0; i < viewers; ++i){
+      if (!fork()){
+        viewer(switches, pass);
+        _exit(0);//Skip destructors, which would unlink the pages
+      }
+    }
+    while (wait(0) > 0){}
+  }
+  return 0;
+}
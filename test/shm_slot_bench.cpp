@@ -0,0 +1,100 @@
+/// \file shm_slot_bench.cpp
+/// Measures IPC::sharedClient slot allocation under connection churn, and the cost of IPC::sharedServer::parseEach.
+/// Forks the given amount of worker processes that each connect, keep alive and finish clients as fast as they can,
+/// while the parent parses the page every 100ms like the controller and inputs do (but more often, to keep up).
+/// Afterwards, times parseEach on a page with a few live slots spread out between many freed ones.
+/// Usage: shm_slot_bench [workers] [connections per worker]
+
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <mist/defines.h>
+#include <mist/shared_memory.h>
+#include <mist/timing.h>
+
+#define BENCH_PAGE "MstSlotBench"
+
+static unsigned long long parsedSlots = 0;
+
+static void countSlot(char * data, size_t len, unsigned int id){++parsedSlots;}
+
+int main(int argc, char ** argv){
+  unsigned int workerCount = (argc > 1 ? atoi(argv[1]) : 8);
+  unsigned int connCount = (argc > 2 ? atoi(argv[2]) : 5000);
+  IPC::sharedServer server(BENCH_PAGE, STAT_EX_SIZE, true);
+
+  //Connection churn: every worker connects, keeps alive and disconnects connCount times
+  std::vector<pid_t> workers;
+  unsigned long long start = Util::getMicros();
+  for (unsigned int i = 0; i < workerCount; ++i){
+    pid_t pid = fork();
+    if (!pid){
+      for (unsigned int j = 0; j < connCount; ++j){
+        IPC::sharedClient client(BENCH_PAGE, STAT_EX_SIZE, true);
+        if (!client.getData()){_exit(1);}
+        client.keepAlive();
+        client.finish();
+      }
+      _exit(0);
+    }
+    workers.push_back(pid);
+  }
+  unsigned int running = workerCount;
+  unsigned long long parseTime = 0, parses = 0;
+  bool failed = false;
+  while (running){
+    unsigned long long parseStart = Util::getMicros();
+    server.parseEach(countSlot);
+    parseTime += Util::getMicros() - parseStart;
+    ++parses;
+    Util::sleep(100);
+    int status;
+    pid_t done;
+    while ((done = waitpid(-1, &status, WNOHANG)) > 0){
+      if (!WIFEXITED(status) || WEXITSTATUS(status)){failed = true;}
+      --running;
+    }
+  }
+  unsigned long long duration = Util::getMicros() - start;
+  if (failed){
+    std::cerr << "A worker could not claim a slot" << std::endl;
+    return 1;
+  }
+  std::cout << (workerCount * connCount) << " connections by " << workerCount << " workers in " << (duration / 1000)
+            << "ms: " << ((unsigned long long)workerCount * connCount * 1000000 / duration) << " connections/s, "
+            << parses << " parses averaging " << (parseTime / parses) << "us" << std::endl;
+
+  //Sparse page: 10000 clients, of which every 100th stays connected
+  std::vector<IPC::sharedClient *> clients;
+  for (unsigned int i = 0; i < 10000; ++i){
+    //The server only adds pages while parsing, so parse regularly while filling up.
+    //Clients that are not kept alive are considered unresponsive, and their process (us!) gets killed.
+    if (!(i % 500)){
+      for (unsigned int j = 0; j < clients.size(); ++j){clients[j]->keepAlive();}
+      server.parseEach(countSlot);
+    }
+    clients.push_back(new IPC::sharedClient(BENCH_PAGE, STAT_EX_SIZE, true));
+  }
+  for (unsigned int i = 0; i < clients.size(); ++i){
+    if (i % 100){clients[i]->finish();}
+  }
+  server.parseEach(countSlot);
+  parsedSlots = 0;
+  start = Util::getMicros();
+  for (unsigned int i = 0; i < 100; ++i){
+    server.parseEach(countSlot);
+    if (!(i % 5)){
+      for (unsigned int j = 0; j < clients.size(); j += 100){clients[j]->keepAlive();}
+    }
+  }
+  duration = Util::getMicros() - start;
+  std::cout << "Sparse page: " << (parsedSlots / 100) << " live slots, parseEach takes " << (duration / 100) << "us" << std::endl;
+  for (unsigned int i = 0; i < clients.size(); ++i){
+    if (!(i % 100)){clients[i]->finish();}
+    delete clients[i];
+  }
+  server.parseEach(countSlot);
+  return 0;
+}